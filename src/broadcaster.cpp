@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "broadcaster.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace {
+// Upper bound for sleeping while waiting on the queues; notifications are sent without holding the queue's mutex.
+constexpr std::chrono::milliseconds QUEUE_WAIT_TIMEOUT{10};
+}
+
+Broadcaster::Broadcaster(uint32_t cid, uint32_t numberOfProducers, uint32_t queueDepth) noexcept
+    : m_sender{"225.0.0." + std::to_string(cid), 12175} {
+    for (uint32_t i{0}; i < numberOfProducers; i++) {
+        m_queues.emplace_back(new SPSCQueue<std::string>(queueDepth));
+        m_buffers.emplace_back(new BufferPool(queueDepth + 2));
+    }
+    m_running.store(true);
+    m_senderThread = std::thread(&Broadcaster::run, this);
+}
+
+Broadcaster::~Broadcaster() {
+    stop();
+}
+
+bool Broadcaster::push(std::size_t producer, const std::string &serializedEnvelope) noexcept {
+    if (MAX_SIZE < serializedEnvelope.size()) {
+        m_tooLarge++;
+        return false;
+    }
+    auto &queue = m_queues[producer % m_queues.size()];
+    std::string copy{m_buffers[producer % m_buffers.size()]->acquire()};
+    copy.assign(serializedEnvelope);
+    const bool retVal{queue->push(std::move(copy))};
+    if (retVal) {
+        m_queueNotEmpty.notify_one();
+    }
+    else {
+        m_dropped++;
+    }
+    return retVal;
+}
+
+void Broadcaster::stop() noexcept {
+    if (m_running.exchange(false)) {
+        m_queueNotEmpty.notify_one();
+    }
+    if (m_senderThread.joinable()) {
+        m_senderThread.join();
+    }
+}
+
+uint64_t Broadcaster::dropped() const noexcept {
+    return m_dropped.load();
+}
+
+uint64_t Broadcaster::tooLarge() const noexcept {
+    return m_tooLarge.load();
+}
+
+void Broadcaster::run() noexcept {
+    auto allEmpty = [this]() {
+        for (const auto &queue : m_queues) {
+            if (!queue->empty()) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::string serializedEnvelope;
+    bool reportedError{false};
+    while (m_running.load()) {
+        // Take one frame from each queue in turn to not starve any camera.
+        bool sentAny{false};
+        for (std::size_t i{0}; i < m_queues.size(); i++) {
+            if (m_queues[i]->pop(serializedEnvelope)) {
+                auto result = m_sender.send(std::move(serializedEnvelope));
+                // UDPSender leaves the string intact so that its buffer can be reused.
+                m_buffers[i]->release(std::move(serializedEnvelope));
+                if ((0 > result.first) && !reportedError) {
+                    std::cerr << "[opendlv-video-h264-recorder]: Failed to broadcast frame: " << ::strerror(result.second) << "; not reporting further errors." << std::endl;
+                    reportedError = true;
+                }
+                sentAny = true;
+            }
+        }
+        if (!sentAny) {
+            std::unique_lock<std::mutex> lck(m_queueMutex);
+            m_queueNotEmpty.wait_for(lck, QUEUE_WAIT_TIMEOUT, [this, &allEmpty]{ return !m_running.load() || !allEmpty(); });
+        }
+    }
+}
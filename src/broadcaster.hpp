@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BROADCASTER_HPP
+#define BROADCASTER_HPP
+
+#include "buffer-pool.hpp"
+#include "cluon-complete.hpp"
+#include "spsc-queue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * This class publishes serialized Envelopes with encoded frames to an
+ * OD4Session for live viewing. The Envelopes are already serialized for the
+ * recording and are sent as they are to the session's multicast group from a
+ * dedicated thread; each encoding thread hands over its frames through a
+ * small bounded queue that drops frames when full so that a slow network
+ * never delays encoding.
+ */
+class Broadcaster {
+   private:
+    Broadcaster(const Broadcaster &) = delete;
+    Broadcaster(Broadcaster &&)      = delete;
+    Broadcaster &operator=(const Broadcaster &) = delete;
+    Broadcaster &operator=(Broadcaster &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param cid OD4Session to publish to.
+     * @param numberOfProducers Number of encoding threads, each with its own queue.
+     * @param queueDepth Number of frames to buffer per encoding thread.
+     */
+    Broadcaster(uint32_t cid, uint32_t numberOfProducers, uint32_t queueDepth) noexcept;
+    ~Broadcaster();
+
+    /**
+     * This method queues a copy of a serialized Envelope for sending; each
+     * producer must only be used from one encoding thread.
+     *
+     * @param producer Index of the encoding thread's queue.
+     * @param serializedEnvelope Serialized Envelope to send.
+     * @return true if the Envelope was queued; false if it was dropped.
+     */
+    bool push(std::size_t producer, const std::string &serializedEnvelope) noexcept;
+
+    /**
+     * This method stops the sending thread; queued Envelopes are discarded.
+     */
+    void stop() noexcept;
+
+    /**
+     * @return Number of Envelopes dropped because the queue was full.
+     */
+    uint64_t dropped() const noexcept;
+
+    /**
+     * @return Number of Envelopes not sent because they exceed the size of a UDP packet.
+     */
+    uint64_t tooLarge() const noexcept;
+
+   public:
+    static constexpr std::size_t MAX_SIZE{0xFFFF - 20 - 8}; // Maximum UDP payload over IPv4.
+
+   private:
+    void run() noexcept;
+
+   private:
+    cluon::UDPSender m_sender;
+    std::vector<std::unique_ptr<SPSCQueue<std::string>>> m_queues{};
+    std::vector<std::unique_ptr<BufferPool>> m_buffers{};
+    std::mutex m_queueMutex{};
+    std::condition_variable m_queueNotEmpty{};
+
+    std::atomic<bool> m_running{false};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_tooLarge{0};
+    std::thread m_senderThread{};
+};
+
+#endif
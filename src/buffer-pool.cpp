@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "buffer-pool.hpp"
+
+#include <algorithm>
+
+namespace {
+// The peak size decays by 1/64 per released buffer so that it follows the frame sizes within a few seconds.
+constexpr std::size_t PEAK_DECAY{64};
+// Buffers larger than this multiple of the reservation for new buffers are released to the system.
+constexpr std::size_t SHRINK_FACTOR{4};
+
+std::size_t reservation(std::size_t peakSize) noexcept {
+    return peakSize + peakSize / 4;
+}
+}
+
+BufferPool::BufferPool(uint32_t numberOfBuffers) noexcept
+    : m_freeBuffers(numberOfBuffers) {}
+
+std::string BufferPool::acquire() noexcept {
+    std::string retVal;
+    if (!m_freeBuffers.pop(retVal)) {
+        retVal.reserve(reservation(m_peakSize.load(std::memory_order_relaxed)));
+    }
+    return retVal;
+}
+
+void BufferPool::release(std::string &&buffer) noexcept {
+    const std::size_t LAST_PEAK{m_peakSize.load(std::memory_order_relaxed)};
+    const std::size_t PEAK{std::max(buffer.size(), LAST_PEAK - LAST_PEAK / PEAK_DECAY)};
+    m_peakSize.store(PEAK, std::memory_order_relaxed);
+
+    if (buffer.capacity() <= SHRINK_FACTOR * reservation(PEAK)) {
+        buffer.clear();
+        if (m_freeBuffers.push(std::move(buffer))) {
+            return;
+        }
+    }
+    // The buffer has grown too large or enough buffers are in circulation already.
+    std::string().swap(buffer);
+}
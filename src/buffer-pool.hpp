@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include "spsc-queue.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * This class recycles the buffers holding serialized Envelopes between the
+ * thread filling them and the thread consuming them so that encoded frames
+ * do not allocate memory in steady state. New buffers are reserved from the
+ * recently observed frame sizes, and buffers that have grown far beyond them,
+ * e.g. after a burst of large IDR frames, are released instead of recycled.
+ */
+class BufferPool {
+   private:
+    BufferPool(const BufferPool &) = delete;
+    BufferPool(BufferPool &&)      = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+    BufferPool &operator=(BufferPool &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param numberOfBuffers Number of buffers to keep for recycling.
+     */
+    explicit BufferPool(uint32_t numberOfBuffers) noexcept;
+
+    /**
+     * This method must only be called from the filling thread.
+     *
+     * @return Empty buffer, either recycled or with room for a typical frame.
+     */
+    std::string acquire() noexcept;
+
+    /**
+     * This method hands a buffer back once its content is consumed; it must
+     * only be called from the consuming thread.
+     *
+     * @param buffer Buffer obtained from acquire.
+     */
+    void release(std::string &&buffer) noexcept;
+
+   private:
+    SPSCQueue<std::string> m_freeBuffers;
+    std::atomic<std::size_t> m_peakSize{0}; // Slowly decaying maximum of the sizes handed back.
+};
+
+#endif
@@ -0,0 +1,529 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "camera-recorder.hpp"
+#include "opendlv-standard-message-set.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+// Interval to repeat waking up the encoding thread while a request is pending; notifications are not queued.
+constexpr std::chrono::milliseconds WAKE_UP_RETRY_INTERVAL{10};
+constexpr std::chrono::milliseconds STOP_POLL_INTERVAL{5};
+constexpr int64_t GEOMETRY_TIMEOUT{1000 * 1000}; // Microseconds for a producer to announce its replaced shared memory.
+
+int64_t steadyMicroseconds() noexcept {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+CameraRecorder::CameraRecorder(const CameraSettings &camera, const EncoderSettings &encoderSettings, const EncoderFactory &encoderFactory, const QualitySettings *quality, bool snapshotFrames, RecordingWriter &recordingWriter, Broadcaster *broadcaster, std::size_t producer) noexcept
+    : m_camera(camera)
+    , m_encoderSettings(encoderSettings)
+    , m_encoderFactory(encoderFactory)
+    , m_recordingWriter(recordingWriter)
+    , m_broadcaster(broadcaster)
+    , m_producer(producer)
+    , m_statistics(camera.name, camera.senderStamp, producer)
+    , m_frameRate(encoderSettings.fps) {
+    m_sharedMemory.reset(new cluon::SharedMemory{m_camera.name});
+    if (!m_sharedMemory || !m_sharedMemory->valid()) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to attach to shared memory '" << m_camera.name << "'." << std::endl;
+        return;
+    }
+    std::clog << "[opendlv-video-h264-recorder]: Attached to '" << m_sharedMemory->name() << "' (" << m_sharedMemory->size() << " bytes)." << std::endl;
+
+    FrameLayout layout;
+    layout.format = m_camera.format;
+    layout.width = m_camera.width;
+    layout.height = m_camera.height;
+    layout.stride = m_camera.stride;
+    layout.strideUV = m_camera.strideUV;
+    layout.planeHeight = m_camera.planeHeight;
+    layout.cropX = m_camera.cropX;
+    layout.cropY = m_camera.cropY;
+    layout.cropWidth = m_camera.cropWidth;
+    layout.cropHeight = m_camera.cropHeight;
+    m_frameConverter.reset(new FrameConverter(layout));
+    if (!m_frameConverter->valid()) {
+        std::cerr << "[opendlv-video-h264-recorder]: Crop region " << m_camera.cropWidth << "x" << m_camera.cropHeight << "+" << m_camera.cropX << "+" << m_camera.cropY << " must start at even coordinates within the frame of '" << m_camera.name << "'." << std::endl;
+        return;
+    }
+    if (m_frameConverter->needsConversion() && ((0 != (m_frameConverter->width() % 2)) || (0 != (m_frameConverter->height() % 2)))) {
+        std::cerr << "[opendlv-video-h264-recorder]: Converting '" << m_camera.name << "' to I420 requires an even width and height." << std::endl;
+        return;
+    }
+    if (m_sharedMemory->size() < m_frameConverter->sourceSize()) {
+        std::cerr << "[opendlv-video-h264-recorder]: Shared memory '" << m_camera.name << "' is too small for a frame of " << m_camera.width << "x" << m_camera.height << " (" << m_frameConverter->sourceSize() << " bytes)." << std::endl;
+        return;
+    }
+
+    // Allocate a buffer to snapshot frames so that the shared memory is only locked while copying or converting.
+    if (snapshotFrames || m_frameConverter->needsConversion()) {
+        const uint32_t FRAME_SIZE{m_frameConverter->needsConversion() ? m_frameConverter->i420Size() : m_frameConverter->sourceSize()};
+        m_frameBuffer.reset(new FrameBuffer(FRAME_SIZE));
+        if (!m_frameBuffer->valid()) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to allocate a frame buffer." << std::endl;
+            return;
+        }
+    }
+
+    // openh264 starts its worker threads while initializing; they inherit the cores of the creating thread.
+    cpu_set_t callerCores;
+    const bool RESTORE_CORES{!m_camera.scheduling.cores.empty() && (0 == ::pthread_getaffinity_np(::pthread_self(), sizeof(cpu_set_t), &callerCores))};
+    if (RESTORE_CORES) {
+        ThreadScheduling encoderThreads;
+        encoderThreads.cores = m_camera.scheduling.cores;
+        applyThreadScheduling(::pthread_self(), encoderThreads, "encoder threads of '" + m_camera.name + "'");
+    }
+    m_encoder = encoderFactory(encoderSettings, m_frameConverter->width(), m_frameConverter->height());
+    if (RESTORE_CORES) {
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set_t), &callerCores);
+    }
+    if (!m_encoder || !m_encoder->valid()) {
+        return;
+    }
+
+    if (encoderSettings.autoFps) {
+        m_frameRateEstimator.reset(new FrameRateEstimator(encoderSettings.fps));
+    }
+    if (nullptr != quality) {
+        m_qualityController.reset(new QualityController(*quality, encoderSettings));
+    }
+    if (0.0f < m_camera.staticThreshold) {
+        m_staticSceneFilter.reset(new StaticSceneFilter(m_frameConverter->width(), m_frameConverter->height(), m_camera.staticThreshold, static_cast<int64_t>(m_camera.staticKeepAlive) * 1000));
+    }
+
+    m_geometry.store((static_cast<uint64_t>(m_camera.width) << 32) | m_camera.height);
+
+    // The NAL units of each layer are serialized directly from the encoder's buffers.
+    m_layers.resize(1 + encoderSettings.layers.size());
+    for (auto &layer : m_layers) {
+        layer.chunks.reserve(VideoEncoder::MAX_CHUNKS);
+    }
+    m_valid = true;
+}
+
+CameraRecorder::~CameraRecorder() {
+    join();
+}
+
+bool CameraRecorder::valid() const noexcept {
+    return m_valid;
+}
+
+CameraStatistics &CameraRecorder::statistics() noexcept {
+    return m_statistics;
+}
+
+void CameraRecorder::start() noexcept {
+    if (m_valid && !m_thread.joinable()) {
+        m_lastFrame.store(steadyMicroseconds());
+        m_thread = std::thread(&CameraRecorder::run, this);
+        applyThreadScheduling(m_thread.native_handle(), m_camera.scheduling, "encoding thread of '" + m_camera.name + "'");
+        m_watching = true;
+        m_watchdog = std::thread(&CameraRecorder::watch, this);
+    }
+}
+
+bool CameraRecorder::stop(std::chrono::steady_clock::time_point deadline) noexcept {
+    {
+        // The watchdog wakes up the encoding thread if it is waiting for a frame.
+        std::lock_guard<std::mutex> lck(m_wakeUpMutex);
+        m_stopping.store(true);
+    }
+    m_wakeUpCondition.notify_all();
+    while (running() && (std::chrono::steady_clock::now() < deadline)) {
+        std::this_thread::sleep_for(STOP_POLL_INTERVAL);
+    }
+    return !running();
+}
+
+bool CameraRecorder::running() const noexcept {
+    return m_thread.joinable() && !m_finished.load();
+}
+
+void CameraRecorder::join() noexcept {
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lck(m_wakeUpMutex);
+        m_watching = false;
+    }
+    m_wakeUpCondition.notify_all();
+    if (m_watchdog.joinable()) {
+        m_watchdog.join();
+    }
+}
+
+bool CameraRecorder::wakeUpRequested() const noexcept {
+    return m_stopping.load() || (0 != m_requestedGeometry.load()) || cluon::TerminateHandler::instance().isTerminated.load();
+}
+
+void CameraRecorder::watch() noexcept {
+    // The encoding thread blocks on the producer's notifications; only a notification wakes it up
+    // before the next frame, which also wakes up the other consumers of the shared memory.
+    const int64_t TIMEOUT{static_cast<int64_t>(m_camera.waitTimeout) * 1000};
+    int64_t stallDeadline{m_lastFrame.load() + TIMEOUT};
+    auto changed = [this]{ return !m_watching || wakeUpRequested(); };
+    std::unique_lock<std::mutex> lck(m_wakeUpMutex);
+    while (m_watching) {
+        if (wakeUpRequested()) {
+            // A notification sent right before the encoding thread starts waiting is lost; hence, it is repeated while waiting.
+            if (m_waiting.load()) {
+                m_notifications++;
+                m_sharedMemory->notifyAll();
+            }
+            m_wakeUpCondition.wait_for(lck, WAKE_UP_RETRY_INTERVAL, [this]{ return !m_watching; });
+            continue;
+        }
+        if (0 < TIMEOUT) {
+            m_wakeUpCondition.wait_for(lck, std::chrono::microseconds(std::max<int64_t>(stallDeadline - steadyMicroseconds(), 0)), changed);
+        }
+        else {
+            m_wakeUpCondition.wait(lck, changed);
+        }
+        if (changed()) {
+            continue;
+        }
+        const int64_t NOW{steadyMicroseconds()};
+        stallDeadline = m_lastFrame.load() + TIMEOUT;
+        if (stallDeadline <= NOW) {
+            // The encoding thread counts the stall when woken up without a frame.
+            if (m_waiting.load()) {
+                m_notifications++;
+                m_sharedMemory->notifyAll();
+            }
+            stallDeadline = NOW + TIMEOUT;
+        }
+    }
+}
+
+void CameraRecorder::resize(uint32_t width, uint32_t height) noexcept {
+    const uint64_t GEOMETRY{(static_cast<uint64_t>(width) << 32) | height};
+    if ((GEOMETRY != m_geometry.load()) && (GEOMETRY != m_requestedGeometry.exchange(GEOMETRY))) {
+        // The watchdog wakes up the encoding thread, which may wait on a shared memory that the producer has replaced.
+        {
+            // Order the request before the watchdog checks for it.
+            std::lock_guard<std::mutex> lck(m_wakeUpMutex);
+        }
+        m_wakeUpCondition.notify_all();
+    }
+}
+
+bool CameraRecorder::reconfigure(uint32_t width, uint32_t height) noexcept {
+    if ((width == m_camera.width) && (height == m_camera.height) && m_sharedMemory->valid()) {
+        return true;
+    }
+    const int64_t START{steadyMicroseconds()};
+
+    // Strides configured for the previous geometry are derived from the new width instead.
+    FrameLayout layout;
+    layout.format = m_camera.format;
+    layout.width = width;
+    layout.height = height;
+    layout.cropX = m_camera.cropX;
+    layout.cropY = m_camera.cropY;
+    layout.cropWidth = m_camera.cropWidth;
+    layout.cropHeight = m_camera.cropHeight;
+    std::unique_ptr<FrameConverter> frameConverter{new FrameConverter(layout)};
+    if (!frameConverter->valid() || (frameConverter->needsConversion() && ((0 != (frameConverter->width() % 2)) || (0 != (frameConverter->height() % 2))))) {
+        std::cerr << "[opendlv-video-h264-recorder]: Cannot record '" << m_camera.name << "' at " << width << "x" << height << "; continuing with " << m_camera.width << "x" << m_camera.height << "." << std::endl;
+        return false;
+    }
+
+    // The producer may have replaced the shared memory by one of the same or a smaller size; hence, it is always attached again.
+    std::unique_ptr<cluon::SharedMemory> sharedMemory{new cluon::SharedMemory{m_camera.name}};
+    if (!sharedMemory->valid() || (sharedMemory->size() < frameConverter->sourceSize())) {
+        std::cerr << "[opendlv-video-h264-recorder]: Shared memory '" << m_camera.name << "' is too small for a frame of " << width << "x" << height << " (" << frameConverter->sourceSize() << " bytes); continuing with " << m_camera.width << "x" << m_camera.height << "." << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<FrameBuffer> frameBuffer{nullptr};
+    if (m_frameBuffer) {
+        const uint32_t FRAME_SIZE{frameConverter->needsConversion() ? frameConverter->i420Size() : frameConverter->sourceSize()};
+        frameBuffer.reset(new FrameBuffer(FRAME_SIZE));
+        if (!frameBuffer->valid()) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to allocate a frame buffer; continuing with " << m_camera.width << "x" << m_camera.height << "." << std::endl;
+            return false;
+        }
+    }
+
+    // The encoding thread already runs on the camera's cores, which new encoder threads inherit.
+    const bool REUSED{m_encoder->resize(frameConverter->width(), frameConverter->height())};
+    if (!REUSED) {
+        std::unique_ptr<VideoEncoder> encoder{createEncoder(frameConverter->width(), frameConverter->height())};
+        if (!encoder) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to create encoder for " << frameConverter->width() << "x" << frameConverter->height() << "; continuing with " << m_camera.width << "x" << m_camera.height << "." << std::endl;
+            if (!m_encoder->valid()) {
+                // The failed resize left the encoder unusable.
+                m_encoder = createEncoder(m_frameConverter->width(), m_frameConverter->height());
+                if (!m_encoder) {
+                    std::cerr << "[opendlv-video-h264-recorder]: Failed to restore the encoder of '" << m_camera.name << "'; its recording ends." << std::endl;
+                    m_stopping.store(true);
+                }
+            }
+            return false;
+        }
+        m_encoder = std::move(encoder);
+    }
+    m_encoder->forceKeyFrame();
+
+    {
+        // The watchdog notifies the shared memory that is waited on.
+        std::lock_guard<std::mutex> lck(m_wakeUpMutex);
+        m_sharedMemory = std::move(sharedMemory);
+    }
+    std::clog << "[opendlv-video-h264-recorder]: Attached to '" << m_sharedMemory->name() << "' (" << m_sharedMemory->size() << " bytes)." << std::endl;
+    if (m_frameBuffer) {
+        m_frameBuffer = std::move(frameBuffer);
+    }
+    if (m_staticSceneFilter) {
+        m_staticSceneFilter.reset(new StaticSceneFilter(frameConverter->width(), frameConverter->height(), m_camera.staticThreshold, static_cast<int64_t>(m_camera.staticKeepAlive) * 1000));
+    }
+    m_frameConverter = std::move(frameConverter);
+    std::clog << "[opendlv-video-h264-recorder]: Changed '" << m_camera.name << "' from " << m_camera.width << "x" << m_camera.height << " to " << width << "x" << height << " in " << (steadyMicroseconds() - START) / 1000 << " ms by " << (REUSED ? "reconfiguring" : "recreating") << " the encoder." << std::endl;
+    m_camera.width = width;
+    m_camera.height = height;
+    m_geometry.store((static_cast<uint64_t>(width) << 32) | height);
+    m_camera.stride = 0;
+    m_camera.strideUV = 0;
+    m_camera.planeHeight = 0;
+    return true;
+}
+
+std::unique_ptr<VideoEncoder> CameraRecorder::createEncoder(uint32_t width, uint32_t height) noexcept {
+    std::unique_ptr<VideoEncoder> encoder{m_encoderFactory(m_encoderSettings, width, height)};
+    if (!encoder || !encoder->valid()) {
+        return nullptr;
+    }
+    encoder->setFrameRate(m_frameRate);
+    if (m_qualityController) {
+        encoder->setBitrate(m_qualityController->bitrate());
+        encoder->setComplexity(m_qualityController->complexity());
+        encoder->setFrameSkip(m_qualityController->frameSkip());
+    }
+    return encoder;
+}
+
+bool CameraRecorder::waitForGeometry() noexcept {
+    // Producers destroy and recreate their shared memory for a camera mode change, which breaks the attached one.
+    std::unique_lock<std::mutex> lck(m_wakeUpMutex);
+    m_wakeUpCondition.wait_for(lck, std::chrono::microseconds(GEOMETRY_TIMEOUT), [this]{ return wakeUpRequested(); });
+    return !m_stopping.load() && (0 != m_requestedGeometry.load());
+}
+
+void CameraRecorder::countMissedFrames(int64_t sampleTimeStamp, int64_t beforeWait) noexcept {
+    // The estimated frame rate follows the received frames only; hence, it cannot tell how many were missed.
+    const int64_t INTERVAL{m_frameRateEstimator ? m_frameRateEstimator->shortestInterval() : static_cast<int64_t>(1000000.0f / m_frameRate)};
+    const int64_t DELTA{sampleTimeStamp - m_lastSampleTimeStamp};
+    if ((0 < m_lastSampleTimeStamp) && (0 < INTERVAL) && (DELTA > INTERVAL + INTERVAL / 2)) {
+        const uint64_t MISSING{static_cast<uint64_t>(std::llround(static_cast<double>(DELTA) / static_cast<double>(INTERVAL))) - 1};
+        // Frames sent while not waiting for a notification were missed; all others were not sent by the producer.
+        const uint64_t BUSY{static_cast<uint64_t>(std::max<int64_t>(beforeWait - m_lastWakeUp, 0) / INTERVAL)};
+        const uint64_t MISSED{std::min(MISSING, BUSY)};
+        m_statistics.missed += MISSED;
+        m_statistics.gaps += MISSING - MISSED;
+    }
+}
+
+void CameraRecorder::run() noexcept {
+    const std::string FOURCC{"h264"};
+    const bool CONVERT{m_frameConverter->needsConversion()};
+    cluon::data::TimeStamp sampleTimeStamp;
+
+    while (m_sharedMemory && !m_stopping.load() && !cluon::TerminateHandler::instance().isTerminated.load()) {
+        if (!m_sharedMemory->valid() && !waitForGeometry()) {
+            break;
+        }
+        const uint64_t GEOMETRY{m_requestedGeometry.exchange(0)};
+        if (0 != GEOMETRY) {
+            reconfigure(static_cast<uint32_t>(GEOMETRY >> 32), static_cast<uint32_t>(GEOMETRY & 0xFFFFFFFF));
+        }
+
+        // Wait for incoming frame; the watchdog checks for m_waiting after posting a request.
+        const cluon::data::TimeStamp BEFORE_WAIT{cluon::time::now()};
+        const uint64_t NOTIFICATIONS{m_notifications.load()};
+        m_waiting.store(true);
+        if (!wakeUpRequested()) {
+            m_sharedMemory->wait();
+        }
+        m_waiting.store(false);
+
+        sampleTimeStamp = cluon::time::now();
+        const cluon::data::TimeStamp WAKE_UP{sampleTimeStamp};
+
+        uint8_t *frame{nullptr};
+        m_sharedMemory->lock();
+        const cluon::data::TimeStamp LOCKED{cluon::time::now()};
+        // Read notification timestamp; producers that do not set it keep the one of the shared memory's creation.
+        auto r = m_sharedMemory->getTimeStamp();
+        const int64_t PRODUCER_TIMESTAMP{r.first ? cluon::time::toMicroseconds(r.second) : 0};
+        const bool STAMPED{PRODUCER_TIMESTAMP != m_lastProducerTimeStamp};
+        if (!STAMPED && ((NOTIFICATIONS != m_notifications.load()) || wakeUpRequested())) {
+            // Woken up by the watchdog without a new frame.
+            m_sharedMemory->unlock();
+            const int64_t SINCE_LAST_FRAME{steadyMicroseconds() - m_lastFrame.load()};
+            if ((0 < m_camera.waitTimeout) && (static_cast<int64_t>(m_camera.waitTimeout) * 1000 <= SINCE_LAST_FRAME)) {
+                if (!m_timedOut) {
+                    std::cerr << "[opendlv-video-h264-recorder]: Warning, no frame from '" << m_camera.name << "' for " << SINCE_LAST_FRAME / 1000 << " ms." << std::endl;
+                    m_timedOut = true;
+                }
+                m_statistics.stalls++;
+            }
+            m_lastWakeUp = cluon::time::toMicroseconds(WAKE_UP);
+            continue;
+        }
+        m_lastProducerTimeStamp = PRODUCER_TIMESTAMP;
+        sampleTimeStamp = STAMPED ? r.second : WAKE_UP;
+        if (m_timedOut) {
+            std::clog << "[opendlv-video-h264-recorder]: Frames from '" << m_camera.name << "' resumed after " << (steadyMicroseconds() - m_lastFrame.load()) / 1000 << " ms." << std::endl;
+            m_timedOut = false;
+        }
+        m_lastFrame.store(steadyMicroseconds());
+        m_statistics.wait.record(cluon::time::deltaInMicroseconds(WAKE_UP, BEFORE_WAIT));
+        countMissedFrames(cluon::time::toMicroseconds(sampleTimeStamp), cluon::time::toMicroseconds(BEFORE_WAIT));
+        m_lastSampleTimeStamp = cluon::time::toMicroseconds(sampleTimeStamp);
+        m_lastWakeUp = cluon::time::toMicroseconds(WAKE_UP);
+        if (m_frameRateEstimator && m_frameRateEstimator->update(cluon::time::toMicroseconds(sampleTimeStamp))) {
+            m_frameRate = m_frameRateEstimator->frameRate();
+            if (m_encoder->setFrameRate(m_frameRate)) {
+                std::clog << "[opendlv-video-h264-recorder]: Frame rate of '" << m_camera.name << "' changed to " << m_frameRateEstimator->frameRate() << " FPS." << std::endl;
+            }
+        }
+        if (m_sharedMemory->size() < m_frameConverter->sourceSize()) {
+            // A replaced shared memory is too small for the frames until their new geometry is announced.
+            m_sharedMemory->unlock();
+            m_statistics.lockHold.record(cluon::time::deltaInMicroseconds(cluon::time::now(), LOCKED));
+            m_statistics.skipped++;
+            continue;
+        }
+        if (m_qualityController && !m_qualityController->encodeNextFrame()) {
+            // Decimated to keep up with the camera.
+            m_sharedMemory->unlock();
+            m_statistics.lockHold.record(cluon::time::deltaInMicroseconds(cluon::time::now(), LOCKED));
+            m_statistics.skipped++;
+            continue;
+        }
+        const uint8_t *data{reinterpret_cast<const uint8_t*>(m_sharedMemory->data())};
+        bool locked{true};
+        if (m_frameBuffer) {
+            // Snapshot the frame and release the producer right away; converted frames do not depend on the shared memory either.
+            frame = m_frameBuffer->data();
+            if (CONVERT) {
+                m_frameConverter->toI420(data, frame);
+            }
+            else {
+                memcpy(frame, data, m_frameConverter->sourceSize());
+            }
+            m_sharedMemory->unlock();
+            m_statistics.lockHold.record(cluon::time::deltaInMicroseconds(cluon::time::now(), LOCKED));
+            locked = false;
+        }
+        else {
+            frame = const_cast<uint8_t*>(data);
+        }
+
+        // Converted frames are tightly packed; I420 frames keep the strides of the shared memory.
+        const I420Picture PICTURE{CONVERT ? m_frameConverter->packedPicture(frame) : m_frameConverter->picture(frame)};
+        if (m_keyFrameRequests != m_recordingWriter.keyFrameRequests()) {
+            // The recording continues in a new segment that shall start with an IDR frame.
+            m_keyFrameRequests = m_recordingWriter.keyFrameRequests();
+            m_encoder->forceKeyFrame();
+        }
+        else if (m_staticSceneFilter && !m_staticSceneFilter->keep(PICTURE.y, PICTURE.strideY, cluon::time::toMicroseconds(sampleTimeStamp))) {
+            if (locked) {
+                m_sharedMemory->unlock();
+                m_statistics.lockHold.record(cluon::time::deltaInMicroseconds(cluon::time::now(), LOCKED));
+            }
+            m_statistics.unchanged++;
+            continue;
+        }
+
+        const cluon::data::TimeStamp BEFORE_ENCODING{cluon::time::now()};
+        bool isKeyFrame{false};
+        const std::size_t totalSize{m_encoder->encode(PICTURE, m_layers, isKeyFrame)};
+        const cluon::data::TimeStamp AFTER_ENCODING{cluon::time::now()};
+        m_statistics.encode.record(cluon::time::deltaInMicroseconds(AFTER_ENCODING, BEFORE_ENCODING));
+
+        if (locked) {
+            m_sharedMemory->unlock();
+            m_statistics.lockHold.record(cluon::time::deltaInMicroseconds(cluon::time::now(), LOCKED));
+        }
+
+        m_statistics.frames++;
+        if (0 == totalSize) {
+            m_statistics.skipped++;
+            continue;
+        }
+        m_statistics.bytes += totalSize;
+
+        // The NAL buffers stay valid until the next call to encode; each layer is sent as its own Envelope.
+        int64_t serializeDuration{0};
+        int64_t writeDuration{0};
+        for (std::size_t i{0}; i < m_layers.size(); i++) {
+            const EncodedLayer &LAYER = m_layers[i];
+            if (0 == LAYER.size) {
+                continue;
+            }
+            const uint32_t SENDER_STAMP{m_camera.senderStamp + static_cast<uint32_t>(i) * m_camera.layerIdOffset};
+            const cluon::data::TimeStamp BEFORE_SERIALIZING{cluon::time::now()};
+            std::string serializedEnvelope{m_recordingWriter.buffer(m_producer)};
+            if (!serializeImageReadingEnvelope(serializedEnvelope, FOURCC, LAYER.width, LAYER.height, LAYER.chunks.data(), LAYER.chunks.size(), BEFORE_SERIALIZING, sampleTimeStamp, SENDER_STAMP)) {
+                std::cerr << "[opendlv-video-h264-recorder]: Warning, frame of " << LAYER.size << " bytes exceeds maximum Envelope size; dropping frame." << std::endl;
+                m_statistics.dropped++;
+                continue;
+            }
+            const cluon::data::TimeStamp AFTER_SERIALIZING{cluon::time::now()};
+            serializeDuration += cluon::time::deltaInMicroseconds(AFTER_SERIALIZING, BEFORE_SERIALIZING);
+
+            if (nullptr != m_broadcaster) {
+                m_broadcaster->push(m_producer, serializedEnvelope);
+            }
+
+            IndexEntry entry;
+            entry.sampleTimeStamp = cluon::time::toMicroseconds(sampleTimeStamp);
+            entry.dataType = opendlv::proxy::ImageReading::ID();
+            entry.senderStamp = SENDER_STAMP;
+            entry.keyFrame = isKeyFrame;
+            if (!m_recordingWriter.push(m_producer, std::move(serializedEnvelope), entry)) {
+                m_statistics.dropped++;
+            }
+            writeDuration += cluon::time::deltaInMicroseconds(cluon::time::now(), AFTER_SERIALIZING);
+        }
+        m_statistics.serialize.record(serializeDuration);
+        m_statistics.write.record(writeDuration);
+
+        if (m_qualityController) {
+            // Without a writer queue, frames are written while handing them over; the disk load is the share of the frame interval spent on it.
+            const std::size_t QUEUE_DEPTH{m_recordingWriter.queueDepth()};
+            const float QUEUE_FILL{(0 < QUEUE_DEPTH) ? static_cast<float>(m_recordingWriter.queued(m_producer)) / static_cast<float>(QUEUE_DEPTH) : std::min(static_cast<float>(writeDuration) * m_frameRate / 1000000.0f, 1.0f)};
+            if (m_qualityController->update(cluon::time::deltaInMicroseconds(cluon::time::now(), LOCKED), QUEUE_FILL, m_frameRate, *m_encoder)) {
+                std::clog << "[opendlv-video-h264-recorder]: Adapted '" << m_camera.name << "' to bitrate=" << m_qualityController->bitrate() << " complexity=" << m_qualityController->complexity() << " frame-skip=" << m_qualityController->frameSkip() << " decimation=" << m_qualityController->decimation() << "." << std::endl;
+            }
+        }
+    }
+    m_finished.store(true);
+}
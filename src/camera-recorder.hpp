@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAMERA_RECORDER_HPP
+#define CAMERA_RECORDER_HPP
+
+#include "broadcaster.hpp"
+#include "cluon-complete.hpp"
+#include "frame-buffer.hpp"
+#include "frame-converter.hpp"
+#include "frame-rate-estimator.hpp"
+#include "quality-controller.hpp"
+#include "recorder-statistics.hpp"
+#include "recording-writer.hpp"
+#include "static-scene-filter.hpp"
+#include "thread-scheduling.hpp"
+#include "video-encoder.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * This struct describes one camera's shared memory area.
+ */
+struct CameraSettings {
+    std::string name{};
+    uint32_t width{0};
+    uint32_t height{0};
+    PixelFormat format{PixelFormat::I420};
+    uint32_t stride{0}; // Bytes per row of the first plane; 0 for tightly packed rows.
+    uint32_t strideUV{0}; // Bytes per row of the chroma plane(s); 0 to derive from stride.
+    uint32_t planeHeight{0}; // Rows of the first plane including padding; 0 for height.
+    uint32_t cropX{0}; // Region to encode; cropWidth and cropHeight of 0 for the whole frame.
+    uint32_t cropY{0};
+    uint32_t cropWidth{0};
+    uint32_t cropHeight{0};
+    uint32_t senderStamp{0};
+    uint32_t layerIdOffset{100}; // Downscaled layer i is sent with senderStamp + i * layerIdOffset.
+    ThreadScheduling scheduling{}; // CPU cores and real-time priority of the encoding thread.
+    float staticThreshold{0.0f}; // Mean absolute difference of the Y plane below which a frame is not encoded; 0 to encode all frames.
+    uint32_t staticKeepAlive{1000}; // Milliseconds between two encoded frames of an unchanged scene.
+    uint32_t waitTimeout{0}; // Milliseconds without a frame until the camera is reported as stalled; 0 to wait indefinitely.
+};
+
+/**
+ * This class attaches to one shared memory area and encodes its frames in a
+ * dedicated thread; the encoded frames are handed to a RecordingWriter.
+ */
+class CameraRecorder {
+   private:
+    CameraRecorder(const CameraRecorder &) = delete;
+    CameraRecorder(CameraRecorder &&)      = delete;
+    CameraRecorder &operator=(const CameraRecorder &) = delete;
+    CameraRecorder &operator=(CameraRecorder &&) = delete;
+
+   public:
+    using EncoderFactory = std::function<std::unique_ptr<VideoEncoder>(const EncoderSettings &settings, uint32_t width, uint32_t height)>;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param camera Shared memory area and geometry of the camera.
+     * @param encoderSettings Settings for the encoder.
+     * @param encoderFactory Function to create the encoder backend.
+     * @param quality Limits to adapt the encoder to the load of the recorder; nullptr to keep the settings.
+     * @param snapshotFrames True to copy frames to a buffer before encoding; otherwise, frames that need no conversion are encoded while locked.
+     * @param recordingWriter Writer to hand over encoded frames to.
+     * @param broadcaster Broadcaster to also publish encoded frames with; nullptr to only record.
+     * @param producer Index of this camera's queue in recordingWriter and broadcaster.
+     */
+    CameraRecorder(const CameraSettings &camera, const EncoderSettings &encoderSettings, const EncoderFactory &encoderFactory, const QualitySettings *quality, bool snapshotFrames, RecordingWriter &recordingWriter, Broadcaster *broadcaster, std::size_t producer) noexcept;
+    ~CameraRecorder();
+
+    /**
+     * @return True if the shared memory could be attached and the encoder is ready.
+     */
+    bool valid() const noexcept;
+
+    /**
+     * @return Per-stage latencies and counters of this camera.
+     */
+    CameraStatistics &statistics() noexcept;
+
+    /**
+     * This method starts encoding in a separate thread.
+     */
+    void start() noexcept;
+
+    /**
+     * This method announces a new geometry of the frames in the shared
+     * memory, e.g., after a camera mode change; the encoding thread is
+     * woken up to reconfigure itself before waiting for the next frame,
+     * which is encoded as IDR frame. Announcing the current geometry has no
+     * effect.
+     *
+     * @param width New width of the frames.
+     * @param height New height of the frames.
+     */
+    void resize(uint32_t width, uint32_t height) noexcept;
+
+    /**
+     * This method asks the encoding thread to finish after the current
+     * frame and wakes it up repeatedly in case it is waiting for a frame.
+     *
+     * @param deadline Time until which to wait for the encoding thread.
+     * @return True if the encoding thread has finished; join() can then be called without blocking.
+     */
+    bool stop(std::chrono::steady_clock::time_point deadline) noexcept;
+
+    /**
+     * @return True while the encoding thread is running.
+     */
+    bool running() const noexcept;
+
+    /**
+     * This method waits for the encoding thread to finish.
+     */
+    void join() noexcept;
+
+   private:
+    void run() noexcept;
+    void watch() noexcept;
+    bool wakeUpRequested() const noexcept;
+    void countMissedFrames(int64_t sampleTimeStamp, int64_t beforeWait) noexcept;
+    bool reconfigure(uint32_t width, uint32_t height) noexcept;
+    std::unique_ptr<VideoEncoder> createEncoder(uint32_t width, uint32_t height) noexcept;
+    bool waitForGeometry() noexcept;
+
+   private:
+    CameraSettings m_camera;
+    EncoderSettings m_encoderSettings;
+    EncoderFactory m_encoderFactory;
+    RecordingWriter &m_recordingWriter;
+    Broadcaster *m_broadcaster;
+    std::size_t m_producer;
+    uint32_t m_keyFrameRequests{0};
+    bool m_valid{false};
+    CameraStatistics m_statistics;
+
+    std::unique_ptr<cluon::SharedMemory> m_sharedMemory{nullptr};
+    std::unique_ptr<FrameConverter> m_frameConverter{nullptr};
+    std::unique_ptr<FrameBuffer> m_frameBuffer{nullptr};
+    std::unique_ptr<VideoEncoder> m_encoder{nullptr};
+    std::unique_ptr<FrameRateEstimator> m_frameRateEstimator{nullptr};
+    std::unique_ptr<QualityController> m_qualityController{nullptr};
+    std::unique_ptr<StaticSceneFilter> m_staticSceneFilter{nullptr};
+    float m_frameRate;
+    std::vector<EncodedLayer> m_layers{};
+    std::thread m_thread{};
+    std::atomic<bool> m_stopping{false};
+    std::atomic<bool> m_finished{false};
+    std::atomic<uint64_t> m_geometry{0};          // Width in the upper, height in the lower 32 bits.
+    std::atomic<uint64_t> m_requestedGeometry{0}; // As m_geometry; 0 if unchanged.
+
+    // Timestamps in microseconds to detect frames that were not waited for.
+    int64_t m_lastSampleTimeStamp{0};
+    int64_t m_lastProducerTimeStamp{0}; // As set by the producer; unchanged if the producer does not set it.
+    int64_t m_lastWakeUp{0};
+
+    // Steady microseconds to report a stalled camera after waitTimeout.
+    std::atomic<int64_t> m_lastFrame{0};
+    bool m_timedOut{false};
+
+    // The watchdog wakes up the encoding thread from waiting on the shared memory when a frame is overdue or for a request.
+    std::mutex m_wakeUpMutex{};
+    std::condition_variable m_wakeUpCondition{};
+    bool m_watching{false};
+    std::atomic<bool> m_waiting{false};
+    std::atomic<uint64_t> m_notifications{0};
+    std::thread m_watchdog{};
+};
+
+#endif
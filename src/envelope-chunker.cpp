@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "envelope-chunker.hpp"
+#include "envelope-serializer.hpp"
+
+#if defined(HAVE_ZLIB_H)
+#include <zlib.h>
+#endif
+#if defined(HAVE_ZSTD_H)
+#include <zstd.h>
+#endif
+
+namespace {
+// Fast levels to keep the writer thread ahead of the incoming Envelopes.
+#if defined(HAVE_ZLIB_H)
+const int ZLIB_LEVEL{1};
+#endif
+#if defined(HAVE_ZSTD_H)
+const int ZSTD_LEVEL{1};
+#endif
+
+void putLittleEndian(char *out, uint32_t value) noexcept {
+    for (std::size_t i{0}; i < 4; i++) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+}
+
+constexpr int32_t EnvelopeChunker::DATATYPE;
+constexpr std::size_t EnvelopeChunker::HEADER_SIZE;
+
+bool EnvelopeChunker::parseCodec(const std::string &name, Codec &codec) noexcept {
+#if defined(HAVE_ZLIB_H)
+    if ("zlib" == name) {
+        codec = Codec::ZLIB;
+        return true;
+    }
+#endif
+#if defined(HAVE_ZSTD_H)
+    if ("zstd" == name) {
+        codec = Codec::ZSTD;
+        return true;
+    }
+#endif
+    (void)name;
+    (void)codec;
+    return false;
+}
+
+EnvelopeChunker::EnvelopeChunker(Codec codec, uint32_t chunkSize, int64_t intervalInMicroseconds) noexcept
+    : m_codec(codec)
+    , m_chunkSize(chunkSize)
+    , m_interval(intervalInMicroseconds) {
+    m_envelopes.reserve(m_chunkSize + 64 * 1024);
+}
+
+void EnvelopeChunker::add(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry, int64_t now) noexcept {
+    if (0 == m_numberOfEnvelopes) {
+        m_firstSampleTimeStamp = entry.sampleTimeStamp;
+        m_firstAdded = now;
+    }
+    m_envelopes.append(data1, size1);
+    if (0 < size2) {
+        m_envelopes.append(data2, size2);
+    }
+    m_numberOfEnvelopes++;
+}
+
+bool EnvelopeChunker::due(int64_t now) const noexcept {
+    return (0 < m_numberOfEnvelopes) && ((m_chunkSize <= m_envelopes.size()) || (m_interval <= now - m_firstAdded));
+}
+
+bool EnvelopeChunker::empty() const noexcept {
+    return 0 == m_numberOfEnvelopes;
+}
+
+bool EnvelopeChunker::take(std::string &serializedChunk, IndexEntry &entry) noexcept {
+    if (0 == m_numberOfEnvelopes) {
+        return false;
+    }
+
+    const bool COMPRESSED{compress(m_envelopes, m_compressed)};
+    if (COMPRESSED) {
+        m_compressed[0] = static_cast<char>(m_codec);
+        putLittleEndian(&m_compressed[1], m_numberOfEnvelopes);
+        putLittleEndian(&m_compressed[5], static_cast<uint32_t>(m_envelopes.size()));
+
+        cluon::data::Envelope envelope;
+        envelope.dataType(DATATYPE)
+            .serializedData(m_compressed)
+            .sent(cluon::time::now())
+            .sampleTimeStamp(cluon::time::fromMicroseconds(m_firstSampleTimeStamp))
+            .senderStamp(m_numberOfEnvelopes);
+        if (serializeEnvelope(serializedChunk, envelope)) {
+            entry = IndexEntry{};
+            entry.sampleTimeStamp = m_firstSampleTimeStamp;
+            entry.dataType = DATATYPE;
+            entry.senderStamp = m_numberOfEnvelopes;
+            entry.chunk = true;
+            m_bytesIn += m_envelopes.size();
+            m_bytesOut += serializedChunk.size();
+        }
+        else {
+            serializedChunk.clear();
+        }
+    }
+    m_envelopes.clear();
+    m_numberOfEnvelopes = 0;
+    return COMPRESSED && !serializedChunk.empty();
+}
+
+uint64_t EnvelopeChunker::bytesIn() const noexcept {
+    return m_bytesIn;
+}
+
+uint64_t EnvelopeChunker::bytesOut() const noexcept {
+    return m_bytesOut;
+}
+
+bool EnvelopeChunker::compress(const std::string &in, std::string &out) const noexcept {
+    switch (m_codec) {
+        case Codec::ZLIB: {
+#if defined(HAVE_ZLIB_H)
+            uLongf size{compressBound(static_cast<uLong>(in.size()))};
+            out.resize(HEADER_SIZE + size);
+            if (Z_OK != compress2(reinterpret_cast<Bytef*>(&out[HEADER_SIZE]), &size, reinterpret_cast<const Bytef*>(in.data()), static_cast<uLong>(in.size()), ZLIB_LEVEL)) {
+                return false;
+            }
+            out.resize(HEADER_SIZE + size);
+            return true;
+#else
+            return false;
+#endif
+        }
+        case Codec::ZSTD: {
+#if defined(HAVE_ZSTD_H)
+            out.resize(HEADER_SIZE + ZSTD_compressBound(in.size()));
+            const std::size_t SIZE{ZSTD_compress(&out[HEADER_SIZE], out.size() - HEADER_SIZE, in.data(), in.size(), ZSTD_LEVEL)};
+            if (ZSTD_isError(SIZE)) {
+                return false;
+            }
+            out.resize(HEADER_SIZE + SIZE);
+            return true;
+#else
+            return false;
+#endif
+        }
+    }
+    return false;
+}
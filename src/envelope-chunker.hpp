@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENVELOPE_CHUNKER_HPP
+#define ENVELOPE_CHUNKER_HPP
+
+#include "recording-index.hpp"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * This class groups consecutive serialized Envelopes into compressed chunks.
+ * A chunk is recorded as one Envelope of dataType DATATYPE so that readers
+ * unaware of chunks skip it; its serializedData consists of
+ *   uint8  codec (1: zlib, 2: zstd),
+ *   uint32 number of Envelopes (little endian),
+ *   uint32 size of the uncompressed Envelopes (little endian),
+ * followed by the compressed concatenation of the serialized Envelopes
+ * including their OD4 headers as they would appear in a recording file.
+ * The chunk's sampleTimeStamp is the one of its first Envelope.
+ *
+ * This class is not thread-safe.
+ */
+class EnvelopeChunker {
+   private:
+    EnvelopeChunker(const EnvelopeChunker &) = delete;
+    EnvelopeChunker(EnvelopeChunker &&)      = delete;
+    EnvelopeChunker &operator=(const EnvelopeChunker &) = delete;
+    EnvelopeChunker &operator=(EnvelopeChunker &&) = delete;
+
+   public:
+    enum class Codec : uint8_t {
+        ZLIB = 1,
+        ZSTD = 2,
+    };
+
+    static constexpr int32_t DATATYPE{-1}; // Negative dataTypes are not assigned to messages.
+    static constexpr std::size_t HEADER_SIZE{9};
+
+    /**
+     * @param name Name of the codec (zlib, zstd).
+     * @param codec Parsed codec (output).
+     * @return True if name is a known codec that this build supports.
+     */
+    static bool parseCodec(const std::string &name, Codec &codec) noexcept;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param codec Codec to compress chunks with.
+     * @param chunkSize Size in bytes of the uncompressed Envelopes at which a chunk is complete.
+     * @param intervalInMicroseconds Longest time to keep Envelopes before a chunk is complete.
+     */
+    EnvelopeChunker(Codec codec, uint32_t chunkSize, int64_t intervalInMicroseconds) noexcept;
+
+    /**
+     * This method adds a serialized Envelope that may be split in two parts.
+     *
+     * @param entry Index entry describing the Envelope.
+     * @param now Current time in microseconds.
+     */
+    void add(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry, int64_t now) noexcept;
+
+    /**
+     * @param now Current time in microseconds.
+     * @return True if the Envelopes added so far shall be written as a chunk.
+     */
+    bool due(int64_t now) const noexcept;
+
+    /**
+     * @return True if no Envelopes are waiting.
+     */
+    bool empty() const noexcept;
+
+    /**
+     * This method compresses the Envelopes added so far into a serialized
+     * chunk Envelope; the chunker is empty afterwards.
+     *
+     * @param serializedChunk Serialized chunk Envelope (output).
+     * @param entry Index entry for the chunk with the number of Envelopes as senderStamp (output).
+     * @return False if there were no Envelopes or they could not be compressed.
+     */
+    bool take(std::string &serializedChunk, IndexEntry &entry) noexcept;
+
+    /**
+     * @return Uncompressed and compressed bytes of all chunks so far.
+     */
+    uint64_t bytesIn() const noexcept;
+    uint64_t bytesOut() const noexcept;
+
+   private:
+    bool compress(const std::string &in, std::string &out) const noexcept;
+
+   private:
+    Codec m_codec;
+    uint32_t m_chunkSize;
+    int64_t m_interval;
+    std::string m_envelopes{};
+    std::string m_compressed{};
+    uint32_t m_numberOfEnvelopes{0};
+    int64_t m_firstSampleTimeStamp{0};
+    int64_t m_firstAdded{0};
+    uint64_t m_bytesIn{0};
+    uint64_t m_bytesOut{0};
+};
+
+#endif
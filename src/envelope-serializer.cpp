@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "envelope-serializer.hpp"
+#include "opendlv-standard-message-set.hpp"
+
+#include <cstring>
+
+namespace {
+// Wire types and layout as used by cluon::ToProtoVisitor and cluon::serializeEnvelope.
+constexpr uint8_t VARINT{0};
+constexpr uint8_t LENGTH_DELIMITED{2};
+constexpr std::size_t OD4_HEADER_SIZE{5};
+constexpr std::size_t OD4_MAX_LENGTH{0xFFFFFF};
+
+constexpr uint8_t key(uint32_t fieldIdentifier, uint8_t protoType) {
+    return static_cast<uint8_t>((fieldIdentifier << 0x3) | protoType);
+}
+
+std::size_t varIntSize(uint64_t v) noexcept {
+    std::size_t size{1};
+    while (0x7f < v) {
+        v >>= 7;
+        size++;
+    }
+    return size;
+}
+
+uint32_t toZigZag32(int32_t v) noexcept {
+    return static_cast<uint32_t>((v << 1) ^ (v >> ((sizeof(v) * 8) - 1)));
+}
+
+char *putVarInt(char *p, uint64_t v) noexcept {
+    while (0x7f < v) {
+        *p++ = static_cast<char>((static_cast<uint8_t>(v & 0x7f)) | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(static_cast<uint8_t>(v) & 0x7f);
+    return p;
+}
+
+std::size_t timeStampSize(const cluon::data::TimeStamp &ts) noexcept {
+    return 1 + varIntSize(toZigZag32(ts.seconds())) + 1 + varIntSize(toZigZag32(ts.microseconds()));
+}
+
+char *putTimeStamp(char *p, uint32_t fieldIdentifier, const cluon::data::TimeStamp &ts) noexcept {
+    *p++ = static_cast<char>(key(fieldIdentifier, LENGTH_DELIMITED));
+    p = putVarInt(p, timeStampSize(ts));
+    *p++ = static_cast<char>(key(1, VARINT));
+    p = putVarInt(p, toZigZag32(ts.seconds()));
+    *p++ = static_cast<char>(key(2, VARINT));
+    p = putVarInt(p, toZigZag32(ts.microseconds()));
+    return p;
+}
+
+char *putHeader(char *p, std::size_t envelopeSize) noexcept {
+    // OD4 header: 0x0D 0xA4 followed by the length as 24 bit little endian.
+    *p++ = static_cast<char>(0x0D);
+    *p++ = static_cast<char>(0xA4);
+    *p++ = static_cast<char>(envelopeSize & 0xFF);
+    *p++ = static_cast<char>((envelopeSize >> 8) & 0xFF);
+    *p++ = static_cast<char>((envelopeSize >> 16) & 0xFF);
+    return p;
+}
+
+// Visits an Envelope's serializedData by reference as its getter returns a copy.
+struct PayloadVisitor {
+    const std::string *payload{nullptr};
+
+    void visit(uint32_t, std::string &&, std::string &&, std::string &v) noexcept {
+        payload = &v;
+    }
+
+    template <typename T>
+    void visit(uint32_t, std::string &&, std::string &&, T &) noexcept {}
+};
+}
+
+bool serializeImageReadingEnvelope(std::string &out,
+                                   const std::string &fourcc,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   const PayloadChunk *chunks,
+                                   std::size_t numberOfChunks,
+                                   const cluon::data::TimeStamp &sent,
+                                   const cluon::data::TimeStamp &sampleTimeStamp,
+                                   uint32_t senderStamp) noexcept {
+    std::size_t payloadSize{0};
+    for (std::size_t i{0}; i < numberOfChunks; i++) {
+        payloadSize += chunks[i].size;
+    }
+
+    // Compute the sizes of the nested messages first to know all length prefixes upfront.
+    const std::size_t IMAGEREADING_SIZE{1 + varIntSize(fourcc.size()) + fourcc.size()
+                                        + 1 + varIntSize(width)
+                                        + 1 + varIntSize(height)
+                                        + 1 + varIntSize(payloadSize) + payloadSize};
+    const cluon::data::TimeStamp received;
+    const std::size_t SENT_SIZE{timeStampSize(sent)};
+    const std::size_t RECEIVED_SIZE{timeStampSize(received)};
+    const std::size_t SAMPLETIMESTAMP_SIZE{timeStampSize(sampleTimeStamp)};
+    const uint32_t DATATYPE{toZigZag32(opendlv::proxy::ImageReading::ID())};
+    const std::size_t ENVELOPE_SIZE{1 + varIntSize(DATATYPE)
+                                    + 1 + varIntSize(IMAGEREADING_SIZE) + IMAGEREADING_SIZE
+                                    + 1 + varIntSize(SENT_SIZE) + SENT_SIZE
+                                    + 1 + varIntSize(RECEIVED_SIZE) + RECEIVED_SIZE
+                                    + 1 + varIntSize(SAMPLETIMESTAMP_SIZE) + SAMPLETIMESTAMP_SIZE
+                                    + 1 + varIntSize(senderStamp)};
+    if (OD4_MAX_LENGTH < ENVELOPE_SIZE) {
+        out.clear();
+        return false;
+    }
+
+    out.resize(OD4_HEADER_SIZE + ENVELOPE_SIZE);
+    char *p{putHeader(&out[0], ENVELOPE_SIZE)};
+
+    // cluon.data.Envelope.
+    *p++ = static_cast<char>(key(1, VARINT));
+    p = putVarInt(p, DATATYPE);
+    *p++ = static_cast<char>(key(2, LENGTH_DELIMITED));
+    p = putVarInt(p, IMAGEREADING_SIZE);
+    {
+        // opendlv.proxy.ImageReading.
+        *p++ = static_cast<char>(key(1, LENGTH_DELIMITED));
+        p = putVarInt(p, fourcc.size());
+        std::memcpy(p, fourcc.data(), fourcc.size());
+        p += fourcc.size();
+        *p++ = static_cast<char>(key(2, VARINT));
+        p = putVarInt(p, width);
+        *p++ = static_cast<char>(key(3, VARINT));
+        p = putVarInt(p, height);
+        *p++ = static_cast<char>(key(4, LENGTH_DELIMITED));
+        p = putVarInt(p, payloadSize);
+        for (std::size_t i{0}; i < numberOfChunks; i++) {
+            std::memcpy(p, chunks[i].data, chunks[i].size);
+            p += chunks[i].size;
+        }
+    }
+    p = putTimeStamp(p, 3, sent);
+    p = putTimeStamp(p, 4, received);
+    p = putTimeStamp(p, 5, sampleTimeStamp);
+    *p++ = static_cast<char>(key(6, VARINT));
+    putVarInt(p, senderStamp);
+
+    return true;
+}
+
+bool serializeEnvelope(std::string &out, cluon::data::Envelope &envelope) noexcept {
+    PayloadVisitor visitor;
+    envelope.accept(2, visitor);
+    const std::size_t PAYLOAD_SIZE{(nullptr != visitor.payload) ? visitor.payload->size() : 0};
+
+    const cluon::data::TimeStamp SENT{envelope.sent()};
+    const cluon::data::TimeStamp RECEIVED{envelope.received()};
+    const cluon::data::TimeStamp SAMPLETIMESTAMP{envelope.sampleTimeStamp()};
+    const std::size_t SENT_SIZE{timeStampSize(SENT)};
+    const std::size_t RECEIVED_SIZE{timeStampSize(RECEIVED)};
+    const std::size_t SAMPLETIMESTAMP_SIZE{timeStampSize(SAMPLETIMESTAMP)};
+    const uint32_t DATATYPE{toZigZag32(envelope.dataType())};
+    const std::size_t ENVELOPE_SIZE{1 + varIntSize(DATATYPE)
+                                    + 1 + varIntSize(PAYLOAD_SIZE) + PAYLOAD_SIZE
+                                    + 1 + varIntSize(SENT_SIZE) + SENT_SIZE
+                                    + 1 + varIntSize(RECEIVED_SIZE) + RECEIVED_SIZE
+                                    + 1 + varIntSize(SAMPLETIMESTAMP_SIZE) + SAMPLETIMESTAMP_SIZE
+                                    + 1 + varIntSize(envelope.senderStamp())};
+    if (OD4_MAX_LENGTH < ENVELOPE_SIZE) {
+        out.clear();
+        return false;
+    }
+
+    out.resize(OD4_HEADER_SIZE + ENVELOPE_SIZE);
+    char *p{putHeader(&out[0], ENVELOPE_SIZE)};
+
+    // cluon.data.Envelope.
+    *p++ = static_cast<char>(key(1, VARINT));
+    p = putVarInt(p, DATATYPE);
+    *p++ = static_cast<char>(key(2, LENGTH_DELIMITED));
+    p = putVarInt(p, PAYLOAD_SIZE);
+    if (0 < PAYLOAD_SIZE) {
+        std::memcpy(p, visitor.payload->data(), PAYLOAD_SIZE);
+        p += PAYLOAD_SIZE;
+    }
+    p = putTimeStamp(p, 3, SENT);
+    p = putTimeStamp(p, 4, RECEIVED);
+    p = putTimeStamp(p, 5, SAMPLETIMESTAMP);
+    *p++ = static_cast<char>(key(6, VARINT));
+    putVarInt(p, envelope.senderStamp());
+
+    return true;
+}
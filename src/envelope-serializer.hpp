@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENVELOPE_SERIALIZER_HPP
+#define ENVELOPE_SERIALIZER_HPP
+
+#include "cluon-complete.hpp"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * This struct describes a piece of payload that is referenced, not owned.
+ */
+struct PayloadChunk {
+    const char *data;
+    std::size_t size;
+};
+
+/**
+ * This function serializes an Envelope carrying an opendlv.proxy.ImageReading
+ * into the given buffer without creating intermediate messages. The payload
+ * chunks are copied once into their final position right after the proto
+ * field headers; the result is byte-identical to cluon::serializeEnvelope.
+ *
+ * @param out Buffer to write to; its content is replaced, its capacity is reused.
+ * @param fourcc FourCC of the image data.
+ * @param width Width of the image.
+ * @param height Height of the image.
+ * @param chunks Pointer to the payload chunks to be concatenated as ImageReading's data.
+ * @param numberOfChunks Number of payload chunks.
+ * @param sent Time stamp when the Envelope was sent.
+ * @param sampleTimeStamp Time stamp when the image was sampled.
+ * @param senderStamp Sender stamp of the Envelope.
+ * @return false if the resulting Envelope exceeds the maximum size of the OD4 format.
+ */
+bool serializeImageReadingEnvelope(std::string &out,
+                                   const std::string &fourcc,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   const PayloadChunk *chunks,
+                                   std::size_t numberOfChunks,
+                                   const cluon::data::TimeStamp &sent,
+                                   const cluon::data::TimeStamp &sampleTimeStamp,
+                                   uint32_t senderStamp) noexcept;
+
+/**
+ * This function serializes an Envelope into the given buffer; the result is
+ * byte-identical to cluon::serializeEnvelope but the Envelope's payload is
+ * copied only once and no intermediate streams are allocated.
+ *
+ * @param out Buffer to write to; its content is replaced, its capacity is reused.
+ * @param envelope Envelope to serialize; it is not modified.
+ * @return false if the resulting Envelope exceeds the maximum size of the OD4 format.
+ */
+bool serializeEnvelope(std::string &out, cluon::data::Envelope &envelope) noexcept;
+
+#endif
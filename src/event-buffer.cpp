@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "event-buffer.hpp"
+#include "opendlv-standard-message-set.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Number of Envelopes the ring can describe per byte of capacity; small CID messages dominate this count.
+const std::size_t BYTES_PER_SLOT{256};
+const std::size_t MIN_SLOTS{1024};
+}
+
+EventBuffer::EventBuffer(uint32_t capacity, int64_t preTriggerMicroseconds, int64_t postTriggerMicroseconds, int32_t triggerDataType, int64_t triggerSenderStamp) noexcept
+    : m_data(capacity)
+    , m_slots(std::max(static_cast<std::size_t>(capacity) / BYTES_PER_SLOT, MIN_SLOTS))
+    , m_preTrigger(preTriggerMicroseconds)
+    , m_postTrigger(postTriggerMicroseconds)
+    , m_triggerDataType(triggerDataType)
+    , m_triggerSenderStamp(triggerSenderStamp) {
+}
+
+bool EventBuffer::isTrigger(const IndexEntry &entry) const noexcept {
+    return (entry.dataType == m_triggerDataType) && ((0 > m_triggerSenderStamp) || (static_cast<int64_t>(entry.senderStamp) == m_triggerSenderStamp));
+}
+
+bool EventBuffer::recording(int64_t now) const noexcept {
+    return now < m_recordUntil;
+}
+
+std::size_t EventBuffer::trigger(int64_t now, const Writer &writer) noexcept {
+    m_recordUntil = now + m_postTrigger;
+
+    // Decoding a camera's frames needs to start at its key frame; its frames before its oldest one are dropped.
+    std::vector<uint32_t> decodableVideos;
+    std::size_t retVal{0};
+    while (0 < m_numberOfSlots) {
+        const Slot &slot{m_slots[m_firstSlot]};
+        bool decodable{true};
+        if (opendlv::proxy::ImageReading::ID() == slot.entry.dataType) {
+            decodable = (decodableVideos.end() != std::find(decodableVideos.begin(), decodableVideos.end(), slot.entry.senderStamp));
+            if (!decodable && slot.entry.keyFrame) {
+                decodableVideos.push_back(slot.entry.senderStamp);
+                decodable = true;
+            }
+        }
+        if (decodable) {
+            const std::size_t SIZE1{std::min(slot.size, m_data.size() - slot.position)};
+            writer(m_data.data() + slot.position, SIZE1, m_data.data(), slot.size - SIZE1, slot.entry);
+            retVal++;
+        }
+        evictFront();
+    }
+    m_head = 0;
+    return retVal;
+}
+
+void EventBuffer::store(const std::string &serializedEnvelope, const IndexEntry &entry, int64_t now) noexcept {
+    const std::size_t SIZE{serializedEnvelope.size()};
+    while ((0 < m_numberOfSlots) && ((m_slots[m_firstSlot].arrival < now - m_preTrigger) || (m_used + SIZE > m_data.size()) || (m_numberOfSlots == m_slots.size()))) {
+        evictFront();
+    }
+    if (SIZE > m_data.size()) {
+        return;
+    }
+
+    Slot &slot{m_slots[(m_firstSlot + m_numberOfSlots) % m_slots.size()]};
+    slot.position = m_head;
+    slot.size = SIZE;
+    slot.arrival = now;
+    slot.entry = entry;
+    const std::size_t SIZE1{std::min(SIZE, m_data.size() - m_head)};
+    memcpy(m_data.data() + m_head, serializedEnvelope.data(), SIZE1);
+    memcpy(m_data.data(), serializedEnvelope.data() + SIZE1, SIZE - SIZE1);
+    m_head = (m_head + SIZE) % m_data.size();
+    m_used += SIZE;
+    m_numberOfSlots++;
+}
+
+void EventBuffer::evictFront() noexcept {
+    m_used -= m_slots[m_firstSlot].size;
+    m_firstSlot = (m_firstSlot + 1) % m_slots.size();
+    m_numberOfSlots--;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENT_BUFFER_HPP
+#define EVENT_BUFFER_HPP
+
+#include "recording-index.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * This class keeps the most recent serialized Envelopes in a preallocated
+ * ring so that a recording can include the time before a trigger Envelope
+ * arrived. Once triggered, Envelopes are recorded directly until the
+ * post-trigger window has passed; another trigger extends the window.
+ *
+ * This class is not thread-safe.
+ */
+class EventBuffer {
+   private:
+    EventBuffer(const EventBuffer &) = delete;
+    EventBuffer(EventBuffer &&)      = delete;
+    EventBuffer &operator=(const EventBuffer &) = delete;
+    EventBuffer &operator=(EventBuffer &&) = delete;
+
+   public:
+    /**
+     * Callback to write one buffered Envelope that may be split in two parts at the end of the ring.
+     */
+    using Writer = std::function<void(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry)>;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param capacity Size in bytes of the ring.
+     * @param preTriggerMicroseconds Time to keep Envelopes before a trigger.
+     * @param postTriggerMicroseconds Time to record Envelopes after a trigger.
+     * @param triggerDataType dataType of the trigger Envelope.
+     * @param triggerSenderStamp senderStamp of the trigger Envelope; -1 to accept any.
+     */
+    EventBuffer(uint32_t capacity, int64_t preTriggerMicroseconds, int64_t postTriggerMicroseconds, int32_t triggerDataType, int64_t triggerSenderStamp) noexcept;
+
+    /**
+     * @param entry Index entry describing an Envelope.
+     * @return True if the Envelope is a trigger.
+     */
+    bool isTrigger(const IndexEntry &entry) const noexcept;
+
+    /**
+     * @param now Current time in microseconds.
+     * @return True while within the post-trigger window.
+     */
+    bool recording(int64_t now) const noexcept;
+
+    /**
+     * This method starts or extends the post-trigger window and writes out
+     * the buffered Envelopes; the frames of each camera (ImageReading per
+     * senderStamp) begin with its oldest key frame.
+     *
+     * @param now Current time in microseconds.
+     * @param writer Callback to write a buffered Envelope.
+     * @return Number of Envelopes written.
+     */
+    std::size_t trigger(int64_t now, const Writer &writer) noexcept;
+
+    /**
+     * This method adds an Envelope to the ring and discards Envelopes that
+     * are older than the pre-trigger window or do not fit.
+     *
+     * @param serializedEnvelope Serialized Envelope.
+     * @param entry Index entry describing the Envelope.
+     * @param now Current time in microseconds.
+     */
+    void store(const std::string &serializedEnvelope, const IndexEntry &entry, int64_t now) noexcept;
+
+   private:
+    struct Slot {
+        std::size_t position{0};
+        std::size_t size{0};
+        int64_t arrival{0};
+        IndexEntry entry{};
+    };
+
+    void evictFront() noexcept;
+
+   private:
+    std::vector<char> m_data;
+    std::vector<Slot> m_slots;
+    std::size_t m_firstSlot{0};
+    std::size_t m_numberOfSlots{0};
+    std::size_t m_head{0};
+    std::size_t m_used{0};
+
+    int64_t m_preTrigger;
+    int64_t m_postTrigger;
+    int32_t m_triggerDataType;
+    int64_t m_triggerSenderStamp;
+    int64_t m_recordUntil{0};
+};
+
+#endif
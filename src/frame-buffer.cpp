@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame-buffer.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+FrameBuffer::FrameBuffer(uint32_t size) noexcept
+    : m_size(size) {
+    void *ptr{nullptr};
+    if ((0 < m_size) && (0 == ::posix_memalign(&ptr, ALIGNMENT, m_size))) {
+        // Touch all pages upfront to not pay for page faults on the first captures.
+        std::memset(ptr, 0, m_size);
+        m_data = static_cast<uint8_t*>(ptr);
+    }
+}
+
+FrameBuffer::~FrameBuffer() {
+    ::free(m_data);
+}
+
+uint8_t *FrameBuffer::data() const noexcept {
+    return m_data;
+}
+
+uint32_t FrameBuffer::size() const noexcept {
+    return m_size;
+}
+
+bool FrameBuffer::valid() const noexcept {
+    return nullptr != m_data;
+}
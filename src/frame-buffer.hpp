@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_BUFFER_HPP
+#define FRAME_BUFFER_HPP
+
+#include <cstdint>
+
+/**
+ * This class provides a preallocated, aligned buffer to snapshot a frame from
+ * the shared memory so that the shared memory can be unlocked before encoding.
+ * Each frame is encoded before the next one is taken; hence, one buffer per
+ * camera suffices and snapshotting and encoding are not pipelined.
+ */
+class FrameBuffer {
+   private:
+    FrameBuffer(const FrameBuffer &) = delete;
+    FrameBuffer(FrameBuffer &&)      = delete;
+    FrameBuffer &operator=(const FrameBuffer &) = delete;
+    FrameBuffer &operator=(FrameBuffer &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param size Size in bytes of the buffer.
+     */
+    explicit FrameBuffer(uint32_t size) noexcept;
+    ~FrameBuffer();
+
+    /**
+     * @return Pointer to the buffer or nullptr if it could not be allocated.
+     */
+    uint8_t *data() const noexcept;
+
+    /**
+     * @return Size in bytes of the buffer.
+     */
+    uint32_t size() const noexcept;
+
+    /**
+     * @return True if the buffer could be allocated.
+     */
+    bool valid() const noexcept;
+
+   public:
+    static constexpr uint32_t ALIGNMENT{64};
+
+   private:
+    uint32_t m_size{0};
+    uint8_t *m_data{nullptr};
+};
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame-converter.hpp"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+/**
+ * Splits n pairs of bytes from src into the even bytes a and the odd bytes b.
+ */
+void deinterleave(const uint8_t *src, uint8_t *a, uint8_t *b, uint32_t n) noexcept {
+    uint32_t i{0};
+#if defined(__SSE2__)
+    const __m128i LOW{_mm_set1_epi16(0x00FF)};
+    for (; i + 16 <= n; i += 16) {
+        const __m128i S0{_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i))};
+        const __m128i S1{_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 16))};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(a + i), _mm_packus_epi16(_mm_and_si128(S0, LOW), _mm_and_si128(S1, LOW)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b + i), _mm_packus_epi16(_mm_srli_epi16(S0, 8), _mm_srli_epi16(S1, 8)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16x2_t S{vld2q_u8(src + 2 * i)};
+        vst1q_u8(a + i, S.val[0]);
+        vst1q_u8(b + i, S.val[1]);
+    }
+#endif
+    for (; i < n; i++) {
+        a[i] = src[2 * i];
+        b[i] = src[2 * i + 1];
+    }
+}
+
+/**
+ * Converts two rows of YUYV into two rows of Y and one row each of U and V;
+ * the chroma of both rows is averaged.
+ */
+void yuyvRows(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, uint32_t width) noexcept {
+    uint32_t x{0};
+#if defined(__SSE2__)
+    const __m128i LOW{_mm_set1_epi16(0x00FF)};
+    for (; x + 32 <= width; x += 32) {
+        const __m128i *R0{reinterpret_cast<const __m128i*>(row0 + 2 * x)};
+        const __m128i *R1{reinterpret_cast<const __m128i*>(row1 + 2 * x)};
+        const __m128i A0{_mm_loadu_si128(R0)}, A1{_mm_loadu_si128(R0 + 1)}, A2{_mm_loadu_si128(R0 + 2)}, A3{_mm_loadu_si128(R0 + 3)};
+        const __m128i B0{_mm_loadu_si128(R1)}, B1{_mm_loadu_si128(R1 + 1)}, B2{_mm_loadu_si128(R1 + 2)}, B3{_mm_loadu_si128(R1 + 3)};
+
+        // Luma is in the even bytes.
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(_mm_and_si128(A0, LOW), _mm_and_si128(A1, LOW)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x + 16), _mm_packus_epi16(_mm_and_si128(A2, LOW), _mm_and_si128(A3, LOW)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(_mm_and_si128(B0, LOW), _mm_and_si128(B1, LOW)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x + 16), _mm_packus_epi16(_mm_and_si128(B2, LOW), _mm_and_si128(B3, LOW)));
+
+        // Chroma is in the odd bytes as U V U V ...; average both rows, then split.
+        const __m128i C0{_mm_avg_epu8(_mm_packus_epi16(_mm_srli_epi16(A0, 8), _mm_srli_epi16(A1, 8)), _mm_packus_epi16(_mm_srli_epi16(B0, 8), _mm_srli_epi16(B1, 8)))};
+        const __m128i C1{_mm_avg_epu8(_mm_packus_epi16(_mm_srli_epi16(A2, 8), _mm_srli_epi16(A3, 8)), _mm_packus_epi16(_mm_srli_epi16(B2, 8), _mm_srli_epi16(B3, 8)))};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2), _mm_packus_epi16(_mm_and_si128(C0, LOW), _mm_and_si128(C1, LOW)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2), _mm_packus_epi16(_mm_srli_epi16(C0, 8), _mm_srli_epi16(C1, 8)));
+    }
+#elif defined(__ARM_NEON)
+    for (; x + 32 <= width; x += 32) {
+        // val[0] and val[2] hold the even and odd luma samples, val[1] and val[3] hold U and V.
+        const uint8x16x4_t A{vld4q_u8(row0 + 2 * x)};
+        const uint8x16x4_t B{vld4q_u8(row1 + 2 * x)};
+        uint8x16x2_t Y0, Y1;
+        Y0.val[0] = A.val[0];
+        Y0.val[1] = A.val[2];
+        Y1.val[0] = B.val[0];
+        Y1.val[1] = B.val[2];
+        vst2q_u8(y0 + x, Y0);
+        vst2q_u8(y1 + x, Y1);
+        vst1q_u8(u + x / 2, vrhaddq_u8(A.val[1], B.val[1]));
+        vst1q_u8(v + x / 2, vrhaddq_u8(A.val[3], B.val[3]));
+    }
+#endif
+    for (; x + 1 < width; x += 2) {
+        y0[x] = row0[2 * x];
+        y0[x + 1] = row0[2 * x + 2];
+        y1[x] = row1[2 * x];
+        y1[x + 1] = row1[2 * x + 2];
+        u[x / 2] = static_cast<uint8_t>((row0[2 * x + 1] + row1[2 * x + 1] + 1) >> 1);
+        v[x / 2] = static_cast<uint8_t>((row0[2 * x + 3] + row1[2 * x + 3] + 1) >> 1);
+    }
+}
+
+// Fixed-point BT.601 limited range as used by libyuv.
+inline uint8_t rgbToY(int32_t r, int32_t g, int32_t b) noexcept {
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t rgbToU(int32_t r, int32_t g, int32_t b) noexcept {
+    return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+inline uint8_t rgbToV(int32_t r, int32_t g, int32_t b) noexcept {
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+} // namespace
+
+bool parsePixelFormat(const std::string &name, PixelFormat &format) noexcept {
+    if ("i420" == name) {
+        format = PixelFormat::I420;
+    }
+    else if ("nv12" == name) {
+        format = PixelFormat::NV12;
+    }
+    else if ("yuyv" == name) {
+        format = PixelFormat::YUYV;
+    }
+    else if ("rgb" == name) {
+        format = PixelFormat::RGB;
+    }
+    else if ("bgr" == name) {
+        format = PixelFormat::BGR;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+FrameConverter::FrameConverter(const FrameLayout &layout) noexcept
+    : m_layout(layout) {
+    if (0 == m_layout.stride) {
+        switch (m_layout.format) {
+            case PixelFormat::I420:
+            case PixelFormat::NV12: { m_layout.stride = m_layout.width; break; }
+            case PixelFormat::YUYV: { m_layout.stride = 2 * m_layout.width; break; }
+            case PixelFormat::RGB:
+            case PixelFormat::BGR: { m_layout.stride = 3 * m_layout.width; break; }
+        }
+    }
+    if (0 == m_layout.strideUV) {
+        m_layout.strideUV = (PixelFormat::NV12 == m_layout.format) ? m_layout.stride : m_layout.stride / 2;
+    }
+    if (0 == m_layout.planeHeight) {
+        m_layout.planeHeight = m_layout.height;
+    }
+    m_width = (0 < m_layout.cropWidth) ? m_layout.cropWidth : m_layout.width - m_layout.cropX;
+    m_height = (0 < m_layout.cropHeight) ? m_layout.cropHeight : m_layout.height - m_layout.cropY;
+}
+
+const FrameLayout &FrameConverter::layout() const noexcept {
+    return m_layout;
+}
+
+bool FrameConverter::valid() const noexcept {
+    const bool INSIDE{(m_layout.cropX < m_layout.width) && (m_layout.cropY < m_layout.height)
+                      && (m_width <= m_layout.width - m_layout.cropX) && (m_height <= m_layout.height - m_layout.cropY)};
+    const bool ALIGNED{(0 == (m_layout.cropX % 2)) && (0 == (m_layout.cropY % 2))};
+    return INSIDE && ALIGNED && (0 < m_width) && (0 < m_height);
+}
+
+uint32_t FrameConverter::width() const noexcept {
+    return m_width;
+}
+
+uint32_t FrameConverter::height() const noexcept {
+    return m_height;
+}
+
+uint32_t FrameConverter::sourceSize() const noexcept {
+    const uint32_t FIRST_PLANE{m_layout.stride * m_layout.planeHeight};
+    switch (m_layout.format) {
+        case PixelFormat::I420: { return FIRST_PLANE + m_layout.strideUV * (m_layout.planeHeight / 2) + m_layout.strideUV * (m_layout.height / 2); }
+        case PixelFormat::NV12: { return FIRST_PLANE + m_layout.strideUV * (m_layout.height / 2); }
+        default: { return m_layout.stride * m_layout.height; }
+    }
+}
+
+uint32_t FrameConverter::i420Size() const noexcept {
+    return m_width * m_height + ((m_width * m_height) >> 1);
+}
+
+bool FrameConverter::needsConversion() const noexcept {
+    return PixelFormat::I420 != m_layout.format;
+}
+
+void FrameConverter::toI420(const uint8_t *src, uint8_t *dst) const noexcept {
+    switch (m_layout.format) {
+        case PixelFormat::I420: {
+            const I420Picture PICTURE{picture(src)};
+            const uint32_t W{m_width};
+            const uint32_t H{m_height};
+            for (uint32_t row{0}; row < H; row++) {
+                memcpy(dst + row * W, PICTURE.y + row * PICTURE.strideY, W);
+            }
+            uint8_t *u{dst + W * H};
+            uint8_t *v{u + (W / 2) * (H / 2)};
+            for (uint32_t row{0}; row < H / 2; row++) {
+                memcpy(u + row * (W / 2), PICTURE.u + row * PICTURE.strideUV, W / 2);
+                memcpy(v + row * (W / 2), PICTURE.v + row * PICTURE.strideUV, W / 2);
+            }
+            break;
+        }
+        case PixelFormat::NV12: { nv12ToI420(src, dst); break; }
+        case PixelFormat::YUYV: { yuyvToI420(src, dst); break; }
+        case PixelFormat::RGB: { rgbToI420(src, dst, false); break; }
+        case PixelFormat::BGR: { rgbToI420(src, dst, true); break; }
+    }
+}
+
+I420Picture FrameConverter::picture(const uint8_t *src) const noexcept {
+    I420Picture picture;
+    const uint32_t OFFSET_UV{(m_layout.cropY / 2) * m_layout.strideUV + m_layout.cropX / 2};
+    picture.y = src + m_layout.cropY * m_layout.stride + m_layout.cropX;
+    picture.u = src + m_layout.stride * m_layout.planeHeight + OFFSET_UV;
+    picture.v = src + m_layout.stride * m_layout.planeHeight + m_layout.strideUV * (m_layout.planeHeight / 2) + OFFSET_UV;
+    picture.strideY = m_layout.stride;
+    picture.strideUV = m_layout.strideUV;
+    return picture;
+}
+
+I420Picture FrameConverter::packedPicture(const uint8_t *i420) const noexcept {
+    I420Picture picture;
+    picture.y = i420;
+    picture.u = i420 + m_width * m_height;
+    picture.v = picture.u + (m_width / 2) * (m_height / 2);
+    picture.strideY = m_width;
+    picture.strideUV = m_width / 2;
+    return picture;
+}
+
+void FrameConverter::nv12ToI420(const uint8_t *src, uint8_t *dst) const noexcept {
+    const uint32_t W{m_width};
+    const uint32_t H{m_height};
+    const uint8_t *y{src + m_layout.cropY * m_layout.stride + m_layout.cropX};
+    for (uint32_t row{0}; row < H; row++) {
+        memcpy(dst + row * W, y + row * m_layout.stride, W);
+    }
+    const uint8_t *uv{src + m_layout.stride * m_layout.planeHeight + (m_layout.cropY / 2) * m_layout.strideUV + m_layout.cropX};
+    uint8_t *u{dst + W * H};
+    uint8_t *v{u + (W / 2) * (H / 2)};
+    for (uint32_t row{0}; row < H / 2; row++) {
+        deinterleave(uv + row * m_layout.strideUV, u + row * (W / 2), v + row * (W / 2), W / 2);
+    }
+}
+
+void FrameConverter::yuyvToI420(const uint8_t *src, uint8_t *dst) const noexcept {
+    const uint32_t W{m_width};
+    const uint32_t H{m_height};
+    src += m_layout.cropY * m_layout.stride + 2 * m_layout.cropX;
+    uint8_t *u{dst + W * H};
+    uint8_t *v{u + (W / 2) * (H / 2)};
+    for (uint32_t row{0}; row + 1 < H; row += 2) {
+        yuyvRows(src + row * m_layout.stride, src + (row + 1) * m_layout.stride, dst + row * W, dst + (row + 1) * W, u + (row / 2) * (W / 2), v + (row / 2) * (W / 2), W);
+    }
+}
+
+void FrameConverter::rgbToI420(const uint8_t *src, uint8_t *dst, bool bgr) const noexcept {
+    const uint32_t W{m_width};
+    const uint32_t H{m_height};
+    src += m_layout.cropY * m_layout.stride + 3 * m_layout.cropX;
+    const uint32_t R{bgr ? 2u : 0u};
+    const uint32_t B{bgr ? 0u : 2u};
+    uint8_t *u{dst + W * H};
+    uint8_t *v{u + (W / 2) * (H / 2)};
+    for (uint32_t row{0}; row + 1 < H; row += 2) {
+        const uint8_t *row0{src + row * m_layout.stride};
+        const uint8_t *row1{row0 + m_layout.stride};
+        uint8_t *y0{dst + row * W};
+        uint8_t *y1{y0 + W};
+        uint8_t *uRow{u + (row / 2) * (W / 2)};
+        uint8_t *vRow{v + (row / 2) * (W / 2)};
+        for (uint32_t x{0}; x + 1 < W; x += 2) {
+            const uint8_t *p0{row0 + 3 * x};
+            const uint8_t *p1{row1 + 3 * x};
+            y0[x] = rgbToY(p0[R], p0[1], p0[B]);
+            y0[x + 1] = rgbToY(p0[3 + R], p0[4], p0[3 + B]);
+            y1[x] = rgbToY(p1[R], p1[1], p1[B]);
+            y1[x + 1] = rgbToY(p1[3 + R], p1[4], p1[3 + B]);
+
+            // Chroma from the average of the 2x2 block.
+            const int32_t SUM_R{p0[R] + p0[3 + R] + p1[R] + p1[3 + R]};
+            const int32_t SUM_G{p0[1] + p0[4] + p1[1] + p1[4]};
+            const int32_t SUM_B{p0[B] + p0[3 + B] + p1[B] + p1[3 + B]};
+            uRow[x / 2] = rgbToU((SUM_R + 2) >> 2, (SUM_G + 2) >> 2, (SUM_B + 2) >> 2);
+            vRow[x / 2] = rgbToV((SUM_R + 2) >> 2, (SUM_G + 2) >> 2, (SUM_B + 2) >> 2);
+        }
+    }
+}
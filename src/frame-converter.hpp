@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_CONVERTER_HPP
+#define FRAME_CONVERTER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Pixel formats that can be read from the shared memory.
+ */
+enum class PixelFormat {
+    I420, // Planar Y, U, V; chroma subsampled 2x2.
+    NV12, // Planar Y followed by interleaved UV; chroma subsampled 2x2.
+    YUYV, // Packed Y0 U Y1 V; chroma subsampled 2x1.
+    RGB,  // Packed 24 bits per pixel, R first.
+    BGR,  // Packed 24 bits per pixel, B first.
+};
+
+/**
+ * This struct describes how a frame is laid out in the shared memory.
+ */
+struct FrameLayout {
+    PixelFormat format{PixelFormat::I420};
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t stride{0}; // Bytes per row of the first plane; 0 for tightly packed rows.
+    uint32_t strideUV{0}; // Bytes per row of the chroma plane(s) for I420 and NV12; 0 to derive from stride.
+    uint32_t planeHeight{0}; // Rows between the start of the first plane and the chroma plane(s); 0 for height.
+    uint32_t cropX{0}; // Left column of the region to encode; must be even.
+    uint32_t cropY{0}; // Top row of the region to encode; must be even.
+    uint32_t cropWidth{0}; // Width of the region to encode; 0 for the whole frame.
+    uint32_t cropHeight{0}; // Height of the region to encode; 0 for the whole frame.
+};
+
+/**
+ * This struct references the three planes of an I420 picture.
+ */
+struct I420Picture {
+    const uint8_t *y{nullptr};
+    const uint8_t *u{nullptr};
+    const uint8_t *v{nullptr};
+    uint32_t strideY{0};
+    uint32_t strideUV{0};
+};
+
+/**
+ * @param name Name of the pixel format (i420, nv12, yuyv, rgb, bgr).
+ * @param format Parsed pixel format (output).
+ * @return True if name is a known pixel format.
+ */
+bool parsePixelFormat(const std::string &name, PixelFormat &format) noexcept;
+
+/**
+ * This class converts frames from the shared memory into tightly packed I420
+ * frames for the encoder. The inner loops use SSE2 on x86-64 and NEON on
+ * ARM for NV12 and YUYV; RGB and BGR are converted with fixed-point BT.601.
+ * I420 frames with padded rows are not converted but passed to the encoder
+ * with their strides. A cropped region is read in place by offsetting the
+ * planes; only this region is converted.
+ */
+class FrameConverter {
+   private:
+    FrameConverter(const FrameConverter &) = delete;
+    FrameConverter(FrameConverter &&)      = delete;
+    FrameConverter &operator=(const FrameConverter &) = delete;
+    FrameConverter &operator=(FrameConverter &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param layout Layout of the frames in the shared memory; unset strides are filled in.
+     */
+    explicit FrameConverter(const FrameLayout &layout) noexcept;
+    ~FrameConverter() = default;
+
+    /**
+     * @return Completed layout of the frames in the shared memory.
+     */
+    const FrameLayout &layout() const noexcept;
+
+    /**
+     * @return True if the region to encode lies within the frame and is aligned to the chroma subsampling.
+     */
+    bool valid() const noexcept;
+
+    /**
+     * @return Width of the frames to encode, i.e., of the cropped region.
+     */
+    uint32_t width() const noexcept;
+
+    /**
+     * @return Height of the frames to encode, i.e., of the cropped region.
+     */
+    uint32_t height() const noexcept;
+
+    /**
+     * @return Bytes that a frame occupies in the shared memory.
+     */
+    uint32_t sourceSize() const noexcept;
+
+    /**
+     * @return Bytes of a tightly packed I420 frame of width() x height().
+     */
+    uint32_t i420Size() const noexcept;
+
+    /**
+     * @return True if frames need to be converted before encoding.
+     */
+    bool needsConversion() const noexcept;
+
+    /**
+     * This method converts the region to encode into a tightly packed I420 frame.
+     *
+     * @param src Frame in the layout given to the constructor.
+     * @param dst Buffer of i420Size() bytes.
+     */
+    void toI420(const uint8_t *src, uint8_t *dst) const noexcept;
+
+    /**
+     * @param src Frame in the layout given to the constructor; must be I420.
+     * @return Planes of the region to encode within src.
+     */
+    I420Picture picture(const uint8_t *src) const noexcept;
+
+    /**
+     * @param i420 Tightly packed I420 frame of width() x height().
+     * @return Planes of i420.
+     */
+    I420Picture packedPicture(const uint8_t *i420) const noexcept;
+
+   private:
+    void nv12ToI420(const uint8_t *src, uint8_t *dst) const noexcept;
+    void yuyvToI420(const uint8_t *src, uint8_t *dst) const noexcept;
+    void rgbToI420(const uint8_t *src, uint8_t *dst, bool bgr) const noexcept;
+
+   private:
+    FrameLayout m_layout;
+    uint32_t m_width{0};
+    uint32_t m_height{0};
+};
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame-rate-estimator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Weight of a new inter-arrival time in the moving average.
+const double SMOOTHING{1.0 / 16.0};
+// Number of intervals to collect before reporting a first estimate.
+const uint32_t WARMUP_INTERVALS{16};
+// Gaps longer than this (e.g., a paused producer) are not part of the frame rate.
+const int64_t MAX_INTERVAL_MICROSECONDS{1000 * 1000};
+// Relative change of the frame rate to report a new estimate.
+const double HYSTERESIS{0.1};
+// Per interval, the shortest interval grows by this fraction of itself to follow a slower camera.
+const int64_t SHORTEST_INTERVAL_GROWTH{64};
+}
+
+FrameRateEstimator::FrameRateEstimator(float initialFrameRate) noexcept
+    : m_frameRate(initialFrameRate) {
+}
+
+bool FrameRateEstimator::update(int64_t sampleTimeStampInMicroseconds) noexcept {
+    const int64_t INTERVAL{sampleTimeStampInMicroseconds - m_lastSampleTimeStamp};
+    const bool HAS_PREVIOUS{0 != m_lastSampleTimeStamp};
+    m_lastSampleTimeStamp = sampleTimeStampInMicroseconds;
+    if (!HAS_PREVIOUS || (0 >= INTERVAL) || (MAX_INTERVAL_MICROSECONDS < INTERVAL)) {
+        return false;
+    }
+
+    if (0 == m_numberOfIntervals) {
+        m_averageInterval = static_cast<double>(INTERVAL);
+        m_shortestInterval = INTERVAL;
+    }
+    else {
+        m_averageInterval += SMOOTHING * (static_cast<double>(INTERVAL) - m_averageInterval);
+        m_shortestInterval = std::min(INTERVAL, m_shortestInterval + m_shortestInterval / SHORTEST_INTERVAL_GROWTH);
+    }
+    m_numberOfIntervals++;
+
+    bool retVal{false};
+    if (WARMUP_INTERVALS <= m_numberOfIntervals) {
+        const double ESTIMATE{1000.0 * 1000.0 / m_averageInterval};
+        if (HYSTERESIS < std::fabs(ESTIMATE - m_frameRate) / m_frameRate) {
+            m_frameRate = static_cast<float>(ESTIMATE);
+            retVal = true;
+        }
+    }
+    return retVal;
+}
+
+float FrameRateEstimator::frameRate() const noexcept {
+    return m_frameRate;
+}
+
+int64_t FrameRateEstimator::shortestInterval() const noexcept {
+    return (WARMUP_INTERVALS <= m_numberOfIntervals) ? m_shortestInterval : 0;
+}
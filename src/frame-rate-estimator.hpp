@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_RATE_ESTIMATOR_HPP
+#define FRAME_RATE_ESTIMATOR_HPP
+
+#include <cstdint>
+
+/**
+ * This class estimates the frame rate of a camera from the sample time
+ * stamps of consecutive frames using an exponential moving average of
+ * the inter-arrival times.
+ */
+class FrameRateEstimator {
+   private:
+    FrameRateEstimator(const FrameRateEstimator &) = delete;
+    FrameRateEstimator(FrameRateEstimator &&)      = delete;
+    FrameRateEstimator &operator=(const FrameRateEstimator &) = delete;
+    FrameRateEstimator &operator=(FrameRateEstimator &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param initialFrameRate Frame rate the encoder is currently configured with.
+     */
+    explicit FrameRateEstimator(float initialFrameRate) noexcept;
+
+    /**
+     * This method adds the sample time stamp of a new frame.
+     *
+     * @param sampleTimeStampInMicroseconds Sample time stamp of the frame.
+     * @return True if the estimated frame rate deviates enough from the last
+     *         reported one to reconfigure the encoder.
+     */
+    bool update(int64_t sampleTimeStampInMicroseconds) noexcept;
+
+    /**
+     * @return Estimated frame rate; this is the value reported when update returned true.
+     */
+    float frameRate() const noexcept;
+
+    /**
+     * The average interval is longer than the camera's when frames are
+     * missed; hence, the shortest recent interval approximates the interval
+     * at which the producer sends frames.
+     *
+     * @return Shortest recent interval in microseconds or 0 while warming up.
+     */
+    int64_t shortestInterval() const noexcept;
+
+   private:
+    float m_frameRate;
+    int64_t m_lastSampleTimeStamp{0};
+    double m_averageInterval{0};
+    int64_t m_shortestInterval{0};
+    uint32_t m_numberOfIntervals{0};
+};
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "h264-encoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+// Keep at least this many macroblock rows per slice, and hence per thread, to limit the overhead from slice
+// headers and lost prediction across slice boundaries on small frames.
+constexpr uint32_t MIN_MB_ROWS_PER_SLICE{4};
+}
+
+H264Encoder::H264Encoder(const EncoderSettings &settings, uint32_t width, uint32_t height) noexcept
+    : m_settings(settings)
+    , m_width(width)
+    , m_height(height) {
+    if (0 > m_settings.threads) {
+        // openh264 keeps its threads when resized; hence, the initial frame size determines their number.
+        const uint32_t MB_ROWS{(m_height + 15) / 16};
+        m_settings.threads = static_cast<int32_t>(std::min(std::max(MB_ROWS / MIN_MB_ROWS_PER_SLICE, 1u), std::max(std::thread::hardware_concurrency(), 1u)));
+    }
+    if (0 != WelsCreateSVCEncoder(&m_encoder) || (nullptr == m_encoder)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to create openh264 encoder." << std::endl;
+        m_encoder = nullptr;
+        return;
+    }
+
+    m_layers.push_back(Layer{m_width, m_height, 1});
+    for (auto divisor : settings.layers) {
+        // openh264 requires even dimensions of at least 16 pixels.
+        const Layer LAYER{((0 < divisor) ? m_width / divisor : 0) & ~1u, ((0 < divisor) ? m_height / divisor : 0) & ~1u, divisor};
+        const bool DUPLICATE{m_layers.end() != std::find_if(m_layers.begin(), m_layers.end(), [divisor](const Layer &l){ return l.divisor == divisor; })};
+        if ((2 > divisor) || DUPLICATE || (16 > LAYER.width) || (16 > LAYER.height) || (MAX_SPATIAL_LAYER_NUM <= m_layers.size())) {
+            std::cerr << "[opendlv-video-h264-recorder]: Invalid layer 1/" << divisor << " of " << m_width << "x" << m_height << "." << std::endl;
+            return;
+        }
+        m_layers.push_back(LAYER);
+    }
+    for (std::size_t i{0}; i < m_layers.size(); i++) {
+        m_layerOfSpatialId.push_back(i);
+    }
+    std::sort(m_layerOfSpatialId.begin(), m_layerOfSpatialId.end(), [this](std::size_t a, std::size_t b){ return m_layers[a].divisor > m_layers[b].divisor; });
+
+    int logLevel{settings.verbose ? WELS_LOG_INFO : WELS_LOG_QUIET};
+    m_encoder->SetOption(ENCODER_OPTION_TRACE_LEVEL, &logLevel);
+
+    // Configure parameters for openh264 encoder.
+    SEncParamExt parameters;
+    {
+        memset(&parameters, 0, sizeof(SEncParamBase));
+        m_encoder->GetDefaultParams(&parameters);
+
+        parameters.fMaxFrameRate = settings.fps; // The actual frame rate is given by the notifications from the shared memory; see setFrameRate.
+        parameters.iUsageType = EUsageType::CAMERA_VIDEO_REAL_TIME;
+        parameters.iPicWidth = m_width;
+        parameters.iPicHeight = m_height;
+        parameters.uiIntraPeriod = settings.gop;
+        parameters.iSpatialLayerNum = static_cast<int>(m_layers.size());
+        parameters.iTemporalLayerNum = 1;
+        parameters.iLtrMarkPeriod = 30;
+        parameters.iMultipleThreadIdc = m_settings.threads; // 1 = disable multi threads.
+        parameters.bSimulcastAVC = (1 < m_layers.size()); // Encode each spatial layer as an independent AVC stream.
+
+        int32_t targetBitrate{0};
+        int32_t maxBitrate{0};
+        for (std::size_t spatialId{0}; spatialId < m_layers.size(); spatialId++) {
+            // The bitrates of downscaled layers are scaled by their number of pixels.
+            const Layer &LAYER = m_layers[m_layerOfSpatialId[spatialId]];
+            const uint32_t PIXEL_RATIO{LAYER.divisor * LAYER.divisor};
+            SSpatialLayerConfig &layer = parameters.sSpatialLayers[spatialId];
+            layer.iVideoWidth = static_cast<int>(LAYER.width);
+            layer.iVideoHeight = static_cast<int>(LAYER.height);
+            layer.fFrameRate = parameters.fMaxFrameRate;
+            layer.iSpatialBitrate = static_cast<int>(settings.bitrate / PIXEL_RATIO);
+            layer.iMaxSpatialBitrate = std::max(static_cast<int>(settings.bitrateMax / PIXEL_RATIO), layer.iSpatialBitrate);
+            layer.sSliceArgument.uiSliceMode = sliceMode(m_settings);
+            layer.sSliceArgument.uiSliceNum = numberOfSlices(m_settings, LAYER.height);
+            targetBitrate += layer.iSpatialBitrate;
+            maxBitrate += layer.iMaxSpatialBitrate;
+            if (settings.verbose) {
+                std::clog << "[opendlv-video-h264-recorder]: Encoding " << LAYER.width << "x" << LAYER.height << " with slice mode " << layer.sSliceArgument.uiSliceMode << " and " << layer.sSliceArgument.uiSliceNum << " slice(s) using " << m_settings.threads << " thread(s) (0 = auto)." << std::endl;
+            }
+        }
+        parameters.iTargetBitrate = targetBitrate;
+
+        /*
+         * Parameters:
+         * https://github.com/cisco/openh264/wiki/TypesAndStructures
+         * https://github.com/cisco/openh264/blob/master/codec/encoder/core/inc/param_svc.h#L132
+         */
+        parameters.iNumRefFrame = (settings.numRefFrame == 0) ? AUTO_REF_PIC_COUNT : settings.numRefFrame;
+        parameters.bPrefixNalAddingCtrl = settings.prefixNal;
+        parameters.bEnableSSEI = settings.ssei;
+        parameters.iPaddingFlag = settings.padding;
+        parameters.iEntropyCodingModeFlag = settings.entropyCoding;
+        parameters.bEnableFrameSkip = settings.frameSkip;
+        parameters.iMaxBitrate = maxBitrate;
+        parameters.iMaxQp = settings.qpMax;
+        parameters.iMinQp = settings.qpMin;
+        parameters.bEnableLongTermReference = settings.longTermReference;
+        parameters.iLoopFilterDisableIdc = settings.loopFilter;
+        parameters.bEnableDenoise = settings.denoise;
+        parameters.bEnableBackgroundDetection = settings.backgroundDetection;
+        parameters.bEnableAdaptiveQuant = settings.adaptiveQuant;
+        parameters.bEnableFrameCroppingFlag = settings.frameCropping;
+        parameters.bEnableSceneChangeDetect = settings.sceneChangeDetect;
+
+        switch (settings.rcMode) {
+            case 0: { parameters.iRCMode = RC_MODES::RC_QUALITY_MODE; break; }
+            case 1: { parameters.iRCMode = RC_MODES::RC_BITRATE_MODE; break; }
+            case 2: { parameters.iRCMode = RC_MODES::RC_BUFFERBASED_MODE; break; }
+            case 3: { parameters.iRCMode = RC_MODES::RC_TIMESTAMP_MODE; break; }
+            case 4: { parameters.iRCMode = RC_MODES::RC_OFF_MODE; break; }
+        }
+
+        switch (settings.spsPpsStrategy) {
+            case 0: { parameters.eSpsPpsIdStrategy = EParameterSetStrategy::CONSTANT_ID; break; }
+            case 1: { parameters.eSpsPpsIdStrategy = EParameterSetStrategy::INCREASING_ID; break; }
+            case 2: { parameters.eSpsPpsIdStrategy = EParameterSetStrategy::SPS_LISTING; break; }
+            case 3: { parameters.eSpsPpsIdStrategy = EParameterSetStrategy::SPS_LISTING_AND_PPS_INCREASING; break; }
+        }
+
+        switch (settings.ecomplexity) {
+            case 0: { parameters.iComplexityMode = ECOMPLEXITY_MODE::LOW_COMPLEXITY;; break; }
+            case 1: { parameters.iComplexityMode = ECOMPLEXITY_MODE::MEDIUM_COMPLEXITY; break; }
+            case 2: { parameters.iComplexityMode = ECOMPLEXITY_MODE::HIGH_COMPLEXITY; break; }
+        }
+    }
+    if (cmResultSuccess != m_encoder->InitializeExt(&parameters)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to set parameters for openh264." << std::endl;
+        return;
+    }
+    m_valid = true;
+}
+
+H264Encoder::~H264Encoder() {
+    if (nullptr != m_encoder) {
+        m_encoder->Uninitialize();
+        WelsDestroySVCEncoder(m_encoder);
+    }
+}
+
+uint32_t H264Encoder::threads(const EncoderSettings &settings) noexcept {
+    // openh264 uses as many threads as there are cores for iMultipleThreadIdc = 0.
+    return (0 >= settings.threads) ? std::max(std::thread::hardware_concurrency(), 1u) : static_cast<uint32_t>(settings.threads);
+}
+
+SliceModeEnum H264Encoder::sliceMode(const EncoderSettings &settings) noexcept {
+    if (0 <= settings.sliceMode) {
+        return static_cast<SliceModeEnum>(settings.sliceMode);
+    }
+    // Slices are the unit of parallelism in openh264; a single thread keeps the size-limited slices.
+    return (1 == threads(settings)) ? SliceModeEnum::SM_SIZELIMITED_SLICE : SliceModeEnum::SM_FIXEDSLCNUM_SLICE;
+}
+
+uint32_t H264Encoder::numberOfSlices(const EncoderSettings &settings, uint32_t height) noexcept {
+    if (SliceModeEnum::SM_FIXEDSLCNUM_SLICE != sliceMode(settings)) {
+        return 1;
+    }
+    if (0 < settings.slices) {
+        return std::min(settings.slices, static_cast<uint32_t>(MAX_SLICES_NUM_TMP));
+    }
+    // One slice per thread but keep at least MIN_MB_ROWS_PER_SLICE macroblock rows per slice.
+    const uint32_t MB_ROWS{(height + 15) / 16};
+    const uint32_t MAX_SLICES{std::max(MB_ROWS / MIN_MB_ROWS_PER_SLICE, 1u)};
+    return std::min(std::min(threads(settings), MAX_SLICES), static_cast<uint32_t>(MAX_SLICES_NUM_TMP));
+}
+
+bool H264Encoder::valid() const noexcept {
+    return m_valid;
+}
+
+std::size_t H264Encoder::encode(const uint8_t *i420, std::vector<EncodedLayer> &layers, bool &isKeyFrame) noexcept {
+    I420Picture picture;
+    picture.y = i420;
+    picture.u = i420 + (m_width * m_height);
+    picture.v = i420 + (m_width * m_height + ((m_width * m_height) >> 2));
+    picture.strideY = m_width;
+    picture.strideUV = m_width/2;
+    return encode(picture, layers, isKeyFrame);
+}
+
+std::size_t H264Encoder::encode(const I420Picture &picture, std::vector<EncodedLayer> &layers, bool &isKeyFrame) noexcept {
+    std::size_t totalSize{0};
+    layers.resize(m_layers.size());
+    for (std::size_t i{0}; i < m_layers.size(); i++) {
+        layers[i].width = m_layers[i].width;
+        layers[i].height = m_layers[i].height;
+        layers[i].size = 0;
+        layers[i].chunks.clear();
+    }
+    isKeyFrame = false;
+
+    SFrameBSInfo frameInfo;
+    memset(&frameInfo, 0, sizeof(SFrameBSInfo));
+
+    SSourcePicture sourceFrame;
+    memset(&sourceFrame, 0, sizeof(SSourcePicture));
+
+    // openh264 does not modify the source picture.
+    sourceFrame.iColorFormat = EVideoFormatType::videoFormatI420;
+    sourceFrame.iPicWidth = m_width;
+    sourceFrame.iPicHeight = m_height;
+    sourceFrame.iStride[0] = static_cast<int>(picture.strideY);
+    sourceFrame.iStride[1] = static_cast<int>(picture.strideUV);
+    sourceFrame.iStride[2] = static_cast<int>(picture.strideUV);
+    sourceFrame.pData[0] = const_cast<uint8_t*>(picture.y);
+    sourceFrame.pData[1] = const_cast<uint8_t*>(picture.u);
+    sourceFrame.pData[2] = const_cast<uint8_t*>(picture.v);
+
+    auto result = m_encoder->EncodeFrame(&sourceFrame, &frameInfo);
+    if (cmResultSuccess == result) {
+        if (videoFrameTypeSkip == frameInfo.eFrameType) {
+            std::cerr << "[opendlv-video-h264-recorder]: Warning, skipping frame." << std::endl;
+        }
+        else {
+            isKeyFrame = (videoFrameTypeIDR == frameInfo.eFrameType);
+            for(int layer{0}; layer < frameInfo.iLayerNum; layer++) {
+                int sizeOfLayer{0};
+                for(int nal{0}; nal < frameInfo.sLayerInfo[layer].iNalCount; nal++) {
+                    sizeOfLayer += frameInfo.sLayerInfo[layer].pNalLengthInByte[nal];
+                }
+                // Parameter sets and slices carry the spatial layer they belong to.
+                const std::size_t SPATIAL_ID{std::min(static_cast<std::size_t>(frameInfo.sLayerInfo[layer].uiSpatialId), m_layers.size() - 1)};
+                EncodedLayer &encodedLayer = layers[m_layerOfSpatialId[SPATIAL_ID]];
+                encodedLayer.chunks.push_back(PayloadChunk{reinterpret_cast<char*>(frameInfo.sLayerInfo[layer].pBsBuf), static_cast<std::size_t>(sizeOfLayer)});
+                encodedLayer.size += static_cast<std::size_t>(sizeOfLayer);
+                totalSize += static_cast<std::size_t>(sizeOfLayer);
+            }
+        }
+    }
+    else {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to encode frame: " << result << std::endl;
+    }
+    return totalSize;
+}
+
+void H264Encoder::forceKeyFrame() noexcept {
+    if (m_valid) {
+        m_encoder->ForceIntraFrame(true);
+    }
+}
+
+bool H264Encoder::setFrameRate(float fps) noexcept {
+    return m_valid && (cmResultSuccess == m_encoder->SetOption(ENCODER_OPTION_FRAME_RATE, &fps));
+}
+
+bool H264Encoder::setBitrate(uint32_t bitrate) noexcept {
+    if (!m_valid) {
+        return false;
+    }
+    bool retVal{true};
+    int32_t totalBitrate{0};
+    for (std::size_t spatialId{0}; spatialId < m_layers.size(); spatialId++) {
+        const Layer &LAYER = m_layers[m_layerOfSpatialId[spatialId]];
+        SBitrateInfo bitrateInfo;
+        bitrateInfo.iLayer = static_cast<LAYER_NUM>(spatialId);
+        bitrateInfo.iBitrate = static_cast<int>(bitrate / (LAYER.divisor * LAYER.divisor));
+        retVal &= (cmResultSuccess == m_encoder->SetOption(ENCODER_OPTION_BITRATE, &bitrateInfo));
+        totalBitrate += bitrateInfo.iBitrate;
+    }
+    SBitrateInfo bitrateInfo;
+    bitrateInfo.iLayer = SPATIAL_LAYER_ALL;
+    bitrateInfo.iBitrate = totalBitrate;
+    return retVal && (cmResultSuccess == m_encoder->SetOption(ENCODER_OPTION_BITRATE, &bitrateInfo));
+}
+
+bool H264Encoder::setComplexity(uint32_t complexity) noexcept {
+    ECOMPLEXITY_MODE mode{ECOMPLEXITY_MODE::LOW_COMPLEXITY};
+    switch (complexity) {
+        case 0: { mode = ECOMPLEXITY_MODE::LOW_COMPLEXITY; break; }
+        case 1: { mode = ECOMPLEXITY_MODE::MEDIUM_COMPLEXITY; break; }
+        default: { mode = ECOMPLEXITY_MODE::HIGH_COMPLEXITY; break; }
+    }
+    return m_valid && (cmResultSuccess == m_encoder->SetOption(ENCODER_OPTION_COMPLEXITY, &mode));
+}
+
+bool H264Encoder::setFrameSkip(bool frameSkip) noexcept {
+    return m_valid && (cmResultSuccess == m_encoder->SetOption(ENCODER_OPTION_RC_FRAME_SKIP, &frameSkip));
+}
+
+bool H264Encoder::resize(uint32_t width, uint32_t height) noexcept {
+    if (!m_valid) {
+        return false;
+    }
+    std::vector<Layer> layers;
+    for (const auto &layer : m_layers) {
+        const Layer LAYER{(width / layer.divisor) & ~1u, (height / layer.divisor) & ~1u, layer.divisor};
+        if ((1 < layer.divisor) && ((16 > LAYER.width) || (16 > LAYER.height))) {
+            std::cerr << "[opendlv-video-h264-recorder]: Invalid layer 1/" << layer.divisor << " of " << width << "x" << height << "." << std::endl;
+            return false;
+        }
+        layers.push_back(LAYER);
+    }
+    layers.front() = Layer{width, height, 1};
+
+    // openh264 resets itself for a new resolution but keeps its instance and threads.
+    SEncParamExt parameters;
+    memset(&parameters, 0, sizeof(SEncParamExt));
+    if (cmResultSuccess != m_encoder->GetOption(ENCODER_OPTION_SVC_ENCODE_PARAM_EXT, &parameters)) {
+        return false;
+    }
+    SEncParamExt previous{parameters};
+    parameters.iPicWidth = static_cast<int>(width);
+    parameters.iPicHeight = static_cast<int>(height);
+    for (std::size_t spatialId{0}; spatialId < layers.size(); spatialId++) {
+        const Layer &LAYER = layers[m_layerOfSpatialId[spatialId]];
+        SSpatialLayerConfig &layer = parameters.sSpatialLayers[spatialId];
+        layer.iVideoWidth = static_cast<int>(LAYER.width);
+        layer.iVideoHeight = static_cast<int>(LAYER.height);
+        layer.sSliceArgument.uiSliceNum = numberOfSlices(m_settings, LAYER.height);
+    }
+    if (cmResultSuccess != m_encoder->SetOption(ENCODER_OPTION_SVC_ENCODE_PARAM_EXT, &parameters)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to change openh264 to " << width << "x" << height << "." << std::endl;
+        // Keep encoding at the previous resolution when the encoder cannot be recreated for the new one.
+        m_valid = (cmResultSuccess == m_encoder->SetOption(ENCODER_OPTION_SVC_ENCODE_PARAM_EXT, &previous));
+        return false;
+    }
+    m_layers = layers;
+    m_width = width;
+    m_height = height;
+    m_encoder->ForceIntraFrame(true);
+    return true;
+}
+
+uint32_t H264Encoder::width() const noexcept {
+    return m_width;
+}
+
+uint32_t H264Encoder::height() const noexcept {
+    return m_height;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef H264_ENCODER_HPP
+#define H264_ENCODER_HPP
+
+#include "video-encoder.hpp"
+
+#include <wels/codec_api.h>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * This class encodes I420 frames into h264 using openh264. Downscaled layers
+ * are encoded as simulcast spatial layers so that each layer is a separate
+ * AVC stream that can be decoded on its own.
+ */
+class H264Encoder : public VideoEncoder {
+   private:
+    H264Encoder(const H264Encoder &) = delete;
+    H264Encoder(H264Encoder &&)      = delete;
+    H264Encoder &operator=(const H264Encoder &) = delete;
+    H264Encoder &operator=(H264Encoder &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param settings Encoder settings.
+     * @param width Width of the frames to encode.
+     * @param height Height of the frames to encode.
+     */
+    H264Encoder(const EncoderSettings &settings, uint32_t width, uint32_t height) noexcept;
+    ~H264Encoder() override;
+
+    bool valid() const noexcept override;
+
+    /**
+     * This method encodes a tightly packed I420 frame.
+     *
+     * @param i420 Pointer to the I420 frame of width x height.
+     * @param layers Encoded layers (output); see VideoEncoder::encode.
+     * @param isKeyFrame True if the encoded frame is an IDR frame (output).
+     * @return Size in bytes of all layers; 0 if the frame was skipped or could not be encoded.
+     */
+    std::size_t encode(const uint8_t *i420, std::vector<EncodedLayer> &layers, bool &isKeyFrame) noexcept;
+
+    std::size_t encode(const I420Picture &picture, std::vector<EncodedLayer> &layers, bool &isKeyFrame) noexcept override;
+    void forceKeyFrame() noexcept override;
+    bool setFrameRate(float fps) noexcept override;
+    bool setBitrate(uint32_t bitrate) noexcept override;
+    bool setComplexity(uint32_t complexity) noexcept override;
+    bool setFrameSkip(bool frameSkip) noexcept override;
+    bool resize(uint32_t width, uint32_t height) noexcept override;
+    uint32_t width() const noexcept override;
+    uint32_t height() const noexcept override;
+
+   private:
+    static uint32_t threads(const EncoderSettings &settings) noexcept;
+    static SliceModeEnum sliceMode(const EncoderSettings &settings) noexcept;
+    static uint32_t numberOfSlices(const EncoderSettings &settings, uint32_t height) noexcept;
+
+   private:
+    struct Layer {
+        uint32_t width{0};
+        uint32_t height{0};
+        uint32_t divisor{1};
+    };
+
+    EncoderSettings m_settings;
+    ISVCEncoder *m_encoder{nullptr};
+    bool m_valid{false};
+    uint32_t m_width;
+    uint32_t m_height;
+    std::vector<Layer> m_layers{}; // Full resolution first, then the downscaled layers.
+    std::vector<std::size_t> m_layerOfSpatialId{}; // openh264 orders spatial layers by increasing resolution.
+};
+
+#endif
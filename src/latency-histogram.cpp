@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latency-histogram.hpp"
+
+constexpr uint32_t LatencyHistogram::SUB_BUCKETS;
+constexpr uint32_t LatencyHistogram::NUMBER_OF_BUCKETS;
+
+void LatencyHistogram::record(int64_t microseconds) noexcept {
+    const int64_t VALUE{(0 > microseconds) ? 0 : microseconds};
+    m_counts[indexOf(static_cast<uint64_t>(VALUE))].fetch_add(1, std::memory_order_relaxed);
+    int64_t max{m_max.load(std::memory_order_relaxed)};
+    while ((max < VALUE) && !m_max.compare_exchange_weak(max, VALUE, std::memory_order_relaxed)) {}
+}
+
+LatencyHistogram::Summary LatencyHistogram::takeSummary() noexcept {
+    uint64_t counts[NUMBER_OF_BUCKETS];
+    Summary summary;
+    for (uint32_t i{0}; i < NUMBER_OF_BUCKETS; i++) {
+        counts[i] = m_counts[i].exchange(0, std::memory_order_relaxed);
+        summary.count += counts[i];
+    }
+    summary.max = m_max.exchange(0, std::memory_order_relaxed);
+
+    if (0 < summary.count) {
+        // Ranks of the percentiles (1-based); a bucket is reported by its highest value.
+        const uint64_t RANK_P50{(summary.count * 500 + 999) / 1000};
+        const uint64_t RANK_P99{(summary.count * 990 + 999) / 1000};
+        const uint64_t RANK_P999{(summary.count * 999 + 999) / 1000};
+        uint64_t seen{0};
+        for (uint32_t i{0}; i < NUMBER_OF_BUCKETS; i++) {
+            if (0 == counts[i]) {
+                continue;
+            }
+            const uint64_t BEFORE{seen};
+            seen += counts[i];
+            const int64_t VALUE{(valueOf(i) < summary.max) ? valueOf(i) : summary.max};
+            if ((BEFORE < RANK_P50) && (RANK_P50 <= seen)) {
+                summary.p50 = VALUE;
+            }
+            if ((BEFORE < RANK_P99) && (RANK_P99 <= seen)) {
+                summary.p99 = VALUE;
+            }
+            if ((BEFORE < RANK_P999) && (RANK_P999 <= seen)) {
+                summary.p999 = VALUE;
+            }
+        }
+    }
+    return summary;
+}
+
+uint32_t LatencyHistogram::indexOf(uint64_t value) noexcept {
+    if (value < SUB_BUCKETS) {
+        return static_cast<uint32_t>(value);
+    }
+    const uint64_t MAX_VALUE{(static_cast<uint64_t>(1) << (MAX_EXPONENT + 1)) - 1};
+    value = (value > MAX_VALUE) ? MAX_VALUE : value;
+    const uint32_t EXPONENT{63 - static_cast<uint32_t>(__builtin_clzll(value))};
+    const uint32_t SHIFT{EXPONENT - SUB_BUCKET_BITS};
+    const uint32_t SUB_BUCKET{static_cast<uint32_t>(value >> SHIFT) - SUB_BUCKETS};
+    return SUB_BUCKETS + SHIFT * SUB_BUCKETS + SUB_BUCKET;
+}
+
+int64_t LatencyHistogram::valueOf(uint32_t index) noexcept {
+    if (index < SUB_BUCKETS) {
+        return static_cast<int64_t>(index);
+    }
+    const uint32_t SHIFT{(index - SUB_BUCKETS) / SUB_BUCKETS};
+    const uint64_t SUB_BUCKET{(index - SUB_BUCKETS) % SUB_BUCKETS};
+    return static_cast<int64_t>(((SUB_BUCKETS + SUB_BUCKET + 1) << SHIFT) - 1);
+}
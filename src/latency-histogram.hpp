@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * This class counts latencies in microseconds in logarithmic buckets with
+ * 16 linear sub-buckets each (relative error below 6.25%), similar to an
+ * HDR histogram. Recording and taking a summary are lock-free so that a
+ * reporting thread never stalls an encoding thread.
+ */
+class LatencyHistogram {
+   private:
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram(LatencyHistogram &&)      = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(LatencyHistogram &&) = delete;
+
+   public:
+    struct Summary {
+        uint64_t count{0};
+        int64_t p50{0};
+        int64_t p99{0};
+        int64_t p999{0};
+        int64_t max{0};
+    };
+
+   public:
+    LatencyHistogram() = default;
+
+    /**
+     * This method adds a latency; values beyond ~18 minutes are clamped.
+     *
+     * @param microseconds Latency to add.
+     */
+    void record(int64_t microseconds) noexcept;
+
+    /**
+     * This method returns percentiles of the latencies recorded since the
+     * last call and resets the histogram.
+     *
+     * @return Summary of the latencies recorded since the last call.
+     */
+    Summary takeSummary() noexcept;
+
+   private:
+    static uint32_t indexOf(uint64_t value) noexcept;
+    static int64_t valueOf(uint32_t index) noexcept;
+
+   private:
+    static constexpr uint32_t SUB_BUCKET_BITS{4};
+    static constexpr uint32_t SUB_BUCKETS{1 << SUB_BUCKET_BITS};
+    static constexpr uint32_t MAX_EXPONENT{30};
+    static constexpr uint32_t NUMBER_OF_BUCKETS{SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS};
+
+    std::atomic<uint64_t> m_counts[NUMBER_OF_BUCKETS]{};
+    std::atomic<int64_t> m_max{0};
+};
+
+#endif
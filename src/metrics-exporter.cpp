@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics-exporter.hpp"
+
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+MetricsExporter::MetricsExporter(const std::string &address, uint16_t port, const std::string &prefix, const std::vector<CameraStatistics*> &statistics, const RecordingWriter &recordingWriter, uint32_t intervalInMilliseconds) noexcept
+    : m_sender(address, port)
+    , m_prefix(sanitize(prefix))
+    , m_statistics(statistics)
+    , m_lastCounters(statistics.size())
+    , m_recordingWriter(recordingWriter)
+    , m_interval(intervalInMilliseconds)
+    , m_lastPush(std::chrono::steady_clock::now()) {
+    for (auto s : m_statistics) {
+        m_names.push_back(m_prefix + "." + sanitize(s->name) + ".");
+        m_lastCounters[m_names.size() - 1] = s->counters();
+    }
+    m_lastBytesWritten = m_recordingWriter.bytesWritten();
+    m_lastDropped = m_recordingWriter.dropped();
+    m_lastDroppedEnvelopes = m_recordingWriter.droppedEnvelopes();
+    m_thread = std::thread(&MetricsExporter::run, this);
+}
+
+MetricsExporter::~MetricsExporter() {
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_running = false;
+    }
+    m_stopped.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    push();
+}
+
+bool MetricsExporter::parseEndpoint(const std::string &endpoint, std::string &address, uint16_t &port) noexcept {
+    const std::size_t COLON{endpoint.rfind(':')};
+    if ((std::string::npos == COLON) || (0 == COLON) || (endpoint.size() == COLON + 1)) {
+        return false;
+    }
+    char *end{nullptr};
+    const long VALUE{std::strtol(endpoint.c_str() + COLON + 1, &end, 10)};
+    if ((nullptr == end) || ('\0' != *end) || (VALUE < 1) || (VALUE > 65535)) {
+        return false;
+    }
+    address = endpoint.substr(0, COLON);
+    port = static_cast<uint16_t>(VALUE);
+    return true;
+}
+
+std::string MetricsExporter::sanitize(const std::string &name) noexcept {
+    // ':', '|', and '@' are delimiters in the statsd protocol; '.' separates the name into a hierarchy.
+    std::string retVal{name};
+    for (auto &c : retVal) {
+        const bool VALID{(('a' <= c) && ('z' >= c)) || (('A' <= c) && ('Z' >= c)) || (('0' <= c) && ('9' >= c)) || ('-' == c) || ('_' == c)};
+        if (!VALID) {
+            c = '_';
+        }
+    }
+    return retVal;
+}
+
+void MetricsExporter::run() noexcept {
+    std::unique_lock<std::mutex> lck(m_mutex);
+    while (m_running) {
+        if (!m_stopped.wait_for(lck, m_interval, [this]{ return !m_running; })) {
+            push();
+        }
+    }
+}
+
+void MetricsExporter::push() noexcept {
+    const std::chrono::steady_clock::time_point NOW{std::chrono::steady_clock::now()};
+    const double SECONDS{std::chrono::duration<double>(NOW - m_lastPush).count()};
+    m_lastPush = NOW;
+
+    for (std::size_t i{0}; i < m_statistics.size(); i++) {
+        const CameraStatistics &statistics{*m_statistics[i]};
+        const CameraCounters COUNTERS{statistics.counters()};
+        const CameraCounters INTERVAL{COUNTERS - m_lastCounters[i]};
+        m_lastCounters[i] = COUNTERS;
+
+        const std::string &NAME{m_names[i]};
+        counter(NAME + "frames", INTERVAL.frames);
+        counter(NAME + "skipped", INTERVAL.skipped);
+        counter(NAME + "unchanged", INTERVAL.unchanged);
+        counter(NAME + "dropped", INTERVAL.dropped);
+        counter(NAME + "missed", INTERVAL.missed);
+        counter(NAME + "gaps", INTERVAL.gaps);
+        counter(NAME + "stalls", INTERVAL.stalls);
+        counter(NAME + "bytes", INTERVAL.bytes);
+        if (0.0 < SECONDS) {
+            gauge(NAME + "fps", static_cast<double>(INTERVAL.frames) / SECONDS);
+            gauge(NAME + "bitrate", static_cast<double>(INTERVAL.bytes) * 8.0 / SECONDS);
+        }
+        gauge(NAME + "queued", static_cast<double>(m_recordingWriter.queued(statistics.producer)));
+    }
+
+    const uint64_t BYTES_WRITTEN{m_recordingWriter.bytesWritten()};
+    const uint64_t DROPPED{m_recordingWriter.dropped()};
+    const uint64_t DROPPED_ENVELOPES{m_recordingWriter.droppedEnvelopes()};
+    const std::string NAME{m_prefix + ".writer."};
+    counter(NAME + "bytes", BYTES_WRITTEN - m_lastBytesWritten);
+    counter(NAME + "dropped", DROPPED - m_lastDropped);
+    counter(NAME + "dropped_envelopes", DROPPED_ENVELOPES - m_lastDroppedEnvelopes);
+    if (0.0 < SECONDS) {
+        gauge(NAME + "throughput", static_cast<double>(BYTES_WRITTEN - m_lastBytesWritten) / SECONDS);
+    }
+    gauge(NAME + "queued", static_cast<double>(m_recordingWriter.queued()));
+    m_lastBytesWritten = BYTES_WRITTEN;
+    m_lastDropped = DROPPED;
+    m_lastDroppedEnvelopes = DROPPED_ENVELOPES;
+    flush();
+}
+
+void MetricsExporter::counter(const std::string &name, uint64_t value) noexcept {
+    append(name + ":" + std::to_string(value) + "|c");
+}
+
+void MetricsExporter::gauge(const std::string &name, double value) noexcept {
+    std::stringstream sstr;
+    // Some statsd daemons do not parse exponents.
+    sstr << name << ":" << std::fixed << std::setprecision(2) << value << "|g";
+    append(sstr.str());
+}
+
+void MetricsExporter::append(const std::string &metric) noexcept {
+    // statsd accepts several metrics per packet separated by newlines.
+    if (!m_packet.empty() && (m_packet.size() + 1 + metric.size() > MAX_PACKET_SIZE)) {
+        flush();
+    }
+    if (!m_packet.empty()) {
+        m_packet += '\n';
+    }
+    m_packet += metric;
+}
+
+void MetricsExporter::flush() noexcept {
+    if (!m_packet.empty()) {
+        std::string packet;
+        packet.swap(m_packet);
+        m_sender.send(std::move(packet));
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_EXPORTER_HPP
+#define METRICS_EXPORTER_HPP
+
+#include "cluon-complete.hpp"
+#include "recorder-statistics.hpp"
+#include "recording-writer.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * This class periodically pushes the counters of the cameras and of the
+ * RecordingWriter as statsd metrics via UDP, e.g., to alert on recorders
+ * falling behind. The counters are only read, so exporting does not
+ * interfere with the StatisticsReporter or with encoding and writing.
+ */
+class MetricsExporter {
+   private:
+    MetricsExporter(const MetricsExporter &) = delete;
+    MetricsExporter(MetricsExporter &&)      = delete;
+    MetricsExporter &operator=(const MetricsExporter &) = delete;
+    MetricsExporter &operator=(MetricsExporter &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param address IPv4 address of the statsd daemon.
+     * @param port UDP port of the statsd daemon.
+     * @param prefix Prefix of all metric names.
+     * @param statistics Statistics of the cameras to export.
+     * @param recordingWriter Writer to export the queue depths and throughput of.
+     * @param intervalInMilliseconds Interval between two pushes.
+     */
+    MetricsExporter(const std::string &address, uint16_t port, const std::string &prefix, const std::vector<CameraStatistics*> &statistics, const RecordingWriter &recordingWriter, uint32_t intervalInMilliseconds) noexcept;
+
+    /**
+     * Destructor; pushes the last metrics.
+     */
+    ~MetricsExporter();
+
+    /**
+     * This method parses "address:port".
+     *
+     * @param endpoint Text to parse.
+     * @param address IPv4 address (output).
+     * @param port UDP port (output).
+     * @return true if endpoint is valid.
+     */
+    static bool parseEndpoint(const std::string &endpoint, std::string &address, uint16_t &port) noexcept;
+
+   public:
+    static constexpr std::size_t MAX_PACKET_SIZE{1432}; // Fits into an Ethernet frame with IPv4 and UDP headers.
+
+   private:
+    void run() noexcept;
+    void push() noexcept;
+    void counter(const std::string &name, uint64_t value) noexcept;
+    void gauge(const std::string &name, double value) noexcept;
+    void append(const std::string &metric) noexcept;
+    void flush() noexcept;
+    static std::string sanitize(const std::string &name) noexcept;
+
+   private:
+    cluon::UDPSender m_sender;
+    const std::string m_prefix;
+    std::vector<CameraStatistics*> m_statistics;
+    std::vector<std::string> m_names{};
+    std::vector<CameraCounters> m_lastCounters;
+    const RecordingWriter &m_recordingWriter;
+    uint64_t m_lastBytesWritten{0};
+    uint64_t m_lastDropped{0};
+    uint64_t m_lastDroppedEnvelopes{0};
+    std::chrono::milliseconds m_interval;
+    std::chrono::steady_clock::time_point m_lastPush;
+    std::string m_packet{};
+
+    std::mutex m_mutex{};
+    std::condition_variable m_stopped{};
+    bool m_running{true};
+    std::thread m_thread{};
+};
+
+#endif
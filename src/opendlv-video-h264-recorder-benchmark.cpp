@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cluon-complete.hpp"
+#include "opendlv-standard-message-set.hpp"
+
+#include "envelope-serializer.hpp"
+#include "frame-buffer.hpp"
+#include "h264-encoder.hpp"
+#include "rec-file.hpp"
+#include "recording-segments.hpp"
+#include "recording-writer.hpp"
+
+#include <wels/codec_api.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+struct SourceFrames {
+    uint32_t width{0};
+    uint32_t height{0};
+    std::vector<std::vector<uint8_t>> frames{};
+};
+
+std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> retVal;
+    std::stringstream sstr(list);
+    std::string entry;
+    while (std::getline(sstr, entry, ',')) {
+        retVal.push_back(entry);
+    }
+    return retVal;
+}
+
+std::vector<uint32_t> toNumbers(const std::string &list, const std::string &defaultList) {
+    std::vector<uint32_t> retVal;
+    for (auto e : splitList(list.empty() ? defaultList : list)) {
+        retVal.push_back(static_cast<uint32_t>(std::stoi(e)));
+    }
+    return retVal;
+}
+
+// Moving diagonal gradient with pseudo-random texture so that both intra and inter prediction have work to do.
+SourceFrames generateFrames(uint32_t width, uint32_t height, uint32_t numberOfFrames) {
+    SourceFrames retVal;
+    retVal.width = width;
+    retVal.height = height;
+    const uint32_t LUMA{width * height};
+    const uint32_t I420_SIZE{LUMA + (LUMA >> 1)};
+    uint32_t state{0x12345678};
+    for (uint32_t i{0}; i < numberOfFrames; i++) {
+        std::vector<uint8_t> frame(I420_SIZE);
+        for (uint32_t y{0}; y < height; y++) {
+            for (uint32_t x{0}; x < width; x++) {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                frame[y * width + x] = static_cast<uint8_t>(((x + y + 4 * i) & 0xFF) / 2 + (state & 0x1F));
+            }
+        }
+        for (uint32_t c{0}; c < (LUMA >> 1); c++) {
+            frame[LUMA + c] = static_cast<uint8_t>(128 + ((c / width + i) & 0x1F));
+        }
+        retVal.frames.push_back(std::move(frame));
+    }
+    return retVal;
+}
+
+// Extracts I420 frames from ImageReadings stored as i420 or h264 in a .rec file; only frames with the geometry of the first one are kept.
+SourceFrames loadFrames(const std::string &recFile, uint32_t maxNumberOfFrames) {
+    SourceFrames retVal;
+    std::fstream in(recFile, std::ios::in | std::ios::binary);
+    if (!in.good()) {
+        std::cerr << "[opendlv-video-h264-recorder-benchmark]: Failed to open '" << recFile << "'." << std::endl;
+        return retVal;
+    }
+
+    ISVCDecoder *decoder{nullptr};
+    if ((0 != WelsCreateDecoder(&decoder)) || (nullptr == decoder)) {
+        std::cerr << "[opendlv-video-h264-recorder-benchmark]: Failed to create openh264 decoder." << std::endl;
+        return retVal;
+    }
+    SDecodingParam decodingParameters;
+    memset(&decodingParameters, 0, sizeof(SDecodingParam));
+    decodingParameters.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_DEFAULT;
+    decoder->Initialize(&decodingParameters);
+
+    auto append = [&retVal](uint32_t width, uint32_t height, std::vector<uint8_t> &&frame){
+        if (retVal.frames.empty()) {
+            retVal.width = width;
+            retVal.height = height;
+        }
+        if ((width == retVal.width) && (height == retVal.height)) {
+            retVal.frames.push_back(std::move(frame));
+        }
+    };
+
+    while (in.good() && (retVal.frames.size() < maxNumberOfFrames)) {
+        auto e{cluon::extractEnvelope(in)};
+        if (!e.first || (opendlv::proxy::ImageReading::ID() != e.second.dataType())) {
+            continue;
+        }
+        auto img{cluon::extractMessage<opendlv::proxy::ImageReading>(std::move(e.second))};
+        if ("i420" == img.fourcc()) {
+            const uint32_t I420_SIZE{img.width() * img.height() + ((img.width() * img.height()) >> 1)};
+            if (I420_SIZE <= img.data().size()) {
+                std::vector<uint8_t> frame(img.data().begin(), img.data().begin() + I420_SIZE);
+                append(img.width(), img.height(), std::move(frame));
+            }
+        }
+        else if ("h264" == img.fourcc()) {
+            unsigned char *yuv[3]{nullptr, nullptr, nullptr};
+            SBufferInfo bufferInfo;
+            memset(&bufferInfo, 0, sizeof(SBufferInfo));
+            const std::string &data{img.data()};
+            if ((0 == decoder->DecodeFrameNoDelay(reinterpret_cast<const unsigned char*>(data.data()), static_cast<int>(data.size()), yuv, &bufferInfo)) && (1 == bufferInfo.iBufferStatus)) {
+                const uint32_t WIDTH{static_cast<uint32_t>(bufferInfo.UsrData.sSystemBuffer.iWidth)};
+                const uint32_t HEIGHT{static_cast<uint32_t>(bufferInfo.UsrData.sSystemBuffer.iHeight)};
+                const uint32_t STRIDE_Y{static_cast<uint32_t>(bufferInfo.UsrData.sSystemBuffer.iStride[0])};
+                const uint32_t STRIDE_UV{static_cast<uint32_t>(bufferInfo.UsrData.sSystemBuffer.iStride[1])};
+                std::vector<uint8_t> frame(WIDTH * HEIGHT + ((WIDTH * HEIGHT) >> 1));
+                uint8_t *dst{frame.data()};
+                for (uint32_t y{0}; y < HEIGHT; y++, dst += WIDTH) {
+                    memcpy(dst, yuv[0] + y * STRIDE_Y, WIDTH);
+                }
+                for (uint32_t plane{1}; plane < 3; plane++) {
+                    for (uint32_t y{0}; y < HEIGHT / 2; y++, dst += WIDTH / 2) {
+                        memcpy(dst, yuv[plane] + y * STRIDE_UV, WIDTH / 2);
+                    }
+                }
+                append(WIDTH, HEIGHT, std::move(frame));
+            }
+        }
+    }
+
+    decoder->Uninitialize();
+    WelsDestroyDecoder(decoder);
+    return retVal;
+}
+
+std::string percentiles(std::vector<int64_t> &samples) {
+    std::stringstream sstr;
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        auto at = [&samples](double p){
+            const std::size_t index{static_cast<std::size_t>(std::ceil(p * static_cast<double>(samples.size())))};
+            return samples[std::min(std::max(index, static_cast<std::size_t>(1)), samples.size()) - 1];
+        };
+        sstr << at(0.5) << "/" << at(0.99) << "/" << at(0.999);
+    }
+    return sstr.str();
+}
+}
+
+int32_t main(int32_t argc, char **argv) {
+    int32_t retCode{1};
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+    if (0 != commandlineArguments.count("help")) {
+        std::cerr << argv[0] << " measures the encode-and-write path of opendlv-video-h264-recorder using synthetic or replayed I420 frames." << std::endl;
+        std::cerr << "Usage:   " << argv[0] << " [--frames=300] [--resolution=640x480,1280x720,1920x1080] [--gop=10] [--rc-mode=0] [--ecomplexity=0] [--threads=1] [--bitrate=1500000] [--replay=MyFile.rec] [--out=/dev/null] [--queue-depth=0]" << std::endl;
+        std::cerr << "         --frames:          number of frames to encode per configuration" << std::endl;
+        std::cerr << "         --resolution:      comma-separated list of WxH to sweep over; ignored with --replay" << std::endl;
+        std::cerr << "         --gop:             comma-separated list of lengths of group of pictures to sweep over" << std::endl;
+        std::cerr << "         --rc-mode:         comma-separated list of rate control modes to sweep over" << std::endl;
+        std::cerr << "         --ecomplexity:     comma-separated list of complexity modes to sweep over" << std::endl;
+        std::cerr << "         --threads:         comma-separated list of numbers of threads to sweep over" << std::endl;
+        std::cerr << "         --bitrate:         desired bitrate" << std::endl;
+        std::cerr << "         --replay:          .rec file to extract i420 or h264 ImageReadings from instead of using synthetic frames" << std::endl;
+        std::cerr << "         --out:             recording file to write the encoded frames to" << std::endl;
+        std::cerr << "         --queue-depth:     number of encoded frames to buffer for a separate writer thread (0: write from the encoding loop)" << std::endl;
+        std::cerr << "Example: " << argv[0] << " --resolution=1920x1080,3840x2160 --threads=1,4,8 --ecomplexity=0,2" << std::endl;
+        return retCode;
+    }
+
+    const uint32_t FRAMES{(commandlineArguments["frames"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["frames"])) : 300};
+    const uint32_t BITRATE{(commandlineArguments["bitrate"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["bitrate"])) : 1500000};
+    const std::string REPLAY{commandlineArguments["replay"]};
+    const std::string OUT{(commandlineArguments["out"].size() != 0) ? commandlineArguments["out"] : "/dev/null"};
+    const uint32_t QUEUE_DEPTH{(commandlineArguments["queue-depth"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["queue-depth"])) : 0};
+    const std::vector<uint32_t> GOPS{toNumbers(commandlineArguments["gop"], "10")};
+    const std::vector<uint32_t> RC_MODE_LIST{toNumbers(commandlineArguments["rc-mode"], "0")};
+    const std::vector<uint32_t> ECOMPLEXITIES{toNumbers(commandlineArguments["ecomplexity"], "0")};
+    const std::vector<uint32_t> THREADS{toNumbers(commandlineArguments["threads"], "1")};
+    // Frames are generated or extracted up front and looped over so that their creation is not measured.
+    const uint32_t SOURCE_FRAMES{std::min(FRAMES, static_cast<uint32_t>(60))};
+
+    std::vector<SourceFrames> sources;
+    if (!REPLAY.empty()) {
+        sources.push_back(loadFrames(REPLAY, SOURCE_FRAMES));
+        if (sources.back().frames.empty()) {
+            std::cerr << "[opendlv-video-h264-recorder-benchmark]: No i420 or h264 frames found in '" << REPLAY << "'." << std::endl;
+            return retCode;
+        }
+    }
+    else {
+        for (auto resolution : splitList((commandlineArguments["resolution"].size() != 0) ? commandlineArguments["resolution"] : "640x480,1280x720,1920x1080")) {
+            const std::size_t X{resolution.find('x')};
+            if (std::string::npos == X) {
+                std::cerr << "[opendlv-video-h264-recorder-benchmark]: Invalid resolution '" << resolution << "'." << std::endl;
+                return retCode;
+            }
+            sources.push_back(generateFrames(static_cast<uint32_t>(std::stoi(resolution.substr(0, X))), static_cast<uint32_t>(std::stoi(resolution.substr(X + 1))), SOURCE_FRAMES));
+        }
+    }
+
+    std::cout << std::left << std::setw(11) << "resolution" << std::setw(5) << "gop" << std::setw(4) << "rc" << std::setw(5) << "cpx" << std::setw(5) << "thr"
+              << std::setw(9) << "fps" << std::setw(12) << "bytes/frame"
+              << std::setw(20) << "copy[us]" << std::setw(20) << "encode[us]" << std::setw(20) << "serialize[us]" << std::setw(20) << "write[us]" << "total[us] (p50/p99/p99.9)" << std::endl;
+
+    const std::string FOURCC{"h264"};
+    for (const auto &source : sources) {
+        const uint32_t I420_SIZE{source.width * source.height + ((source.width * source.height) >> 1)};
+        for (auto gop : GOPS) {
+            for (auto rcMode : RC_MODE_LIST) {
+                for (auto ecomplexity : ECOMPLEXITIES) {
+                    for (auto threads : THREADS) {
+                        EncoderSettings encoderSettings;
+                        encoderSettings.gop = gop;
+                        encoderSettings.bitrate = BITRATE;
+                        encoderSettings.rcMode = std::min(rcMode, static_cast<uint32_t>(4));
+                        encoderSettings.ecomplexity = std::min(ecomplexity, static_cast<uint32_t>(2));
+                        encoderSettings.threads = static_cast<int32_t>(threads);
+                        encoderSettings.autoFps = false;
+
+                        H264Encoder encoder(encoderSettings, source.width, source.height);
+                        FrameBuffer frameBuffer(I420_SIZE);
+                        std::mutex recFileMutex;
+                        RecordingSegments segments(OUT, {}, 0, std::chrono::seconds(0), false, false, 0, [](const std::string &filename){
+                            return std::unique_ptr<RecordingFile>(new RecFile(filename, 256 * 1024, 100, 0));
+                        });
+                        if (!encoder.valid() || !frameBuffer.valid() || !segments.good()) {
+                            std::cerr << "[opendlv-video-h264-recorder-benchmark]: Failed to set up configuration." << std::endl;
+                            return retCode;
+                        }
+                        std::vector<int64_t> copy, encode, serialize, write, total;
+                        {
+                            RecordingWriter recordingWriter(segments, recFileMutex, nullptr, nullptr, 1, QUEUE_DEPTH, RecordingWriter::QueuePolicy::BLOCK, 0, false);
+                            std::vector<EncodedLayer> layers;
+                            uint64_t bytes{0};
+                            uint32_t encodedFrames{0};
+
+                            const cluon::data::TimeStamp START{cluon::time::now()};
+                            for (uint32_t i{0}; i < FRAMES; i++) {
+                                const cluon::data::TimeStamp T0{cluon::time::now()};
+                                uint8_t *frame{frameBuffer.data()};
+                                memcpy(frame, source.frames[i % source.frames.size()].data(), I420_SIZE);
+                                const cluon::data::TimeStamp T1{cluon::time::now()};
+                                bool isKeyFrame{false};
+                                const std::size_t totalSize{encoder.encode(frame, layers, isKeyFrame)};
+                                const cluon::data::TimeStamp T2{cluon::time::now()};
+                                if (0 == totalSize) {
+                                    continue;
+                                }
+                                std::string serializedEnvelope;
+                                serializeImageReadingEnvelope(serializedEnvelope, FOURCC, source.width, source.height, layers[0].chunks.data(), layers[0].chunks.size(), T2, T0, 0);
+                                const cluon::data::TimeStamp T3{cluon::time::now()};
+                                recordingWriter.push(0, std::move(serializedEnvelope), IndexEntry{});
+                                const cluon::data::TimeStamp T4{cluon::time::now()};
+
+                                copy.push_back(cluon::time::deltaInMicroseconds(T1, T0));
+                                encode.push_back(cluon::time::deltaInMicroseconds(T2, T1));
+                                serialize.push_back(cluon::time::deltaInMicroseconds(T3, T2));
+                                write.push_back(cluon::time::deltaInMicroseconds(T4, T3));
+                                total.push_back(cluon::time::deltaInMicroseconds(T4, T0));
+                                bytes += totalSize;
+                                encodedFrames++;
+                            }
+                            recordingWriter.stop();
+                            segments.close();
+                            const int64_t DURATION{std::max(cluon::time::deltaInMicroseconds(cluon::time::now(), START), static_cast<int64_t>(1))};
+
+                            std::stringstream resolution;
+                            resolution << source.width << "x" << source.height;
+                            std::cout << std::left << std::setw(11) << resolution.str() << std::setw(5) << gop << std::setw(4) << encoderSettings.rcMode << std::setw(5) << encoderSettings.ecomplexity << std::setw(5) << threads
+                                      << std::setw(9) << std::fixed << std::setprecision(1) << (static_cast<double>(FRAMES) * 1000.0 * 1000.0 / static_cast<double>(DURATION))
+                                      << std::setw(12) << ((0 < encodedFrames) ? bytes / encodedFrames : 0)
+                                      << std::setw(20) << percentiles(copy) << std::setw(20) << percentiles(encode) << std::setw(20) << percentiles(serialize) << std::setw(20) << percentiles(write) << percentiles(total) << std::endl;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    retCode = 0;
+    return retCode;
+}
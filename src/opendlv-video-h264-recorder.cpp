@@ -17,36 +17,60 @@
 
 #include "cluon-complete.hpp"
 #include "opendlv-standard-message-set.hpp"
-
-#include <wels/codec_api.h>
+#include "broadcaster.hpp"
+#include "camera-recorder.hpp"
+#include "envelope-chunker.hpp"
+#include "event-buffer.hpp"
+#include "h264-encoder.hpp"
+#include "metrics-exporter.hpp"
+#include "rec-file.hpp"
+#include "recorder-statistics.hpp"
+#include "recording-segments.hpp"
+#include "recording-transcoder.hpp"
+#include "recording-writer.hpp"
+#include "thread-scheduling.hpp"
+#include "uring-rec-file.hpp"
+#include "v4l2-encoder.hpp"
 
 #include <cstdint>
 #include <cstring>
 #include <ctime>
 
 #include <algorithm>
-#include <fstream>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 int32_t main(int32_t argc, char **argv) {
     int32_t retCode{1};
     auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
-    if ( (0 == commandlineArguments.count("name")) ||
-         (0 == commandlineArguments.count("width")) ||
-         (0 == commandlineArguments.count("height")) ) {
-        std::cerr << argv[0] << " attaches to an I420-formatted image residing in a shared memory area to convert it into an h264 frame to store to a file." << std::endl;
+    if ( (0 == commandlineArguments.count("transcode")) &&
+         ((0 == commandlineArguments.count("name")) ||
+          (0 == commandlineArguments.count("width")) ||
+          (0 == commandlineArguments.count("height"))) ) {
+        std::cerr << argv[0] << " attaches to an I420-formatted (or NV12, YUYV, RGB) image residing in a shared memory area to convert it into an h264 frame to store to a file." << std::endl;
         std::cerr << "Usage:   " << argv[0] << " --name=<name of shared memory area> --width=<width> --height=<height> [--verbose] [--id=<identifier in case of multiple instances] [--cid=<OpenDaVINCI session to include Envelopes from the specified CID in the recording>] [--rec=MyFile.rec] [--recsuffix=Suffix]" << std::endl;
         std::cerr << "         --cid:             CID of the OD4Session to receive Envelopes to include in the recording file" << std::endl;
-        std::cerr << "         --id:              when using several instances, this identifier is used as senderStamp" << std::endl;
+        std::cerr << "         --id:              when using several instances, this identifier is used as senderStamp; comma-separated list for several cameras" << std::endl;
         std::cerr << "         --rec:             name of the recording file; default: YYYY-MM-DD_HHMMSS.rec" << std::endl;
         std::cerr << "         --recsuffix:       additional suffix to add to the .rec file" << std::endl;
-        std::cerr << "         --name:            name of the shared memory area to attach" << std::endl;
-        std::cerr << "         --width:           width of the frame" << std::endl;
-        std::cerr << "         --height:          height of the frame" << std::endl;
+        std::cerr << "         --name:            name of the shared memory area to attach; comma-separated list to record several cameras into one file" << std::endl;
+        std::cerr << "         --width:           width of the frame; comma-separated list for several cameras; a new geometry can be announced as ImageReadingShared via --cid" << std::endl;
+        std::cerr << "         --height:          height of the frame; comma-separated list for several cameras; see --width" << std::endl;
+        std::cerr << "         --cores:           optional: comma-separated list of CPU cores to pin each camera's encoding and encoder threads to; several cores per camera as ranges joined by '+', e.g., 2-3+6" << std::endl;
+        std::cerr << "         --writer-cores:    optional: CPU cores to pin the writer thread to (see --queue-depth), e.g., 4-5" << std::endl;
+        std::cerr << "         --priority:        optional: SCHED_FIFO priority of the encoding and writer threads (default: 0, 0: default scheduler, max: 99)" << std::endl;
+        std::cerr << "         --mlock:           optional: lock the preallocated buffers and all other memory mapped at start into RAM" << std::endl;
+        std::cerr << "         --format:          optional: pixel format in the shared memory; comma-separated list for several cameras (default: i420, one of: i420, nv12, yuyv, rgb, bgr)" << std::endl;
+        std::cerr << "         --stride:          optional: bytes per row of the first plane including padding; comma-separated list for several cameras (default: 0, 0: tightly packed)" << std::endl;
+        std::cerr << "         --stride-uv:       optional: bytes per row of the chroma plane(s) for i420 and nv12; comma-separated list for several cameras (default: 0, 0: half of --stride for i420, --stride for nv12)" << std::endl;
+        std::cerr << "         --plane-height:    optional: rows of the first plane including padding before the chroma plane(s) start; comma-separated list for several cameras (default: 0, 0: height)" << std::endl;
+        std::cerr << "         --crop:            optional: region x,y,w,h of the frame to encode with x and y even; four values per camera (default: whole frame)" << std::endl;
         std::cerr << "         --bitrate:         optional: desired bitrate (default: 1,500,000, min: 100,000 max: 5,000,000)" << std::endl;
         std::cerr << "         --bitrate-max:     optional: maximum bitrate (default: 5,000,000, min: 100,000 max: 5,000,000)" << std::endl;
         std::cerr << "         --gop:             optional: length of group of pictures (default = 10)" << std::endl;
@@ -67,9 +91,55 @@ int32_t main(int32_t argc, char **argv) {
         std::cerr << "         --adaptive-quant:  optional: toggle adaptive quantization control (default: 1)" << std::endl;
         std::cerr << "         --frame-cropping:  optional: toggle frame cropping (default: 1)" << std::endl;
         std::cerr << "         --scene-change-detect: optional: toggle scene change detection control (default: 1)" << std::endl;
-        std::cerr << "         --threads:         optional: number of threads (default: 1, 0: auto, >1: number of theads, max 4)" << std::endl;
-        std::cerr << "         --verbose:         print encoding information" << std::endl;
+        std::cerr << "         --encoder:         optional: h264 encoder (default: openh264, openh264: software encoder, v4l2: V4L2 memory-to-memory hardware encoder, falls back to openh264)" << std::endl;
+        std::cerr << "         --encoder-device:  optional: device of the v4l2 encoder (default: /dev/video11)" << std::endl;
+        std::cerr << "         --adaptive:        optional: adapt bitrate, complexity, frame skipping, and the share of encoded frames to the encoding time and the writer queue or, without --queue-depth, the write time to keep up in real time" << std::endl;
+        std::cerr << "         --adaptive-bitrate-min: optional: lowest bitrate for --adaptive (default: --bitrate / 4, min: 100,000)" << std::endl;
+        std::cerr << "         --adaptive-bitrate-max: optional: highest bitrate for --adaptive (default: --bitrate, max: --bitrate-max)" << std::endl;
+        std::cerr << "         --adaptive-decimation-max: optional: encode at least every N-th frame with --adaptive (default: 2, 1: encode all frames, max: 10)" << std::endl;
+        std::cerr << "         --fps:             optional: frame rate of the camera for the rate control (default: auto, auto: start at 20 FPS and follow the measured frame rate, N: fixed frame rate)" << std::endl;
+        std::cerr << "         --threads:         optional: number of threads (default: one per four macroblock rows of the frame, 1 with --transcode, max: number of cores; 0: auto, >0: number of threads)" << std::endl;
+        std::cerr << "         --slice-mode:      optional: slice mode (default: 3 for one thread, otherwise 1; 0: single slice, 1: fixed number of slices, 2: one slice per macroblock row, 3: size-limited slices)" << std::endl;
+        std::cerr << "         --slices:          optional: number of slices for slice mode 1 (default: 0, 0: one per thread with at least four macroblock rows each, max: " << MAX_SLICES_NUM_TMP << ")" << std::endl;
+        std::cerr << "         --layers:          optional: comma-separated list of divisors of width and height to additionally encode downscaled layers in the same pass, e.g., 2,4 for 1/2 and 1/4 size (default: none, max: 3 layers)" << std::endl;
+        std::cerr << "         --layer-id-offset: optional: the i-th downscaled layer is sent with senderStamp + i * offset (default: 100)" << std::endl;
+        std::cerr << "         --snapshot:        optional: copy each frame into a buffer to unlock the shared memory before encoding; frames that need a conversion are always converted into such a buffer (default: 1, 0: encode while locked, 1: copy)" << std::endl;
+        std::cerr << "         --queue-depth:     optional: number of encoded frames to buffer for a separate writer thread (default: 0, 0: write from the encoding loop, max: 1024)" << std::endl;
+        std::cerr << "         --envelope-queue-depth: optional: number of Envelopes from --cid to buffer for the writer thread before they are dropped (default: 1024, 0: write from the receiving thread, max: 65536)" << std::endl;
+        std::cerr << "         --queue-policy:    optional: behavior when the writer queue is full (default: drop, drop: discard the frame, block: wait for the writer)" << std::endl;
+        std::cerr << "         --flush-bytes:     optional: number of bytes to collect before writing to the recording file (default: 262,144, 0: write every Envelope immediately)" << std::endl;
+        std::cerr << "         --flush-interval-ms: optional: maximum time in milliseconds to keep data collected before writing (default: 100, 0: no time limit)" << std::endl;
+        std::cerr << "         --fdatasync-interval-ms: optional: interval in milliseconds to commit written data to disk using fdatasync (default: 0, 0: off)" << std::endl;
+        std::cerr << "         --split-size:      optional: continue the recording in a new numbered file (e.g., MyFile-0001.rec) at the next IDR frame after this many MiB (default: 0, 0: off)" << std::endl;
+        std::cerr << "         --split-duration:  optional: continue the recording in a new numbered file at the next IDR frame after this many seconds (default: 0, 0: off)" << std::endl;
+        std::cerr << "         --out-dir:         optional: comma-separated list of directories, e.g., on different disks, to place the numbered files in by turns, skipping those without room for a full file; their order is listed in <rec>.segments (default: directory of --rec)" << std::endl;
+        std::cerr << "         --trigger:         optional: only record when an Envelope with dataType[/senderStamp] arrives on --cid (e.g., 1100/3); until then, Envelopes are kept in memory for --pre-trigger seconds" << std::endl;
+        std::cerr << "         --pre-trigger:     optional: seconds of Envelopes before the trigger to record, starting at an IDR frame (default: 10)" << std::endl;
+        std::cerr << "         --post-trigger:    optional: seconds to record after the last trigger (default: 10)" << std::endl;
+        std::cerr << "         --pre-trigger-buffer: optional: size in MiB of the preallocated memory to keep Envelopes in before the trigger (default: 256, min: 1)" << std::endl;
+        std::cerr << "         --broadcast:       optional: also publish the encoded frames to the OD4Session given by --cid; frames larger than a UDP packet are only recorded" << std::endl;
+        std::cerr << "         --broadcast-cid:   optional: publish the encoded frames to this OD4Session instead of --cid; implies --broadcast" << std::endl;
+        std::cerr << "         --broadcast-queue-depth: optional: number of encoded frames per camera waiting to be published before frames are dropped (default: 4, min: 1, max: 64)" << std::endl;
+        std::cerr << "         --chunk-compression: optional: group Envelopes from --cid into chunks compressed with zlib or zstd as supported by the build; h264 frames stay uncompressed (default: off)" << std::endl;
+        std::cerr << "         --chunk-size:      optional: KiB of uncompressed Envelopes per chunk (default: 256, max: 16384)" << std::endl;
+        std::cerr << "         --chunk-interval:  optional: milliseconds after which a chunk is written even if not full (default: 1000)" << std::endl;
+        std::cerr << "         --index:           optional: toggle writing a seek index with time stamp, file offset, dataType, senderStamp, and key frame flag per Envelope to <rec>.idx (default: 1)" << std::endl;
+        std::cerr << "         --io-backend:      optional: how to write the recording file (default: buffered, buffered: through the page cache, uring: io_uring with O_DIRECT, falls back to buffered)" << std::endl;
+        std::cerr << "         --static-threshold: optional: do not encode frames whose Y plane differs from the last encoded frame by less than this mean absolute difference, e.g., 1.5 (default: 0, 0: encode all frames)" << std::endl;
+        std::cerr << "         --static-keep-alive: optional: milliseconds after which a frame of an unchanged scene is encoded anyway (default: 1000)" << std::endl;
+        std::cerr << "         --wait-timeout:    optional: milliseconds without a frame until a camera is reported as stalled and its encoding thread is woken up, e.g., to terminate (default: 0, 0: wait indefinitely)" << std::endl;
+        std::cerr << "         --shutdown-timeout: optional: milliseconds after a termination signal until which encoding threads are stopped and queued frames are written; then, remaining frames are discarded and the files are committed using fdatasync (default: 0, 0: write all queued frames without fdatasync)" << std::endl;
+        std::cerr << "         --stats-interval:  optional: interval in seconds to print per-stage latency percentiles and counters, also sent as SignalStatusMessage with --cid (default: 0, 0: off; 10 with --verbose)" << std::endl;
+        std::cerr << "         --statsd:          optional: address:port of a statsd daemon to push counters, frame rates, bitrates, queue depths, and write throughput to via UDP" << std::endl;
+        std::cerr << "         --statsd-interval: optional: interval in milliseconds between two pushes to --statsd (default: 1000, min: 100)" << std::endl;
+        std::cerr << "         --statsd-prefix:   optional: prefix of all metric names (default: opendlv-video-h264-recorder)" << std::endl;
+        std::cerr << "         --transcode:       optional: instead of attaching to shared memory, re-encode the raw (i420, nv12, yuyv, rgb, bgr) and h264 ImageReadings of this recording file into --rec using the encoder settings; all other Envelopes are copied" << std::endl;
+        std::cerr << "         --transcode-threads: optional: number of threads to encode chunks of frames in parallel with --transcode (default: number of cores)" << std::endl;
+        std::cerr << "         --transcode-chunk: optional: number of frames per stream and chunk to encode with one encoder; h264 input is cut at the next IDR frame (default: 10 * --gop)" << std::endl;
+        std::cerr << "         --verbose:         print encoding information and statistics" << std::endl;
         std::cerr << "Example: " << argv[0] << " --name=data --width=640 --height=480 --verbose" << std::endl;
+        std::cerr << "         " << argv[0] << " --name=left,right --width=1280 --height=720 --id=1,2 --cores=2,3 --cid=111" << std::endl;
+        std::cerr << "         " << argv[0] << " --transcode=archive.rec --rec=archive-500k.rec --bitrate=500000" << std::endl;
     }
     else {
         auto getYYYYMMDD_HHMMSS = [](){
@@ -95,14 +165,99 @@ int32_t main(int32_t argc, char **argv) {
             return retVal;
         };
 
-        const std::string NAME{commandlineArguments["name"]};
+        auto splitList = [](const std::string &list){
+            std::vector<std::string> retVal;
+            std::stringstream sstr(list);
+            std::string entry;
+            while (std::getline(sstr, entry, ',')) {
+                retVal.push_back(entry);
+            }
+            return retVal;
+        };
+
+        // Several cameras are given as comma-separated lists; missing widths and heights are taken from the previous camera.
+        const std::vector<std::string> NAMES{splitList(commandlineArguments["name"])};
+        const std::vector<std::string> WIDTHS{splitList(commandlineArguments["width"])};
+        const std::vector<std::string> HEIGHTS{splitList(commandlineArguments["height"])};
+        const std::vector<std::string> IDS{splitList(commandlineArguments["id"])};
+        const std::vector<std::string> CORES{splitList(commandlineArguments["cores"])};
+        const int32_t PRIORITY_MAX{99};
+        const int32_t PRIORITY{(commandlineArguments["priority"].size() != 0) ? std::min(std::max(std::stoi(commandlineArguments["priority"]), 0), PRIORITY_MAX) : 0};
+        ThreadScheduling writerScheduling;
+        writerScheduling.priority = PRIORITY;
+        if ((commandlineArguments["writer-cores"].size() != 0) && !parseCores(commandlineArguments["writer-cores"], writerScheduling.cores)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Invalid CPU cores '" << commandlineArguments["writer-cores"] << "' for the writer thread." << std::endl;
+            return retCode;
+        }
+        const bool MLOCK{0 != commandlineArguments.count("mlock")};
+        const std::vector<std::string> FORMATS{splitList(commandlineArguments["format"])};
+        const std::vector<std::string> STRIDES{splitList(commandlineArguments["stride"])};
+        const std::vector<std::string> STRIDES_UV{splitList(commandlineArguments["stride-uv"])};
+        const std::vector<std::string> PLANE_HEIGHTS{splitList(commandlineArguments["plane-height"])};
+        const std::vector<std::string> CROPS{splitList(commandlineArguments["crop"])};
+        if (0 != (CROPS.size() % 4)) {
+            std::cerr << "[opendlv-video-h264-recorder]: --crop requires four values x,y,w,h per camera." << std::endl;
+            return retCode;
+        }
+        const float STATIC_THRESHOLD{(commandlineArguments["static-threshold"].size() != 0) ? std::max(std::stof(commandlineArguments["static-threshold"]), 0.0f) : 0.0f};
+        const uint32_t STATIC_KEEP_ALIVE{(commandlineArguments["static-keep-alive"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["static-keep-alive"])) : 1000};
+        const uint32_t WAIT_TIMEOUT{(commandlineArguments["wait-timeout"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["wait-timeout"])) : 0};
+        const uint32_t LAYER_ID_OFFSET{(commandlineArguments["layer-id-offset"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["layer-id-offset"])) : 100};
+        std::vector<CameraSettings> CAMERAS;
+        for (std::size_t i{0}; i < NAMES.size(); i++) {
+            CameraSettings camera;
+            camera.name = NAMES[i];
+            camera.width = static_cast<uint32_t>(std::stoi(WIDTHS[std::min(i, WIDTHS.size() - 1)]));
+            camera.height = static_cast<uint32_t>(std::stoi(HEIGHTS[std::min(i, HEIGHTS.size() - 1)]));
+            // Cameras without an explicit identifier continue counting from the last given one.
+            camera.senderStamp = (i < IDS.size()) ? static_cast<uint32_t>(std::stoi(IDS[i])) : (IDS.empty() ? static_cast<uint32_t>(i) : CAMERAS.back().senderStamp + 1);
+            if ((i < CORES.size()) && !parseCores(CORES[i], camera.scheduling.cores)) {
+                std::cerr << "[opendlv-video-h264-recorder]: Invalid CPU cores '" << CORES[i] << "' for '" << camera.name << "'." << std::endl;
+                return retCode;
+            }
+            camera.scheduling.priority = PRIORITY;
+            const std::string FORMAT{FORMATS.empty() ? "i420" : FORMATS[std::min(i, FORMATS.size() - 1)]};
+            if (!parsePixelFormat(FORMAT, camera.format)) {
+                std::cerr << "[opendlv-video-h264-recorder]: Unknown pixel format '" << FORMAT << "' for '" << camera.name << "'." << std::endl;
+                return retCode;
+            }
+            camera.stride = STRIDES.empty() ? 0 : static_cast<uint32_t>(std::stoi(STRIDES[std::min(i, STRIDES.size() - 1)]));
+            camera.strideUV = STRIDES_UV.empty() ? 0 : static_cast<uint32_t>(std::stoi(STRIDES_UV[std::min(i, STRIDES_UV.size() - 1)]));
+            camera.layerIdOffset = LAYER_ID_OFFSET;
+            camera.waitTimeout = WAIT_TIMEOUT;
+            camera.staticThreshold = STATIC_THRESHOLD;
+            camera.staticKeepAlive = STATIC_KEEP_ALIVE;
+            camera.planeHeight = PLANE_HEIGHTS.empty() ? 0 : static_cast<uint32_t>(std::stoi(PLANE_HEIGHTS[std::min(i, PLANE_HEIGHTS.size() - 1)]));
+            if (!CROPS.empty()) {
+                // Cameras without their own region use the last given one.
+                const std::size_t CROP{4 * std::min(i, CROPS.size() / 4 - 1)};
+                camera.cropX = static_cast<uint32_t>(std::stoi(CROPS[CROP]));
+                camera.cropY = static_cast<uint32_t>(std::stoi(CROPS[CROP + 1]));
+                camera.cropWidth = static_cast<uint32_t>(std::stoi(CROPS[CROP + 2]));
+                camera.cropHeight = static_cast<uint32_t>(std::stoi(CROPS[CROP + 3]));
+            }
+            CAMERAS.push_back(camera);
+        }
+
         const std::string RECSUFFIX{commandlineArguments["recsuffix"]};
-        const uint32_t WIDTH{static_cast<uint32_t>(std::stoi(commandlineArguments["width"]))};
-        const uint32_t HEIGHT{static_cast<uint32_t>(std::stoi(commandlineArguments["height"]))};
         const uint32_t CID{(commandlineArguments["cid"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["cid"])) : 0};
-        const uint32_t ID{(commandlineArguments["id"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["id"])) : 0};
+        const bool BROADCAST{(0 != commandlineArguments.count("broadcast")) || (0 != commandlineArguments.count("broadcast-cid"))};
+        const uint32_t BROADCAST_CID{BROADCAST ? ((commandlineArguments["broadcast-cid"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["broadcast-cid"])) : CID) : 0};
+        const uint32_t BROADCAST_QUEUE_DEPTH_MAX{64};
+        const uint32_t BROADCAST_QUEUE_DEPTH{(commandlineArguments["broadcast-queue-depth"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["broadcast-queue-depth"])), 1u), BROADCAST_QUEUE_DEPTH_MAX) : 4};
         const std::string NAME_RECFILE{(commandlineArguments["rec"].size() != 0) ? commandlineArguments["rec"] + RECSUFFIX : (getYYYYMMDD_HHMMSS() + RECSUFFIX + ".rec")};
         const bool VERBOSE{commandlineArguments.count("verbose") != 0};
+        const uint32_t STATS_INTERVAL{(commandlineArguments["stats-interval"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["stats-interval"])) : (VERBOSE ? 10 : 0)};
+        const uint32_t SHUTDOWN_TIMEOUT{(commandlineArguments["shutdown-timeout"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["shutdown-timeout"])) : 0};
+        const std::string STATSD{commandlineArguments["statsd"]};
+        const uint32_t STATSD_INTERVAL{(commandlineArguments["statsd-interval"].size() != 0) ? std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["statsd-interval"])), 100u) : 1000};
+        const std::string STATSD_PREFIX{(commandlineArguments["statsd-prefix"].size() != 0) ? commandlineArguments["statsd-prefix"] : "opendlv-video-h264-recorder"};
+        std::string statsdAddress;
+        uint16_t statsdPort{0};
+        if (!STATSD.empty() && !MetricsExporter::parseEndpoint(STATSD, statsdAddress, statsdPort)) {
+            std::cerr << "[opendlv-video-h264-recorder]: --statsd must be given as address:port." << std::endl;
+            return retCode;
+        }
 
         const uint32_t GOP_DEFAULT{10};
         const uint32_t GOP{(commandlineArguments["gop"].size() != 0) ? static_cast<uint32_t>(std::stoi(commandlineArguments["gop"])) : GOP_DEFAULT};
@@ -126,6 +281,10 @@ int32_t main(int32_t argc, char **argv) {
         const uint32_t I_ENTROPY_CODING{(commandlineArguments["entropy-coding"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["entropy-coding"])), ZERO), ONE): 0};
         const uint32_t B_FRAME_SKIP{(commandlineArguments["frame-skip"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["frame-skip"])), ZERO), ONE): 1};
         const uint32_t I_BITRATE_MAX{(commandlineArguments["bitrate-max"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["bitrate-max"])), BITRATE_MIN), BITRATE_MAX) : BITRATE_MAX};
+        const bool ADAPTIVE{0 != commandlineArguments.count("adaptive")};
+        const uint32_t ADAPTIVE_BITRATE_MIN{(commandlineArguments["adaptive-bitrate-min"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["adaptive-bitrate-min"])), BITRATE_MIN), BITRATE) : std::max(BITRATE / 4, BITRATE_MIN)};
+        const uint32_t ADAPTIVE_BITRATE_MAX{(commandlineArguments["adaptive-bitrate-max"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["adaptive-bitrate-max"])), BITRATE), I_BITRATE_MAX) : BITRATE};
+        const uint32_t ADAPTIVE_DECIMATION_MAX{(commandlineArguments["adaptive-decimation-max"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["adaptive-decimation-max"])), ONE), static_cast<uint32_t>(10)) : 2};
         const uint32_t QP_MIN{0};
         const uint32_t QP_MAX{51};
         const uint32_t I_MAX_QP{(commandlineArguments["qp-max"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["qp-max"])), QP_MIN), QP_MAX): 42};
@@ -137,222 +296,312 @@ int32_t main(int32_t argc, char **argv) {
         const uint32_t B_ADAPTIVE_QUANT{(commandlineArguments["adaptive-quant"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["adaptive-quant"])), ZERO), ONE): 1};
         const uint32_t B_FRAME_CROPPING{(commandlineArguments["frame-cropping"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["frame-cropping"])), ZERO), ONE): 1};
         const uint32_t B_SCENE_CHANGE_DETECT{(commandlineArguments["scene-change-detect"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["scene-change-detect"])), ZERO), ONE): 1};
-        const uint32_t I_MULTIPLE_THREADS{(commandlineArguments["threads"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["threads"])), ZERO), FOUR): 1};
-
-
-        std::unique_ptr<cluon::SharedMemory> sharedMemory(new cluon::SharedMemory{NAME});
-        if (sharedMemory && sharedMemory->valid()) {
-            std::clog << "[opendlv-video-h264-recorder]: Attached to '" << sharedMemory->name() << "' (" << sharedMemory->size() << " bytes); recording data to '" << NAME_RECFILE << "'" << std::endl;
-
-            ISVCEncoder *encoder{nullptr};
-            if (0 != WelsCreateSVCEncoder(&encoder) || (nullptr == encoder)) {
-                std::cerr << argv[0] << ": Failed to create openh264 encoder." << std::endl;
-                return retCode;
-            }
-
-            int logLevel{VERBOSE ? WELS_LOG_INFO : WELS_LOG_QUIET};
-            encoder->SetOption(ENCODER_OPTION_TRACE_LEVEL, &logLevel);
-
-            // Configure parameters for openh264 encoder.
-            SEncParamExt parameters;
-            {
-                memset(&parameters, 0, sizeof(SEncParamBase));
-                encoder->GetDefaultParams(&parameters);
-
-                parameters.fMaxFrameRate = 20 /*FPS*/; // This parameter is implicitly given by the notifications from the shared memory.
-                parameters.iUsageType = EUsageType::CAMERA_VIDEO_REAL_TIME;
-                parameters.iPicWidth = WIDTH;
-                parameters.iPicHeight = HEIGHT;
-                parameters.uiIntraPeriod = GOP;
-                parameters.iTargetBitrate = BITRATE;
-                parameters.iSpatialLayerNum = 1;
-                parameters.iTemporalLayerNum = 1;
-                parameters.iLtrMarkPeriod = 30;
-                parameters.iMultipleThreadIdc = I_MULTIPLE_THREADS; // 1 = disable multi threads.
-
-                parameters.sSpatialLayers[0].iVideoWidth = parameters.iPicWidth;
-                parameters.sSpatialLayers[0].iVideoHeight = parameters.iPicHeight;
-                parameters.sSpatialLayers[0].fFrameRate = parameters.fMaxFrameRate;
-                parameters.sSpatialLayers[0].iSpatialBitrate = parameters.iTargetBitrate;
-                parameters.sSpatialLayers[0].iMaxSpatialBitrate = I_BITRATE_MAX;
-                parameters.sSpatialLayers[0].sSliceArgument.uiSliceMode = SliceModeEnum::SM_SIZELIMITED_SLICE;
-                parameters.sSpatialLayers[0].sSliceArgument.uiSliceNum = 1;
-
-                /*
-                 * Parameters:
-                 * https://github.com/cisco/openh264/wiki/TypesAndStructures
-                 * https://github.com/cisco/openh264/blob/master/codec/encoder/core/inc/param_svc.h#L132
-                 */
-                parameters.iNumRefFrame = (I_NUM_REF_FRAME == 0) ? AUTO_REF_PIC_COUNT : I_NUM_REF_FRAME;
-                parameters.bPrefixNalAddingCtrl = B_PREFIX_NAL;
-                parameters.bEnableSSEI = B_SSEI;
-                parameters.iPaddingFlag = I_PADDING;
-                parameters.iEntropyCodingModeFlag = I_ENTROPY_CODING;
-                parameters.bEnableFrameSkip = B_FRAME_SKIP;
-                parameters.iMaxBitrate = I_BITRATE_MAX;
-                parameters.iMaxQp = I_MAX_QP;
-                parameters.iMinQp = I_MIN_QP;
-                parameters.bEnableLongTermReference = B_LONG_TERM_REFERENCE;
-                parameters.iLoopFilterDisableIdc = I_LOOP_FILTER;
-                parameters.bEnableDenoise = B_DENOISE;
-                parameters.bEnableBackgroundDetection = B_BACKGROUND_DETECTION;
-                parameters.bEnableAdaptiveQuant = B_ADAPTIVE_QUANT;
-                parameters.bEnableFrameCroppingFlag = B_FRAME_CROPPING;
-                parameters.bEnableSceneChangeDetect = B_SCENE_CHANGE_DETECT;
-
-                switch (RC_MODE) {
-                    case 0: { parameters.iRCMode = RC_MODES::RC_QUALITY_MODE; break; }
-                    case 1: { parameters.iRCMode = RC_MODES::RC_BITRATE_MODE; break; }
-                    case 2: { parameters.iRCMode = RC_MODES::RC_BUFFERBASED_MODE; break; }
-                    case 3: { parameters.iRCMode = RC_MODES::RC_TIMESTAMP_MODE; break; }
-                    case 4: { parameters.iRCMode = RC_MODES::RC_OFF_MODE; break; }
-                }
-
-                switch (SPS_PPS_STRATEGY) {
-                    case 0: { parameters.eSpsPpsIdStrategy = EParameterSetStrategy::CONSTANT_ID; break; }
-                    case 1: { parameters.eSpsPpsIdStrategy = EParameterSetStrategy::INCREASING_ID; break; }
-                    case 2: { parameters.eSpsPpsIdStrategy = EParameterSetStrategy::SPS_LISTING; break; }
-                    case 3: { parameters.eSpsPpsIdStrategy = EParameterSetStrategy::SPS_LISTING_AND_PPS_INCREASING; break; }
+        const bool AUTO_FPS{(commandlineArguments["fps"].size() == 0) || ("auto" == commandlineArguments["fps"])};
+        const float FPS{AUTO_FPS ? 20.0f : std::max(std::stof(commandlineArguments["fps"]), 1.0f)};
+        const uint32_t NUMBER_OF_CORES{std::max(std::thread::hardware_concurrency(), ONE)};
+        const int32_t I_MULTIPLE_THREADS{(commandlineArguments["threads"].size() != 0) ? static_cast<int32_t>(std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["threads"])), ZERO), NUMBER_OF_CORES)) : -1};
+        const int32_t I_SLICE_MODE{(commandlineArguments["slice-mode"].size() != 0) ? static_cast<int32_t>(std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["slice-mode"])), ZERO), THREE)) : -1};
+        const uint32_t I_SLICES{(commandlineArguments["slices"].size() != 0) ? std::min(static_cast<uint32_t>(std::stoi(commandlineArguments["slices"])), static_cast<uint32_t>(MAX_SLICES_NUM_TMP)) : 0};
+        std::vector<uint32_t> LAYERS;
+        for (const auto &layer : splitList(commandlineArguments["layers"])) {
+            LAYERS.push_back(static_cast<uint32_t>(std::stoi(layer)));
+        }
+        if (VideoEncoder::MAX_EXTRA_LAYERS < LAYERS.size()) {
+            std::cerr << "[opendlv-video-h264-recorder]: At most " << VideoEncoder::MAX_EXTRA_LAYERS << " downscaled layers are supported." << std::endl;
+            return retCode;
+        }
+        const uint32_t FLUSH_BYTES_MAX{64 * 1024 * 1024};
+        const uint32_t FLUSH_BYTES{(commandlineArguments["flush-bytes"].size() != 0) ? std::min(static_cast<uint32_t>(std::stoul(commandlineArguments["flush-bytes"])), FLUSH_BYTES_MAX) : 256 * 1024};
+        const uint32_t FLUSH_INTERVAL_MS{(commandlineArguments["flush-interval-ms"].size() != 0) ? static_cast<uint32_t>(std::stoul(commandlineArguments["flush-interval-ms"])) : 100};
+        const uint32_t FDATASYNC_INTERVAL_MS{(commandlineArguments["fdatasync-interval-ms"].size() != 0) ? static_cast<uint32_t>(std::stoul(commandlineArguments["fdatasync-interval-ms"])) : 0};
+        const bool WRITE_INDEX{(commandlineArguments["index"].size() != 0) ? (0 != std::stoi(commandlineArguments["index"])) : true};
+        const uint64_t SPLIT_SIZE{(commandlineArguments["split-size"].size() != 0) ? static_cast<uint64_t>(std::stoull(commandlineArguments["split-size"])) * 1024 * 1024 : 0};
+        const uint32_t SPLIT_DURATION{(commandlineArguments["split-duration"].size() != 0) ? static_cast<uint32_t>(std::stoul(commandlineArguments["split-duration"])) : 0};
+        const std::vector<std::string> OUT_DIRS{splitList(commandlineArguments["out-dir"])};
+        const std::string TRANSCODE{commandlineArguments["transcode"]};
+        const uint32_t TRANSCODE_THREADS{(commandlineArguments["transcode-threads"].size() != 0) ? std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["transcode-threads"])), ONE) : NUMBER_OF_CORES};
+        const uint32_t TRANSCODE_CHUNK{(commandlineArguments["transcode-chunk"].size() != 0) ? std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["transcode-chunk"])), ONE) : 10 * std::max(GOP, ONE)};
+        const std::string TRIGGER{commandlineArguments["trigger"]};
+        const int64_t PRE_TRIGGER{(commandlineArguments["pre-trigger"].size() != 0) ? static_cast<int64_t>(std::stoul(commandlineArguments["pre-trigger"])) : 10};
+        const int64_t POST_TRIGGER{(commandlineArguments["post-trigger"].size() != 0) ? static_cast<int64_t>(std::stoul(commandlineArguments["post-trigger"])) : 10};
+        const uint32_t PRE_TRIGGER_BUFFER_MAX{2047};
+        const uint32_t PRE_TRIGGER_BUFFER{(commandlineArguments["pre-trigger-buffer"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoul(commandlineArguments["pre-trigger-buffer"])), ONE), PRE_TRIGGER_BUFFER_MAX) : 256};
+        const bool IO_BACKEND_URING{"uring" == commandlineArguments["io-backend"]};
+        const std::string ENCODER{("v4l2" == commandlineArguments["encoder"]) ? "v4l2" : "openh264"};
+        const std::string ENCODER_DEVICE{(commandlineArguments["encoder-device"].size() != 0) ? commandlineArguments["encoder-device"] : "/dev/video11"};
+        const uint32_t QUEUE_DEPTH_MAX{1024};
+        const uint32_t QUEUE_DEPTH{(commandlineArguments["queue-depth"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["queue-depth"])), ZERO), QUEUE_DEPTH_MAX) : 0};
+        const uint32_t ENVELOPE_QUEUE_DEPTH_MAX{65536};
+        const uint32_t ENVELOPE_QUEUE_DEPTH{(commandlineArguments["envelope-queue-depth"].size() != 0) ? std::min(static_cast<uint32_t>(std::stoi(commandlineArguments["envelope-queue-depth"])), ENVELOPE_QUEUE_DEPTH_MAX) : 1024};
+        const std::string CHUNK_COMPRESSION{commandlineArguments["chunk-compression"]};
+        const uint32_t CHUNK_SIZE_MAX{16 * 1024};
+        const uint32_t CHUNK_SIZE{(commandlineArguments["chunk-size"].size() != 0) ? std::min(std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["chunk-size"])), ONE), CHUNK_SIZE_MAX) : 256};
+        const uint32_t CHUNK_INTERVAL{(commandlineArguments["chunk-interval"].size() != 0) ? std::max(static_cast<uint32_t>(std::stoi(commandlineArguments["chunk-interval"])), ONE) : 1000};
+        EnvelopeChunker::Codec chunkCodec{EnvelopeChunker::Codec::ZLIB};
+        if (!CHUNK_COMPRESSION.empty() && !EnvelopeChunker::parseCodec(CHUNK_COMPRESSION, chunkCodec)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Compression '" << CHUNK_COMPRESSION << "' is unknown or not supported by this build." << std::endl;
+            return retCode;
+        }
+        const RecordingWriter::QueuePolicy QUEUE_POLICY{("block" == commandlineArguments["queue-policy"]) ? RecordingWriter::QueuePolicy::BLOCK : RecordingWriter::QueuePolicy::DROP};
+        const bool SNAPSHOT{(commandlineArguments["snapshot"].size() == 0) || (0 != std::stoi(commandlineArguments["snapshot"]))};
+
+
+        EncoderSettings encoderSettings;
+        {
+            encoderSettings.gop = GOP;
+            encoderSettings.bitrate = BITRATE;
+            encoderSettings.bitrateMax = I_BITRATE_MAX;
+            encoderSettings.rcMode = RC_MODE;
+            encoderSettings.ecomplexity = ECOMPLEXITY;
+            encoderSettings.spsPpsStrategy = SPS_PPS_STRATEGY;
+            encoderSettings.numRefFrame = I_NUM_REF_FRAME;
+            encoderSettings.prefixNal = B_PREFIX_NAL;
+            encoderSettings.ssei = B_SSEI;
+            encoderSettings.padding = I_PADDING;
+            encoderSettings.entropyCoding = I_ENTROPY_CODING;
+            encoderSettings.frameSkip = B_FRAME_SKIP;
+            encoderSettings.qpMax = I_MAX_QP;
+            encoderSettings.qpMin = I_MIN_QP;
+            encoderSettings.longTermReference = B_LONG_TERM_REFERENCE;
+            encoderSettings.loopFilter = I_LOOP_FILTER;
+            encoderSettings.denoise = B_DENOISE;
+            encoderSettings.backgroundDetection = B_BACKGROUND_DETECTION;
+            encoderSettings.adaptiveQuant = B_ADAPTIVE_QUANT;
+            encoderSettings.frameCropping = B_FRAME_CROPPING;
+            encoderSettings.sceneChangeDetect = B_SCENE_CHANGE_DETECT;
+            encoderSettings.fps = FPS;
+            encoderSettings.autoFps = AUTO_FPS;
+            encoderSettings.threads = I_MULTIPLE_THREADS;
+            encoderSettings.sliceMode = I_SLICE_MODE;
+            encoderSettings.slices = I_SLICES;
+            encoderSettings.layers = LAYERS;
+            encoderSettings.verbose = VERBOSE;
+            encoderSettings.backend = ENCODER;
+            encoderSettings.device = ENCODER_DEVICE;
+        }
+        QualitySettings qualitySettings;
+        {
+            qualitySettings.bitrateMin = ADAPTIVE_BITRATE_MIN;
+            qualitySettings.bitrateMax = ADAPTIVE_BITRATE_MAX;
+            qualitySettings.decimationMax = ADAPTIVE_DECIMATION_MAX;
+        }
+        auto createEncoder = [](const EncoderSettings &settings, uint32_t width, uint32_t height){
+            std::unique_ptr<VideoEncoder> encoder{nullptr};
+            if ("v4l2" == settings.backend) {
+                encoder.reset(new V4L2Encoder(settings, width, height));
+                if (!encoder->valid()) {
+                    std::cerr << "[opendlv-video-h264-recorder]: V4L2 encoder not available for " << width << "x" << height << "; falling back to openh264." << std::endl;
+                    encoder.reset(nullptr);
                 }
+            }
+            if (!encoder) {
+                encoder.reset(new H264Encoder(settings, width, height));
+            }
+            return encoder;
+        };
 
-                switch (ECOMPLEXITY) {
-                    case 0: { parameters.iComplexityMode = ECOMPLEXITY_MODE::LOW_COMPLEXITY;; break; }
-                    case 1: { parameters.iComplexityMode = ECOMPLEXITY_MODE::MEDIUM_COMPLEXITY; break; }
-                    case 2: { parameters.iComplexityMode = ECOMPLEXITY_MODE::HIGH_COMPLEXITY; break; }
+        std::mutex recFileMutex{};
+        // Segments are opened from a background thread; the fallback to buffered writes is decided on the first one.
+        std::atomic<bool> useUring{IO_BACKEND_URING};
+        auto openRecordingFile = [&useUring, FLUSH_BYTES, FLUSH_INTERVAL_MS, FDATASYNC_INTERVAL_MS](const std::string &filename){
+            std::unique_ptr<RecordingFile> recFile{nullptr};
+            if (useUring.load()) {
+                recFile.reset(new UringRecFile(filename, FLUSH_BYTES, FLUSH_INTERVAL_MS, FDATASYNC_INTERVAL_MS));
+                if (!recFile->good()) {
+                    std::cerr << "[opendlv-video-h264-recorder]: io_uring backend not available for '" << filename << "'; falling back to buffered writes." << std::endl;
+                    useUring.store(false);
+                    recFile.reset(nullptr);
                 }
             }
-            if (cmResultSuccess != encoder->InitializeExt(&parameters)) {
-                std::cerr << argv[0] << ": Failed to set parameters for openh264." << std::endl;
+            if (!recFile) {
+                recFile.reset(new RecFile(filename, FLUSH_BYTES, FLUSH_INTERVAL_MS, FDATASYNC_INTERVAL_MS));
+            }
+            return recFile;
+        };
+        if (!TRANSCODE.empty()) {
+            // Offline mode: re-encode the frames of an existing recording file instead of attaching to shared memory.
+            if (TRANSCODE == NAME_RECFILE) {
+                std::cerr << "[opendlv-video-h264-recorder]: --transcode and --rec must name different files." << std::endl;
                 return retCode;
             }
-            else {
-                std::clog << argv[0] << ": Encoding bitrate = " << BITRATE << std::endl;
+            if (commandlineArguments["threads"].size() == 0) {
+                // The chunks are encoded in parallel already.
+                encoderSettings.threads = 1;
             }
+            RecordingSegments transcodeSegments(NAME_RECFILE, OUT_DIRS, SPLIT_SIZE, std::chrono::seconds(SPLIT_DURATION), true, WRITE_INDEX, FDATASYNC_INTERVAL_MS, openRecordingFile);
+            if (transcodeSegments.good()) {
+                std::clog << "[opendlv-video-h264-recorder]: Transcoding '" << TRANSCODE << "' to '" << NAME_RECFILE << "' using " << TRANSCODE_THREADS << " thread(s)" << std::endl;
+                RecordingWriter recordingWriter(transcodeSegments, recFileMutex, nullptr, nullptr, 1, 0, RecordingWriter::QueuePolicy::BLOCK, 0, false);
+                {
+                    RecordingTranscoder recordingTranscoder(encoderSettings, createEncoder, LAYER_ID_OFFSET, TRANSCODE_CHUNK, TRANSCODE_THREADS, recordingWriter);
+                    retCode = recordingTranscoder.transcode(TRANSCODE) ? 0 : 1;
+                }
+                recordingWriter.stop();
+            }
+            transcodeSegments.close();
+            return retCode;
+        }
 
-            // Allocate image buffer to hold h264 frame as output.
-            std::vector<char> h264Buffer;
-            h264Buffer.resize(WIDTH * HEIGHT * 3, '0'); // In practice, this is smaller than WIDTH * HEIGHT * 3
-
-            std::mutex recFileMutex{};
-            std::fstream recFile(NAME_RECFILE.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
-            if (recFile.good()) {
-                cluon::data::TimeStamp before, after, afterWriting, sampleTimeStamp;
-
-                // Interface to a running OpenDaVINCI session (ignoring any incoming Envelopes).
-                std::unique_ptr<cluon::OD4Session> od4{nullptr};
-                if (CID > 0) {
-                    od4.reset(new cluon::OD4Session(CID,
-                              [&recFileMutex, &recFile](cluon::data::Envelope &&envelope){
-                                  std::lock_guard<std::mutex> lck(recFileMutex);
-                                  std::string data{cluon::serializeEnvelope(std::move(envelope))};
-                                  recFile.write(data.data(), data.size());
-                                  recFile.flush();
-                              }));
+        RecordingSegments recordingSegments(NAME_RECFILE, OUT_DIRS, SPLIT_SIZE, std::chrono::seconds(SPLIT_DURATION), false, WRITE_INDEX, FDATASYNC_INTERVAL_MS, openRecordingFile);
+        if (recordingSegments.good()) {
+            // Writer stage decoupling disk I/O from encoding; one queue per camera.
+            std::unique_ptr<EventBuffer> eventBuffer{nullptr};
+            if (!TRIGGER.empty()) {
+                const std::size_t SLASH{TRIGGER.find('/')};
+                const int32_t TRIGGER_DATATYPE{std::stoi(TRIGGER.substr(0, SLASH))};
+                const int64_t TRIGGER_SENDERSTAMP{(std::string::npos != SLASH) ? std::stoll(TRIGGER.substr(SLASH + 1)) : -1};
+                eventBuffer.reset(new EventBuffer(PRE_TRIGGER_BUFFER * 1024 * 1024, PRE_TRIGGER * 1000 * 1000, POST_TRIGGER * 1000 * 1000, TRIGGER_DATATYPE, TRIGGER_SENDERSTAMP));
+                if (0 == CID) {
+                    std::cerr << "[opendlv-video-h264-recorder]: Warning, --trigger requires --cid to receive trigger Envelopes." << std::endl;
                 }
+            }
 
-                while (sharedMemory && sharedMemory->valid() && !cluon::TerminateHandler::instance().isTerminated.load()) {
-                    // Wait for incoming frame.
-                    sharedMemory->wait();
+            std::unique_ptr<EnvelopeChunker> envelopeChunker{nullptr};
+            if (!CHUNK_COMPRESSION.empty()) {
+                envelopeChunker.reset(new EnvelopeChunker(chunkCodec, CHUNK_SIZE * 1024, static_cast<int64_t>(CHUNK_INTERVAL) * 1000));
+            }
 
-                    sampleTimeStamp = cluon::time::now();
+            // Without queues, the writer thread only keeps the time limits of batched writes, chunks, and fdatasync.
+            const bool WRITE_WHEN_IDLE{((0 < FLUSH_BYTES) && (0 < FLUSH_INTERVAL_MS)) || (0 < FDATASYNC_INTERVAL_MS) || (nullptr != envelopeChunker)};
+            RecordingWriter recordingWriter(recordingSegments, recFileMutex, eventBuffer.get(), envelopeChunker.get(), static_cast<uint32_t>(CAMERAS.size()), QUEUE_DEPTH, QUEUE_POLICY, (0 < CID) ? ENVELOPE_QUEUE_DEPTH : 0, WRITE_WHEN_IDLE);
 
-                    int totalSize{0};
-                    sharedMemory->lock();
-                    {
-                        // Read notification timestamp.
-                        auto r = sharedMemory->getTimeStamp();
-                        sampleTimeStamp = (r.first ? r.second : sampleTimeStamp);
-                    }
-                    {
-                        SFrameBSInfo frameInfo;
-                        memset(&frameInfo, 0, sizeof(SFrameBSInfo));
+            std::unique_ptr<Broadcaster> broadcaster{nullptr};
+            if (0 < BROADCAST_CID) {
+                broadcaster.reset(new Broadcaster(BROADCAST_CID, static_cast<uint32_t>(CAMERAS.size()), BROADCAST_QUEUE_DEPTH));
+            }
+            else if (BROADCAST) {
+                std::cerr << "[opendlv-video-h264-recorder]: Warning, --broadcast requires --cid or --broadcast-cid." << std::endl;
+            }
 
-                        SSourcePicture sourceFrame;
-                        memset(&sourceFrame, 0, sizeof(SSourcePicture));
+            std::vector<std::unique_ptr<CameraRecorder>> cameraRecorders;
+            std::chrono::steady_clock::time_point shutdownStart{std::chrono::steady_clock::now()};
+            std::chrono::steady_clock::time_point shutdownDeadline{std::chrono::steady_clock::time_point::max()};
+            std::chrono::steady_clock::time_point camerasStopped{shutdownStart};
+            bool allValid{true};
+            for (std::size_t i{0}; i < CAMERAS.size(); i++) {
+                cameraRecorders.emplace_back(new CameraRecorder(CAMERAS[i], encoderSettings, createEncoder, (ADAPTIVE ? &qualitySettings : nullptr), SNAPSHOT, recordingWriter, broadcaster.get(), i));
+                allValid &= cameraRecorders.back()->valid();
+            }
 
-                        sourceFrame.iColorFormat = EVideoFormatType::videoFormatI420;
-                        sourceFrame.iPicWidth = WIDTH;
-                        sourceFrame.iPicHeight = HEIGHT;
-                        sourceFrame.iStride[0] = WIDTH;
-                        sourceFrame.iStride[1] = WIDTH/2;
-                        sourceFrame.iStride[2] = WIDTH/2;
-                        sourceFrame.pData[0] = reinterpret_cast<uint8_t*>(sharedMemory->data());
-                        sourceFrame.pData[1] = reinterpret_cast<uint8_t*>(sharedMemory->data() + (WIDTH * HEIGHT));
-                        sourceFrame.pData[2] = reinterpret_cast<uint8_t*>(sharedMemory->data() + (WIDTH * HEIGHT + ((WIDTH * HEIGHT) >> 2)));
+            if (allValid) {
+                std::clog << "[opendlv-video-h264-recorder]: Recording " << CAMERAS.size() << " camera(s) to '" << NAME_RECFILE << "'" << std::endl;
+                if (!OUT_DIRS.empty()) {
+                    std::clog << "[opendlv-video-h264-recorder]: Placing the files in " << OUT_DIRS.size() << " directories as listed in '" << NAME_RECFILE << ".segments'" << std::endl;
+                }
+                std::clog << argv[0] << ": Encoding bitrate = " << BITRATE << std::endl;
 
-                        if (VERBOSE) {
-                            before = cluon::time::now();
-                        }
-                        auto result = encoder->EncodeFrame(&sourceFrame, &frameInfo);
-                        if (VERBOSE) {
-                            after = cluon::time::now();
-                        }
-                        if (cmResultSuccess == result) {
-                            if (videoFrameTypeSkip == frameInfo.eFrameType) {
-                                std::cerr << "[opendlv-video-h264-recorder]: Warning, skipping frame." << std::endl;
-                            }
-                            else {
-                                for(int layer{0}; layer < frameInfo.iLayerNum; layer++) {
-                                    int sizeOfLayer{0};
-                                    for(int nal{0}; nal < frameInfo.sLayerInfo[layer].iNalCount; nal++) {
-                                        sizeOfLayer += frameInfo.sLayerInfo[layer].pNalLengthInByte[nal];
-                                    }
-                                    memcpy(&h264Buffer[totalSize], frameInfo.sLayerInfo[layer].pBsBuf, sizeOfLayer);
-                                    totalSize += sizeOfLayer;
-                                }
+                // Interface to a running OpenDaVINCI session (ignoring any incoming Envelopes); shared by all cameras.
+                std::unique_ptr<cluon::OD4Session> od4{nullptr};
+                if (CID > 0) {
+                    // Frames broadcast to the same session are received again and must not be recorded twice.
+                    std::vector<uint32_t> ownSenderStamps;
+                    if (CID == BROADCAST_CID) {
+                        for (const auto &camera : CAMERAS) {
+                            for (std::size_t layer{0}; layer <= LAYERS.size(); layer++) {
+                                ownSenderStamps.push_back(camera.senderStamp + static_cast<uint32_t>(layer) * camera.layerIdOffset);
                             }
                         }
-                        else {
-                            std::cerr << "[opendlv-video-h264-recorder]: Failed to encode frame: " << result << std::endl;
-                        }
                     }
-                    sharedMemory->unlock();
+                    od4.reset(new cluon::OD4Session(CID,
+                              [&recordingWriter, &cameraRecorders, &CAMERAS, ownSenderStamps](cluon::data::Envelope &&envelope){
+                                  if ((opendlv::proxy::ImageReading::ID() == envelope.dataType()) &&
+                                      (ownSenderStamps.end() != std::find(ownSenderStamps.begin(), ownSenderStamps.end(), envelope.senderStamp()))) {
+                                      return;
+                                  }
+                                  if (opendlv::proxy::ImageReadingShared::ID() == envelope.dataType()) {
+                                      // Producers announce the geometry of their shared memory, e.g., after a camera mode change.
+                                      const opendlv::proxy::ImageReadingShared ANNOUNCEMENT{cluon::extractMessage<opendlv::proxy::ImageReadingShared>(cluon::data::Envelope{envelope})};
+                                      for (std::size_t i{0}; i < CAMERAS.size(); i++) {
+                                          if ((CAMERAS[i].name == ANNOUNCEMENT.name()) && (0 < ANNOUNCEMENT.width()) && (0 < ANNOUNCEMENT.height())) {
+                                              cameraRecorders[i]->resize(ANNOUNCEMENT.width(), ANNOUNCEMENT.height());
+                                          }
+                                      }
+                                  }
+                                  // Serialized and written by the writer thread to not hold up receiving.
+                                  recordingWriter.push(std::move(envelope));
+                              }));
+                }
 
-                    if (0 < totalSize) {
-                        opendlv::proxy::ImageReading ir;
-                        ir.fourcc("h264")
-                          .width(WIDTH)
-                          .height(HEIGHT)
-                          .data(std::string(&h264Buffer[0], totalSize));
-                        {
-                            cluon::data::Envelope envelope;
-                            {
-                                cluon::ToProtoVisitor protoEncoder;
-                                {
-                                    envelope.dataType(ir.ID());
-                                    ir.accept(protoEncoder);
-                                    envelope.serializedData(protoEncoder.encodedData());
-                                    envelope.sent(cluon::time::now());
-                                    envelope.sampleTimeStamp(sampleTimeStamp);
-                                    envelope.senderStamp(ID);
-                                }
-                            }
+                if (!writerScheduling.cores.empty() || (0 < writerScheduling.priority)) {
+                    recordingWriter.schedule(writerScheduling);
+                }
+                if (MLOCK && lockMemory()) {
+                    std::clog << "[opendlv-video-h264-recorder]: Locked memory." << std::endl;
+                }
+                for (auto &cameraRecorder : cameraRecorders) {
+                    cameraRecorder->start();
+                }
 
-                            std::lock_guard<std::mutex> lck(recFileMutex);
-                            std::string serializedData{cluon::serializeEnvelope(std::move(envelope))};
-                            recFile.write(serializedData.data(), serializedData.size());
-                            recFile.flush();
+                std::vector<CameraStatistics*> statistics;
+                for (auto &cameraRecorder : cameraRecorders) {
+                    statistics.push_back(&cameraRecorder->statistics());
+                }
+                std::unique_ptr<StatisticsReporter> statisticsReporter{nullptr};
+                if (0 < STATS_INTERVAL) {
+                    statisticsReporter.reset(new StatisticsReporter(statistics, recordingWriter, od4.get(), STATS_INTERVAL));
+                }
+                std::unique_ptr<MetricsExporter> metricsExporter{nullptr};
+                if (!STATSD.empty()) {
+                    metricsExporter.reset(new MetricsExporter(statsdAddress, statsdPort, STATSD_PREFIX, statistics, recordingWriter, STATSD_INTERVAL));
+                }
 
-                            if (VERBOSE) {
-                                afterWriting = cluon::time::now();
-                            }
-                        }
+                // Wait for a termination signal or until all encoding threads ended, e.g., as their shared memory vanished.
+                auto anyRunning = [&cameraRecorders](){
+                    return std::any_of(cameraRecorders.begin(), cameraRecorders.end(), [](const std::unique_ptr<CameraRecorder> &cameraRecorder){ return cameraRecorder->running(); });
+                };
+                while (!cluon::TerminateHandler::instance().isTerminated.load() && anyRunning()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
 
-                        if (VERBOSE) {
-                            std::clog << "[opendlv-video-h264-recorder]: Frame size = " << totalSize << " bytes; sample time = " << cluon::time::toMicroseconds(sampleTimeStamp) << " microseconds; encoding took " << cluon::time::deltaInMicroseconds(after, before) << " microseconds; encoding+writing took " << cluon::time::deltaInMicroseconds(afterWriting, before) << " microseconds." << std::endl;
-                        }
+                shutdownStart = std::chrono::steady_clock::now();
+                if (0 < SHUTDOWN_TIMEOUT) {
+                    shutdownDeadline = shutdownStart + std::chrono::milliseconds(SHUTDOWN_TIMEOUT);
+                }
+                for (auto &cameraRecorder : cameraRecorders) {
+                    if (!cameraRecorder->stop(shutdownDeadline)) {
+                        std::cerr << "[opendlv-video-h264-recorder]: Warning, encoding thread of '" << cameraRecorder->statistics().name << "' did not stop within " << SHUTDOWN_TIMEOUT << " ms." << std::endl;
                     }
                 }
+                for (auto &cameraRecorder : cameraRecorders) {
+                    cameraRecorder->join();
+                }
+                camerasStopped = std::chrono::steady_clock::now();
+
+                metricsExporter.reset(nullptr);
+                statisticsReporter.reset(nullptr);
+                od4.reset(nullptr);
+                retCode = 0;
             }
 
-            if (nullptr != encoder) {
-                encoder->Uninitialize();
-                WelsDestroySVCEncoder(encoder);
+            recordingWriter.stop(shutdownDeadline);
+            const std::chrono::steady_clock::time_point WRITER_STOPPED{std::chrono::steady_clock::now()};
+            if (0 < SHUTDOWN_TIMEOUT) {
+                recordingSegments.sync();
+            }
+            recordingSegments.close();
+            if ((0 == retCode) && ((0 < SHUTDOWN_TIMEOUT) || VERBOSE)) {
+                auto milliseconds = [](std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to){
+                    return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+                };
+                const std::chrono::steady_clock::time_point FILES_CLOSED{std::chrono::steady_clock::now()};
+                std::clog << "[opendlv-video-h264-recorder]: Shut down in " << milliseconds(shutdownStart, FILES_CLOSED) << " ms (encoding threads: " << milliseconds(shutdownStart, camerasStopped)
+                          << " ms, writer: " << milliseconds(camerasStopped, WRITER_STOPPED) << " ms, files: " << milliseconds(WRITER_STOPPED, FILES_CLOSED) << " ms)." << std::endl;
+            }
+            if (0 < recordingWriter.dropped()) {
+                std::clog << "[opendlv-video-h264-recorder]: Dropped " << recordingWriter.dropped() << " frames due to a full writer queue or the shutdown timeout." << std::endl;
+            }
+            if (envelopeChunker && (0 < envelopeChunker->bytesIn())) {
+                std::clog << "[opendlv-video-h264-recorder]: Compressed " << envelopeChunker->bytesIn() << " bytes of Envelopes into " << envelopeChunker->bytesOut() << " bytes." << std::endl;
+            }
+            if (0 < recordingWriter.droppedEnvelopes()) {
+                std::clog << "[opendlv-video-h264-recorder]: Dropped " << recordingWriter.droppedEnvelopes() << " Envelopes from the OD4Session due to a full envelope queue or the shutdown timeout." << std::endl;
+            }
+            if (broadcaster) {
+                broadcaster->stop();
+                if (0 < broadcaster->dropped() + broadcaster->tooLarge()) {
+                    std::clog << "[opendlv-video-h264-recorder]: Did not broadcast " << broadcaster->dropped() << " frames due to a full send queue and " << broadcaster->tooLarge() << " frames exceeding " << Broadcaster::MAX_SIZE << " bytes." << std::endl;
+                }
             }
-            retCode = 0;
-        }
-        else {
-            std::cerr << "[opendlv-video-h264-recorder]: Failed to attach to shared memory '" << NAME << "'." << std::endl;
         }
     }
     return retCode;
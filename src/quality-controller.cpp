@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "quality-controller.hpp"
+
+#include <algorithm>
+
+QualityController::QualityController(const QualitySettings &quality, const EncoderSettings &encoderSettings) noexcept
+    : m_quality(quality)
+    , m_configuredComplexity(encoderSettings.ecomplexity)
+    , m_configuredFrameSkip(0 != encoderSettings.frameSkip)
+    , m_bitrate(std::min(std::max(encoderSettings.bitrate, quality.bitrateMin), quality.bitrateMax))
+    , m_complexity(encoderSettings.ecomplexity)
+    , m_frameSkip(0 != encoderSettings.frameSkip) {
+    m_quality.decimationMax = std::max(m_quality.decimationMax, 1u);
+}
+
+bool QualityController::encodeNextFrame() noexcept {
+    m_decimationCounter = (m_decimationCounter + 1) % m_decimation;
+    return 0 == m_decimationCounter;
+}
+
+bool QualityController::update(int64_t busyInMicroseconds, float queueFill, float frameRate, VideoEncoder &encoder) noexcept {
+    m_busySum += busyInMicroseconds;
+    m_queueFillMax = std::max(m_queueFillMax, queueFill);
+    if (++m_frames < WINDOW) {
+        return false;
+    }
+
+    // Decimated frames leave more time for the encoded ones.
+    const double BUDGET{(0.0f < frameRate) ? (1000.0 * 1000.0 * m_decimation) / frameRate : 0.0};
+    const double CPU_LOAD{(0.0 < BUDGET) ? (static_cast<double>(m_busySum) / m_frames) / BUDGET : 0.0};
+    const bool CPU{CPU_HIGH < CPU_LOAD};
+    const bool DISK{QUEUE_HIGH < m_queueFillMax};
+    const bool IDLE{(CPU_LOW > CPU_LOAD) && (QUEUE_LOW > m_queueFillMax)};
+    m_frames = 0;
+    m_busySum = 0;
+    m_queueFillMax = 0;
+
+    bool retVal{false};
+    if (CPU || DISK) {
+        m_idleWindows = 0;
+        retVal = stepDown(CPU, DISK, encoder);
+    }
+    else if (IDLE && (RECOVERY_WINDOWS <= ++m_idleWindows)) {
+        m_idleWindows = 0;
+        retVal = stepUp(encoder);
+    }
+    else if (!IDLE) {
+        m_idleWindows = 0;
+    }
+    return retVal;
+}
+
+bool QualityController::stepDown(bool cpu, bool disk, VideoEncoder &encoder) noexcept {
+    if (disk && (m_bitrate > m_quality.bitrateMin)) {
+        m_bitrate = std::max(m_bitrate - m_bitrate / 4, m_quality.bitrateMin);
+        return encoder.setBitrate(m_bitrate);
+    }
+    if (cpu && (0 < m_complexity) && encoder.setComplexity(m_complexity - 1)) {
+        m_complexity--;
+        return true;
+    }
+    if (disk && !m_frameSkip && encoder.setFrameSkip(true)) {
+        m_frameSkip = true;
+        return true;
+    }
+    if (m_decimation < m_quality.decimationMax) {
+        m_decimation++;
+        return true;
+    }
+    return false;
+}
+
+bool QualityController::stepUp(VideoEncoder &encoder) noexcept {
+    if (1 < m_decimation) {
+        m_decimation--;
+        return true;
+    }
+    if (m_frameSkip && !m_configuredFrameSkip && encoder.setFrameSkip(false)) {
+        m_frameSkip = false;
+        return true;
+    }
+    if ((m_complexity < m_configuredComplexity) && encoder.setComplexity(m_complexity + 1)) {
+        m_complexity++;
+        return true;
+    }
+    if (m_bitrate < m_quality.bitrateMax) {
+        m_bitrate = std::min(m_bitrate + m_bitrate / 4, m_quality.bitrateMax);
+        return encoder.setBitrate(m_bitrate);
+    }
+    return false;
+}
+
+uint32_t QualityController::bitrate() const noexcept {
+    return m_bitrate;
+}
+
+uint32_t QualityController::complexity() const noexcept {
+    return m_complexity;
+}
+
+bool QualityController::frameSkip() const noexcept {
+    return m_frameSkip;
+}
+
+uint32_t QualityController::decimation() const noexcept {
+    return m_decimation;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUALITY_CONTROLLER_HPP
+#define QUALITY_CONTROLLER_HPP
+
+#include "video-encoder.hpp"
+
+#include <cstdint>
+
+/**
+ * This struct holds the limits for adapting the encoding quality.
+ */
+struct QualitySettings {
+    uint32_t bitrateMin{100000}; // Floor for the target bitrate.
+    uint32_t bitrateMax{1500000}; // Ceiling for the target bitrate.
+    uint32_t decimationMax{2}; // Encode at least every decimationMax-th frame; 1 to encode all frames.
+};
+
+/**
+ * This class adapts the encoder to the load of the recorder so that it keeps
+ * up with the camera in real time. It watches the time spent per frame in
+ * relation to the frame interval (CPU load) and the fill level of the writer
+ * queue or, without a queue, the time spent writing (disk load) over windows
+ * of frames:
+ *
+ * - Disk load first lowers the target bitrate down to its floor, then enables
+ *   openh264's frame skipping, and finally encodes only every n-th frame.
+ * - CPU load first lowers the complexity mode and then encodes only every n-th frame.
+ * - After several windows without load, the steps are undone one at a time
+ *   starting with the decimation, up to the configured settings and the bitrate ceiling.
+ */
+class QualityController {
+   private:
+    QualityController(const QualityController &) = delete;
+    QualityController(QualityController &&)      = delete;
+    QualityController &operator=(const QualityController &) = delete;
+    QualityController &operator=(QualityController &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param quality Limits for adapting the quality.
+     * @param encoderSettings Settings the encoder was created with.
+     */
+    QualityController(const QualitySettings &quality, const EncoderSettings &encoderSettings) noexcept;
+    ~QualityController() = default;
+
+    /**
+     * @return True if the next frame shall be encoded; false if it is decimated.
+     */
+    bool encodeNextFrame() noexcept;
+
+    /**
+     * This method adds the load caused by an encoded frame and reconfigures
+     * the encoder at the end of each window.
+     *
+     * @param busyInMicroseconds Time spent to copy, encode, serialize, and hand over the frame.
+     * @param queueFill Fill level of the writer queue between 0 and 1; without a queue, the share of the frame interval spent writing the frame.
+     * @param frameRate Current frame rate of the camera.
+     * @param encoder Encoder to reconfigure.
+     * @return True if the encoder settings or the decimation changed.
+     */
+    bool update(int64_t busyInMicroseconds, float queueFill, float frameRate, VideoEncoder &encoder) noexcept;
+
+    uint32_t bitrate() const noexcept;
+    uint32_t complexity() const noexcept;
+    bool frameSkip() const noexcept;
+    uint32_t decimation() const noexcept;
+
+   public:
+    static constexpr uint32_t WINDOW{15}; // Encoded frames per evaluation.
+    static constexpr uint32_t RECOVERY_WINDOWS{4}; // Windows without load before stepping up.
+    static constexpr float CPU_HIGH{0.9f}; // Fraction of the frame interval spent per frame.
+    static constexpr float CPU_LOW{0.6f};
+    static constexpr float QUEUE_HIGH{0.5f}; // Fill level of the writer queue or share of the frame interval spent writing.
+    static constexpr float QUEUE_LOW{0.1f};
+
+   private:
+    bool stepDown(bool cpu, bool disk, VideoEncoder &encoder) noexcept;
+    bool stepUp(VideoEncoder &encoder) noexcept;
+
+   private:
+    QualitySettings m_quality;
+    uint32_t m_configuredComplexity;
+    bool m_configuredFrameSkip;
+
+    uint32_t m_bitrate;
+    uint32_t m_complexity;
+    bool m_frameSkip;
+    uint32_t m_decimation{1};
+    uint32_t m_decimationCounter{0};
+
+    uint32_t m_frames{0};
+    int64_t m_busySum{0};
+    float m_queueFillMax{0};
+    uint32_t m_idleWindows{0};
+};
+
+#endif
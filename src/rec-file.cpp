@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rec-file.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+RecFile::RecFile(const std::string &filename, uint32_t flushBytes, uint32_t flushIntervalMs, uint32_t fdatasyncIntervalMs) noexcept
+    : m_filename(filename)
+    , m_flushBytes(flushBytes)
+    , m_flushInterval(flushIntervalMs)
+    , m_fdatasyncInterval(fdatasyncIntervalMs) {
+    m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (-1 == m_fd) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to open '" << m_filename << "': " << ::strerror(errno) << std::endl;
+    }
+    else {
+        m_good = true;
+        m_buffer.reserve(m_flushBytes);
+        m_lastFlush = m_lastFdatasync = std::chrono::steady_clock::now();
+    }
+}
+
+RecFile::~RecFile() {
+    close();
+}
+
+bool RecFile::good() const noexcept {
+    return m_good;
+}
+
+void RecFile::write(const char *data, std::size_t size) noexcept {
+    if (!m_good || (nullptr == data) || (0 == size)) {
+        return;
+    }
+    m_size += size;
+
+    if (m_buffer.size() + size <= m_flushBytes) {
+        m_buffer.insert(m_buffer.end(), data, data + size);
+        if (m_buffer.size() == m_flushBytes) {
+            flush();
+        }
+        else {
+            flushIfDue();
+        }
+    }
+    else {
+        // Large chunks are written together with the pending buffer to avoid copying them.
+        m_good = writeFully(m_buffer.data(), m_buffer.size(), data, size);
+        m_buffer.clear();
+        m_lastFlush = std::chrono::steady_clock::now();
+        m_pendingFdatasync = true;
+        flushIfDue();
+    }
+}
+
+void RecFile::flush() noexcept {
+    if (m_good && !m_buffer.empty()) {
+        m_good = writeFully(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+        m_pendingFdatasync = true;
+    }
+    m_lastFlush = std::chrono::steady_clock::now();
+}
+
+void RecFile::flushIfDue() noexcept {
+    if (!m_good) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if ((0 < m_flushInterval.count()) && !m_buffer.empty() && (now - m_lastFlush >= m_flushInterval)) {
+        flush();
+    }
+    if ((0 < m_fdatasyncInterval.count()) && m_pendingFdatasync && (now - m_lastFdatasync >= m_fdatasyncInterval)) {
+        datasync();
+    }
+}
+
+void RecFile::sync() noexcept {
+    if (-1 != m_fd) {
+        flush();
+        if (m_good) {
+            datasync();
+        }
+    }
+}
+
+void RecFile::close() noexcept {
+    if (-1 != m_fd) {
+        flush();
+        if (m_preallocated > m_size) {
+            // Release reserved but unused blocks beyond the end of the file.
+            if (0 != ::ftruncate(m_fd, static_cast<off_t>(m_size))) {
+                std::cerr << "[opendlv-video-h264-recorder]: Failed to truncate '" << m_filename << "': " << ::strerror(errno) << std::endl;
+            }
+        }
+        if (m_good && (0 < m_fdatasyncInterval.count())) {
+            datasync();
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_good = false;
+}
+
+void RecFile::preallocate(uint64_t size) noexcept {
+    if (-1 != m_fd) {
+        if (0 == ::fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size))) {
+            m_preallocated = size;
+        }
+    }
+}
+
+uint64_t RecFile::size() const noexcept {
+    return m_size;
+}
+
+bool RecFile::writeFully(const char *data, std::size_t size) noexcept {
+    return writeFully(data, size, nullptr, 0);
+}
+
+bool RecFile::writeFully(const char *data1, std::size_t size1, const char *data2, std::size_t size2) noexcept {
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(data1);
+    iov[0].iov_len = size1;
+    iov[1].iov_base = const_cast<char*>(data2);
+    iov[1].iov_len = size2;
+
+    struct iovec *current{iov};
+    int count{2};
+    while (0 < count) {
+        if (0 == current->iov_len) {
+            current++;
+            count--;
+            continue;
+        }
+        ssize_t written = ::writev(m_fd, current, count);
+        if (-1 == written) {
+            if (EINTR == errno) {
+                continue;
+            }
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to write to '" << m_filename << "': " << ::strerror(errno) << std::endl;
+            return false;
+        }
+        // Advance over partially written vectors.
+        std::size_t remaining{static_cast<std::size_t>(written)};
+        while ((0 < count) && (remaining >= current->iov_len)) {
+            remaining -= current->iov_len;
+            current++;
+            count--;
+        }
+        if (0 < count) {
+            current->iov_base = static_cast<char*>(current->iov_base) + remaining;
+            current->iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
+void RecFile::datasync() noexcept {
+    if (0 != ::fdatasync(m_fd)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to fdatasync '" << m_filename << "': " << ::strerror(errno) << std::endl;
+    }
+    m_pendingFdatasync = false;
+    m_lastFdatasync = std::chrono::steady_clock::now();
+}
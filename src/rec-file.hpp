@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REC_FILE_HPP
+#define REC_FILE_HPP
+
+#include "recording-file.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * This class provides batched writing to a .rec file through the page cache.
+ * Data is collected in a buffer that is written with a single syscall once it
+ * exceeds a byte threshold or a time interval has passed; optionally, the
+ * written data is periodically committed to the storage device using fdatasync.
+ */
+class RecFile : public RecordingFile {
+   private:
+    RecFile(const RecFile &) = delete;
+    RecFile(RecFile &&)      = delete;
+    RecFile &operator=(const RecFile &) = delete;
+    RecFile &operator=(RecFile &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param filename Name of the file to create; an existing file is truncated.
+     * @param flushBytes Amount of buffered bytes that triggers a write; 0 writes every call immediately.
+     * @param flushIntervalMs Maximum time in milliseconds that data stays buffered; 0 disables the time limit.
+     * @param fdatasyncIntervalMs Interval in milliseconds to call fdatasync; 0 disables fdatasync.
+     */
+    RecFile(const std::string &filename, uint32_t flushBytes, uint32_t flushIntervalMs, uint32_t fdatasyncIntervalMs) noexcept;
+    ~RecFile() override;
+
+    bool good() const noexcept override;
+    void write(const char *data, std::size_t size) noexcept override;
+    void flush() noexcept override;
+    void flushIfDue() noexcept override;
+    void sync() noexcept override;
+    void close() noexcept override;
+    void preallocate(uint64_t size) noexcept override;
+    uint64_t size() const noexcept override;
+
+   private:
+    bool writeFully(const char *data, std::size_t size) noexcept;
+    bool writeFully(const char *data1, std::size_t size1, const char *data2, std::size_t size2) noexcept;
+    void datasync() noexcept;
+
+   private:
+    std::string m_filename;
+    int m_fd{-1};
+    bool m_good{false};
+
+    uint32_t m_flushBytes;
+    std::chrono::milliseconds m_flushInterval;
+    std::chrono::milliseconds m_fdatasyncInterval;
+    std::chrono::steady_clock::time_point m_lastFlush{};
+    std::chrono::steady_clock::time_point m_lastFdatasync{};
+    bool m_pendingFdatasync{false};
+
+    std::vector<char> m_buffer{};
+    uint64_t m_size{0};
+    uint64_t m_preallocated{0};
+};
+
+#endif
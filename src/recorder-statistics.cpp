@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recorder-statistics.hpp"
+#include "opendlv-standard-message-set.hpp"
+
+#include <iostream>
+#include <sstream>
+
+CameraCounters CameraCounters::operator-(const CameraCounters &other) const noexcept {
+    CameraCounters retVal;
+    retVal.frames = frames - other.frames;
+    retVal.skipped = skipped - other.skipped;
+    retVal.unchanged = unchanged - other.unchanged;
+    retVal.dropped = dropped - other.dropped;
+    retVal.missed = missed - other.missed;
+    retVal.gaps = gaps - other.gaps;
+    retVal.stalls = stalls - other.stalls;
+    retVal.bytes = bytes - other.bytes;
+    return retVal;
+}
+
+CameraCounters CameraStatistics::counters() const noexcept {
+    CameraCounters retVal;
+    retVal.frames = frames.load(std::memory_order_relaxed);
+    retVal.skipped = skipped.load(std::memory_order_relaxed);
+    retVal.unchanged = unchanged.load(std::memory_order_relaxed);
+    retVal.dropped = dropped.load(std::memory_order_relaxed);
+    retVal.missed = missed.load(std::memory_order_relaxed);
+    retVal.gaps = gaps.load(std::memory_order_relaxed);
+    retVal.stalls = stalls.load(std::memory_order_relaxed);
+    retVal.bytes = bytes.load(std::memory_order_relaxed);
+    return retVal;
+}
+
+StatisticsReporter::StatisticsReporter(const std::vector<CameraStatistics*> &statistics, const RecordingWriter &recordingWriter, cluon::OD4Session *od4, uint32_t intervalInSeconds) noexcept
+    : m_statistics(statistics)
+    , m_lastCounters(statistics.size())
+    , m_recordingWriter(recordingWriter)
+    , m_od4(od4)
+    , m_interval(intervalInSeconds) {
+    m_thread = std::thread(&StatisticsReporter::run, this);
+}
+
+StatisticsReporter::~StatisticsReporter() {
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_running = false;
+    }
+    m_stopped.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    report();
+}
+
+void StatisticsReporter::run() noexcept {
+    std::unique_lock<std::mutex> lck(m_mutex);
+    while (m_running) {
+        if (!m_stopped.wait_for(lck, m_interval, [this]{ return !m_running; })) {
+            report();
+        }
+    }
+}
+
+void StatisticsReporter::report() noexcept {
+    auto append = [](std::stringstream &sstr, const char *stage, LatencyHistogram &histogram){
+        const LatencyHistogram::Summary SUMMARY{histogram.takeSummary()};
+        sstr << " " << stage << "=" << SUMMARY.p50 << "/" << SUMMARY.p99 << "/" << SUMMARY.p999 << "/" << SUMMARY.max;
+    };
+
+    for (std::size_t i{0}; i < m_statistics.size(); i++) {
+        CameraStatistics *statistics{m_statistics[i]};
+        const CameraCounters COUNTERS{statistics->counters()};
+        const CameraCounters INTERVAL{COUNTERS - m_lastCounters[i]};
+        m_lastCounters[i] = COUNTERS;
+
+        std::stringstream sstr;
+        sstr << "frames=" << INTERVAL.frames
+             << " skipped=" << INTERVAL.skipped
+             << " unchanged=" << INTERVAL.unchanged
+             << " dropped=" << INTERVAL.dropped
+             << " missed=" << INTERVAL.missed
+             << " gaps=" << INTERVAL.gaps
+             << " stalls=" << INTERVAL.stalls
+             << " queued=" << m_recordingWriter.queued(statistics->producer)
+             << "; latencies in microseconds (p50/p99/p99.9/max):";
+        append(sstr, "wait", statistics->wait);
+        append(sstr, "lock", statistics->lockHold);
+        append(sstr, "encode", statistics->encode);
+        append(sstr, "serialize", statistics->serialize);
+        append(sstr, "write", statistics->write);
+
+        const std::string SUMMARY{sstr.str()};
+        std::clog << "[opendlv-video-h264-recorder]: Statistics for '" << statistics->name << "': " << SUMMARY << std::endl;
+        if ((nullptr != m_od4) && m_od4->isRunning()) {
+            opendlv::system::SignalStatusMessage msg;
+            msg.code(0).description(SUMMARY);
+            m_od4->send(msg, cluon::time::now(), statistics->senderStamp);
+        }
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDER_STATISTICS_HPP
+#define RECORDER_STATISTICS_HPP
+
+#include "cluon-complete.hpp"
+#include "latency-histogram.hpp"
+#include "recording-writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * This struct is a snapshot of the counters of one camera.
+ */
+struct CameraCounters {
+    uint64_t frames{0};
+    uint64_t skipped{0};
+    uint64_t unchanged{0};
+    uint64_t dropped{0};
+    uint64_t missed{0};
+    uint64_t gaps{0};
+    uint64_t stalls{0};
+    uint64_t bytes{0};
+
+    CameraCounters operator-(const CameraCounters &other) const noexcept;
+};
+
+/**
+ * This struct collects the per-stage latencies and counters of one camera;
+ * it is updated by the camera's encoding thread without locking. The
+ * counters are totals since the start so that they can be read by more
+ * than one reporter.
+ */
+struct CameraStatistics {
+    CameraStatistics(const std::string &cameraName, uint32_t cameraSenderStamp, std::size_t cameraProducer) noexcept
+        : name(cameraName)
+        , senderStamp(cameraSenderStamp)
+        , producer(cameraProducer) {}
+
+    const std::string name;
+    const uint32_t senderStamp;
+    const std::size_t producer;
+
+    LatencyHistogram wait{};       // Waiting for a notification from the shared memory.
+    LatencyHistogram lockHold{};   // Holding the shared memory's lock.
+    LatencyHistogram encode{};
+    LatencyHistogram serialize{};
+    LatencyHistogram write{};      // Handing the Envelope to the RecordingWriter.
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> skipped{0}; // Frames skipped by the encoder or for lack of a frame buffer.
+    std::atomic<uint64_t> unchanged{0}; // Frames not encoded as the scene did not change.
+    std::atomic<uint64_t> dropped{0}; // Frames dropped by the RecordingWriter.
+    std::atomic<uint64_t> missed{0};  // Frames sent by the producer while this camera was busy with earlier frames.
+    std::atomic<uint64_t> gaps{0};    // Frames missing in the producer's time stamps while this camera was waiting.
+    std::atomic<uint64_t> stalls{0};  // Timeouts without a new frame.
+    std::atomic<uint64_t> bytes{0};   // Bytes of encoded frames.
+
+    /**
+     * @return Current values of the counters.
+     */
+    CameraCounters counters() const noexcept;
+};
+
+/**
+ * This class periodically emits a summary of the CameraStatistics to
+ * std::clog and, if available, as SignalStatusMessage to an OD4Session.
+ */
+class StatisticsReporter {
+   private:
+    StatisticsReporter(const StatisticsReporter &) = delete;
+    StatisticsReporter(StatisticsReporter &&)      = delete;
+    StatisticsReporter &operator=(const StatisticsReporter &) = delete;
+    StatisticsReporter &operator=(StatisticsReporter &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param statistics Statistics of the cameras to report.
+     * @param recordingWriter Writer to report the queue depths of.
+     * @param od4 OD4Session to send summaries to; nullptr to only log them.
+     * @param intervalInSeconds Interval between two summaries.
+     */
+    StatisticsReporter(const std::vector<CameraStatistics*> &statistics, const RecordingWriter &recordingWriter, cluon::OD4Session *od4, uint32_t intervalInSeconds) noexcept;
+
+    /**
+     * Destructor; emits a last summary.
+     */
+    ~StatisticsReporter();
+
+   private:
+    void run() noexcept;
+    void report() noexcept;
+
+   private:
+    std::vector<CameraStatistics*> m_statistics;
+    std::vector<CameraCounters> m_lastCounters;
+    const RecordingWriter &m_recordingWriter;
+    cluon::OD4Session *m_od4;
+    std::chrono::seconds m_interval;
+
+    std::mutex m_mutex{};
+    std::condition_variable m_stopped{};
+    bool m_running{true};
+    std::thread m_thread{};
+};
+
+#endif
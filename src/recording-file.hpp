@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDING_FILE_HPP
+#define RECORDING_FILE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * This interface describes an append-only .rec file with batched writes.
+ * Implementations are not thread-safe.
+ */
+class RecordingFile {
+   public:
+    virtual ~RecordingFile() = default;
+
+    /**
+     * @return True if the file is open and no write error occurred.
+     */
+    virtual bool good() const noexcept = 0;
+
+    /**
+     * This method appends data to the file.
+     *
+     * @param data Pointer to the data to write.
+     * @param size Number of bytes to write.
+     */
+    virtual void write(const char *data, std::size_t size) noexcept = 0;
+
+    /**
+     * This method writes all buffered data to the file.
+     */
+    virtual void flush() noexcept = 0;
+
+    /**
+     * This method writes buffered data and commits it when their respective intervals have passed.
+     */
+    virtual void flushIfDue() noexcept = 0;
+
+    /**
+     * This method writes all buffered data and commits it to the storage
+     * device using fdatasync regardless of the configured interval.
+     */
+    virtual void sync() noexcept = 0;
+
+    /**
+     * This method flushes buffered data, commits it, and closes the file.
+     */
+    virtual void close() noexcept = 0;
+
+    /**
+     * This method reserves disk space for the file without changing its size
+     * so that later writes do not need to allocate blocks; failures are ignored.
+     *
+     * @param size Number of bytes to reserve from the beginning of the file.
+     */
+    virtual void preallocate(uint64_t size) noexcept = 0;
+
+    /**
+     * @return Number of bytes appended to the file so far including buffered data.
+     */
+    virtual uint64_t size() const noexcept = 0;
+};
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recording-index.hpp"
+
+namespace {
+// Index entries are tiny; collect them for up to a second to keep syscalls rare.
+const uint32_t INDEX_FLUSH_BYTES{64 * 1024};
+const uint32_t INDEX_FLUSH_INTERVAL_MS{1000};
+
+void putLittleEndian(char *out, uint64_t value, std::size_t size) noexcept {
+    for (std::size_t i{0}; i < size; i++) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+}
+
+constexpr std::size_t RecordingIndex::ENTRY_SIZE;
+
+RecordingIndex::RecordingIndex(const std::string &filename, uint32_t fdatasyncIntervalMs) noexcept
+    : m_file(filename, INDEX_FLUSH_BYTES, INDEX_FLUSH_INTERVAL_MS, fdatasyncIntervalMs) {
+    const char MAGIC[]{"RECIDX01"};
+    m_file.write(MAGIC, sizeof(MAGIC) - 1);
+}
+
+bool RecordingIndex::good() const noexcept {
+    return m_file.good();
+}
+
+void RecordingIndex::append(const IndexEntry &entry) noexcept {
+    char buffer[ENTRY_SIZE]{};
+    putLittleEndian(buffer, static_cast<uint64_t>(entry.sampleTimeStamp), 8);
+    putLittleEndian(buffer + 8, entry.offset, 8);
+    putLittleEndian(buffer + 16, static_cast<uint32_t>(entry.dataType), 4);
+    putLittleEndian(buffer + 20, entry.senderStamp, 4);
+    buffer[24] = static_cast<char>((entry.keyFrame ? 1 : 0) | (entry.chunk ? 2 : 0));
+    m_file.write(buffer, sizeof(buffer));
+}
+
+void RecordingIndex::flushIfDue() noexcept {
+    m_file.flushIfDue();
+}
+
+void RecordingIndex::sync() noexcept {
+    m_file.sync();
+}
+
+void RecordingIndex::close() noexcept {
+    m_file.close();
+}
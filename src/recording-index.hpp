@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDING_INDEX_HPP
+#define RECORDING_INDEX_HPP
+
+#include "rec-file.hpp"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * This struct describes one Envelope in the recording file.
+ */
+struct IndexEntry {
+    int64_t sampleTimeStamp{0}; // Microseconds since epoch.
+    uint64_t offset{0};         // Position of the Envelope's header in the recording file.
+    int32_t dataType{0};
+    uint32_t senderStamp{0};
+    bool keyFrame{false};       // True for h264 IDR frames.
+    bool chunk{false};          // True for compressed chunks of Envelopes; senderStamp is the number of Envelopes.
+};
+
+/**
+ * This class writes a sidecar seek index for a recording file so that tools
+ * can seek to a time stamp or key frame without scanning the recording.
+ *
+ * The file starts with the 8 bytes "RECIDX01" followed by one 32 bytes
+ * entry per Envelope in the order of the recording file; all fields are
+ * little endian:
+ *   int64  sampleTimeStamp in microseconds,
+ *   uint64 offset of the Envelope in the recording file,
+ *   int32  dataType,
+ *   uint32 senderStamp,
+ *   uint8  flags (bit 0: key frame, bit 1: compressed chunk of Envelopes),
+ *   7 bytes reserved (0).
+ * A reader must ignore entries beyond the end of the recording file.
+ */
+class RecordingIndex {
+   private:
+    RecordingIndex(const RecordingIndex &) = delete;
+    RecordingIndex(RecordingIndex &&)      = delete;
+    RecordingIndex &operator=(const RecordingIndex &) = delete;
+    RecordingIndex &operator=(RecordingIndex &&) = delete;
+
+   public:
+    static constexpr std::size_t ENTRY_SIZE{32};
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param filename Name of the index file to create; an existing file is truncated.
+     * @param fdatasyncIntervalMs Interval in milliseconds to call fdatasync; 0 disables fdatasync.
+     */
+    RecordingIndex(const std::string &filename, uint32_t fdatasyncIntervalMs) noexcept;
+
+    bool good() const noexcept;
+
+    /**
+     * This method adds an entry; the index is written in batches.
+     *
+     * @param entry Entry to add.
+     */
+    void append(const IndexEntry &entry) noexcept;
+
+    /**
+     * This method writes out batched entries if their time limit has passed.
+     */
+    void flushIfDue() noexcept;
+
+    /**
+     * This method writes out batched entries and commits them using fdatasync.
+     */
+    void sync() noexcept;
+
+    void close() noexcept;
+
+   private:
+    RecFile m_file;
+};
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recording-segments.hpp"
+
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+uint64_t freeSpace(const std::string &directory) noexcept {
+    struct statvfs fs;
+    return (0 == ::statvfs(directory.c_str(), &fs)) ? static_cast<uint64_t>(fs.f_bavail) * fs.f_frsize : 0;
+}
+}
+
+RecordingSegments::RecordingSegments(const std::string &filename, const std::vector<std::string> &directories, uint64_t splitSize, std::chrono::seconds splitDuration, bool splitBySampleTime, bool writeIndex, uint32_t fdatasyncIntervalMs, FileFactory fileFactory) noexcept
+    : m_filename(filename)
+    , m_directories(directories)
+    , m_splitSize(splitSize)
+    , m_splitDuration(splitDuration)
+    , m_splitBySampleTime(splitBySampleTime)
+    , m_writeIndex(writeIndex)
+    , m_fdatasyncIntervalMs(fdatasyncIntervalMs)
+    , m_fileFactory(fileFactory) {
+    if (!m_directories.empty()) {
+        m_segmentList.open(m_filename + ".segments", std::ios::out | std::ios::trunc);
+        if (!m_segmentList.good()) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to create list of segments '" << m_filename << ".segments'." << std::endl;
+        }
+    }
+    m_current = openSegment(placeSegment(splitting() ? segmentName(0) : m_filename));
+    m_currentStart = std::chrono::steady_clock::now();
+    if (good()) {
+        listSegment(m_current->filename);
+    }
+    if (splitting()) {
+        m_running = true;
+        m_thread = std::thread(&RecordingSegments::run, this);
+    }
+}
+
+RecordingSegments::~RecordingSegments() {
+    close();
+}
+
+bool RecordingSegments::good() const noexcept {
+    return m_current && m_current->file && m_current->file->good();
+}
+
+RecordingFile &RecordingSegments::file() noexcept {
+    return *(m_current->file);
+}
+
+RecordingIndex *RecordingSegments::index() noexcept {
+    return m_current->index.get();
+}
+
+bool RecordingSegments::due(int64_t sampleTimeStamp) noexcept {
+    if ((0 < m_splitSize) && (m_current->file->size() >= m_splitSize)) {
+        return true;
+    }
+    if (0 == m_splitDuration.count()) {
+        return false;
+    }
+    if (m_splitBySampleTime) {
+        // The Envelope given just before rotate is the first one of the next segment.
+        m_lastSample = sampleTimeStamp;
+        if (0 == m_currentStartSample) {
+            m_currentStartSample = sampleTimeStamp;
+        }
+        return sampleTimeStamp - m_currentStartSample >= std::chrono::duration_cast<std::chrono::microseconds>(m_splitDuration).count();
+    }
+    return std::chrono::steady_clock::now() - m_currentStart >= m_splitDuration;
+}
+
+bool RecordingSegments::rotate() noexcept {
+    if (!splitting()) {
+        return false;
+    }
+
+    std::unique_ptr<Segment> next{nullptr};
+    {
+        // The next segment is usually ready; only wait if the previous switch was very recent.
+        std::unique_lock<std::mutex> lck(m_mutex);
+        m_condition.wait(lck, [this]{ return nullptr != m_next; });
+        next = std::move(m_next);
+    }
+    const bool RETVAL{next->file && next->file->good()};
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        if (RETVAL) {
+            m_finished.push_back(std::move(m_current));
+            m_current = std::move(next);
+            m_currentStart = std::chrono::steady_clock::now();
+            m_currentStartSample = m_lastSample;
+        }
+        else {
+            m_finished.push_back(std::move(next));
+        }
+        m_nextNumber++;
+    }
+    m_condition.notify_all();
+
+    if (RETVAL) {
+        listSegment(m_current->filename);
+        std::clog << "[opendlv-video-h264-recorder]: Continuing recording in '" << m_current->filename << "'." << std::endl;
+    }
+    return RETVAL;
+}
+
+void RecordingSegments::sync() noexcept {
+    if (m_current) {
+        if (m_current->file) {
+            m_current->file->sync();
+        }
+        if (m_current->index) {
+            m_current->index->sync();
+        }
+    }
+}
+
+void RecordingSegments::close() noexcept {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lck(m_mutex);
+            m_running = false;
+        }
+        m_condition.notify_all();
+        m_thread.join();
+    }
+    if (m_next) {
+        // Remove the unused, prepared segment.
+        closeSegment(*m_next);
+        ::unlink(m_next->filename.c_str());
+        if (m_next->index) {
+            ::unlink((m_next->filename + ".idx").c_str());
+        }
+        m_next.reset(nullptr);
+    }
+    if (m_current) {
+        closeSegment(*m_current);
+    }
+    if (m_segmentList.is_open()) {
+        m_segmentList.close();
+    }
+}
+
+std::unique_ptr<RecordingSegments::Segment> RecordingSegments::openSegment(const std::string &filename) noexcept {
+    std::unique_ptr<Segment> segment{new Segment};
+    segment->filename = filename;
+    segment->file = m_fileFactory(filename);
+    if (!segment->file || !segment->file->good()) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to open '" << filename << "'." << std::endl;
+        return segment;
+    }
+    if (0 < m_splitSize) {
+        segment->file->preallocate(m_splitSize);
+    }
+    if (m_writeIndex) {
+        segment->index.reset(new RecordingIndex(filename + ".idx", m_fdatasyncIntervalMs));
+        if (!segment->index->good()) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to create seek index '" << filename << ".idx'; recording without index." << std::endl;
+            segment->index.reset(nullptr);
+        }
+    }
+    return segment;
+}
+
+void RecordingSegments::closeSegment(Segment &segment) noexcept {
+    if (segment.file) {
+        segment.file->close();
+    }
+    if (segment.index) {
+        segment.index->close();
+    }
+}
+
+std::string RecordingSegments::segmentName(uint32_t number) const noexcept {
+    // Insert the segment number before the extension, i.e., MyFile.rec becomes MyFile-0001.rec.
+    const std::size_t SLASH{m_filename.find_last_of('/')};
+    std::size_t dot{m_filename.find_last_of('.')};
+    if ((std::string::npos == dot) || ((std::string::npos != SLASH) && (dot < SLASH))) {
+        dot = m_filename.size();
+    }
+    std::stringstream sstr;
+    sstr << m_filename.substr(0, dot) << "-" << std::setw(4) << std::setfill('0') << number << m_filename.substr(dot);
+    return sstr.str();
+}
+
+std::string RecordingSegments::placeSegment(const std::string &filename) noexcept {
+    if (m_directories.empty()) {
+        return filename;
+    }
+
+    // Take turns between the directories but skip those without room for a full segment;
+    // if none has enough room, use the one with the most free space.
+    const uint64_t NEEDED{(0 < m_splitSize) ? m_splitSize : FREE_SPACE_MIN};
+    std::size_t directory{m_nextDirectory % m_directories.size()};
+    uint64_t mostFreeSpace{0};
+    for (std::size_t i{0}; i < m_directories.size(); i++) {
+        const std::size_t CANDIDATE{(m_nextDirectory + i) % m_directories.size()};
+        const uint64_t FREE_SPACE{freeSpace(m_directories[CANDIDATE])};
+        if (NEEDED <= FREE_SPACE) {
+            directory = CANDIDATE;
+            break;
+        }
+        if (mostFreeSpace < FREE_SPACE) {
+            directory = CANDIDATE;
+            mostFreeSpace = FREE_SPACE;
+        }
+    }
+    m_nextDirectory = directory + 1;
+
+    const std::size_t SLASH{filename.find_last_of('/')};
+    const std::string BASENAME{(std::string::npos == SLASH) ? filename : filename.substr(SLASH + 1)};
+    std::string path{m_directories[directory]};
+    if (!path.empty() && ('/' != path.back())) {
+        path += '/';
+    }
+    return path + BASENAME;
+}
+
+void RecordingSegments::listSegment(const std::string &filename) noexcept {
+    if (m_segmentList.is_open()) {
+        m_segmentList << filename << std::endl;
+    }
+}
+
+bool RecordingSegments::splitting() const noexcept {
+    return (0 < m_splitSize) || (0 < m_splitDuration.count());
+}
+
+void RecordingSegments::run() noexcept {
+    std::unique_lock<std::mutex> lck(m_mutex);
+    while (m_running || !m_finished.empty()) {
+        if (m_running && !m_next) {
+            const uint32_t NUMBER{m_nextNumber};
+            lck.unlock();
+            std::unique_ptr<Segment> next{openSegment(placeSegment(segmentName(NUMBER)))};
+            lck.lock();
+            m_next = std::move(next);
+            m_condition.notify_all();
+        }
+        if (!m_finished.empty()) {
+            std::vector<std::unique_ptr<Segment>> finished;
+            finished.swap(m_finished);
+            lck.unlock();
+            for (auto &segment : finished) {
+                // Closing commits the data, which may take a while on slow disks.
+                closeSegment(*segment);
+            }
+            lck.lock();
+            continue;
+        }
+        m_condition.wait(lck, [this]{ return !m_running || !m_next || !m_finished.empty(); });
+    }
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDING_SEGMENTS_HPP
+#define RECORDING_SEGMENTS_HPP
+
+#include "recording-file.hpp"
+#include "recording-index.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * This class manages the recording file and its seek index. When splitting
+ * by size or duration is enabled, the recording is written to numbered
+ * segments (e.g., MyFile-0000.rec, MyFile-0001.rec, ...); a background
+ * thread opens and preallocates the next segment ahead of time and closes
+ * finished segments so that switching segments does not block the caller.
+ *
+ * The methods of this class are not thread-safe and must be serialized by
+ * the caller.
+ *
+ * Given several directories, e.g., on different disks, each segment is
+ * placed in the next directory with room for a full segment so that one
+ * segment is written while the previous one is committed to another disk;
+ * the order of the segments is kept in a list next to the given filename.
+ */
+class RecordingSegments {
+   private:
+    RecordingSegments(const RecordingSegments &) = delete;
+    RecordingSegments(RecordingSegments &&)      = delete;
+    RecordingSegments &operator=(const RecordingSegments &) = delete;
+    RecordingSegments &operator=(RecordingSegments &&) = delete;
+
+   public:
+    using FileFactory = std::function<std::unique_ptr<RecordingFile>(const std::string &filename)>;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param filename Name of the recording file; the base name for segments when splitting.
+     * @param directories Directories to place the recording file or its segments in, using the file name part of filename; empty to use filename as it is.
+     * @param splitSize Size in bytes after which to continue in a new segment; 0 to not split by size.
+     * @param splitDuration Duration after which to continue in a new segment; 0 to not split by duration.
+     * @param splitBySampleTime True to measure splitDuration by the sample time stamps of the Envelopes instead of the time passed, e.g., when transcoding.
+     * @param writeIndex True to write a seek index next to each segment.
+     * @param fdatasyncIntervalMs Interval in milliseconds to call fdatasync on the index; 0 disables fdatasync.
+     * @param fileFactory Function to create a RecordingFile for a given filename.
+     */
+    RecordingSegments(const std::string &filename, const std::vector<std::string> &directories, uint64_t splitSize, std::chrono::seconds splitDuration, bool splitBySampleTime, bool writeIndex, uint32_t fdatasyncIntervalMs, FileFactory fileFactory) noexcept;
+    ~RecordingSegments();
+
+    /**
+     * @return True if the current segment is open and no write error occurred.
+     */
+    bool good() const noexcept;
+
+    /**
+     * @return Recording file of the current segment.
+     */
+    RecordingFile &file() noexcept;
+
+    /**
+     * @return Seek index of the current segment; nullptr if no index is written.
+     */
+    RecordingIndex *index() noexcept;
+
+    /**
+     * @param sampleTimeStamp Sample time stamp in microseconds of the Envelope to append next.
+     * @return True if the current segment has reached its size or duration.
+     */
+    bool due(int64_t sampleTimeStamp) noexcept;
+
+    /**
+     * This method continues the recording in the next segment.
+     *
+     * @return True if the next segment was opened successfully.
+     */
+    bool rotate() noexcept;
+
+    /**
+     * This method commits the current segment and its seek index using fdatasync.
+     */
+    void sync() noexcept;
+
+    /**
+     * This method closes the current segment and waits for all finished segments to be closed.
+     */
+    void close() noexcept;
+
+   public:
+    static constexpr uint64_t FREE_SPACE_MIN{64 * 1024 * 1024}; // Room needed in a directory for a segment without --split-size.
+
+   private:
+    struct Segment {
+        std::string filename{};
+        std::unique_ptr<RecordingFile> file{nullptr};
+        std::unique_ptr<RecordingIndex> index{nullptr};
+    };
+
+    std::unique_ptr<Segment> openSegment(const std::string &filename) noexcept;
+    static void closeSegment(Segment &segment) noexcept;
+    std::string segmentName(uint32_t number) const noexcept;
+    std::string placeSegment(const std::string &filename) noexcept;
+    void listSegment(const std::string &filename) noexcept;
+    bool splitting() const noexcept;
+    void run() noexcept;
+
+   private:
+    std::string m_filename;
+    std::vector<std::string> m_directories;
+    std::size_t m_nextDirectory{0};
+    std::ofstream m_segmentList{};
+    uint64_t m_splitSize;
+    std::chrono::seconds m_splitDuration;
+    bool m_splitBySampleTime;
+    bool m_writeIndex;
+    uint32_t m_fdatasyncIntervalMs;
+    FileFactory m_fileFactory;
+
+    std::unique_ptr<Segment> m_current{nullptr};
+    std::chrono::steady_clock::time_point m_currentStart{};
+    int64_t m_currentStartSample{0};
+    int64_t m_lastSample{0};
+    uint32_t m_nextNumber{1};
+
+    std::mutex m_mutex{};
+    std::condition_variable m_condition{};
+    bool m_running{false};
+    std::unique_ptr<Segment> m_next{nullptr};
+    std::vector<std::unique_ptr<Segment>> m_finished{};
+    std::thread m_thread{};
+};
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recording-transcoder.hpp"
+
+#include "envelope-serializer.hpp"
+#include "frame-converter.hpp"
+
+#include <wels/codec_api.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+namespace {
+// Looks for an IDR slice (NAL unit type 5) in an h264 Annex B byte stream.
+bool containsIdrSlice(const std::string &data) noexcept {
+    for (std::size_t i{2}; i + 1 < data.size(); i++) {
+        if ((0 == data[i - 2]) && (0 == data[i - 1]) && (1 == data[i]) && (5 == (static_cast<uint8_t>(data[i + 1]) & 0x1F))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Provides the lowercase fourcc of an ImageReading and whether it can be re-encoded.
+bool transcodable(const opendlv::proxy::ImageReading &image, std::string &fourcc) noexcept {
+    fourcc = image.fourcc();
+    std::transform(fourcc.begin(), fourcc.end(), fourcc.begin(), [](unsigned char c){ return static_cast<char>(std::tolower(c)); });
+    PixelFormat format{PixelFormat::I420};
+    return ("h264" == fourcc) || parsePixelFormat(fourcc, format);
+}
+}
+
+RecordingTranscoder::RecordingTranscoder(const EncoderSettings &settings, const CameraRecorder::EncoderFactory &encoderFactory, uint32_t layerIdOffset, uint32_t framesPerChunk, uint32_t numberOfThreads, RecordingWriter &recordingWriter) noexcept
+    : m_settings(settings)
+    , m_encoderFactory(encoderFactory)
+    , m_layerIdOffset(layerIdOffset)
+    , m_framesPerChunk(std::max(framesPerChunk, 1u))
+    , m_maxChunksInFlight(2 * std::max(numberOfThreads, 1u))
+    , m_recordingWriter(recordingWriter) {
+    for (uint32_t i{0}; i < std::max(numberOfThreads, 1u); i++) {
+        m_threads.emplace_back(&RecordingTranscoder::run, this);
+    }
+}
+
+RecordingTranscoder::~RecordingTranscoder() {
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_running = false;
+    }
+    m_chunkAvailable.notify_all();
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+bool RecordingTranscoder::transcode(const std::string &recFile) noexcept {
+    std::fstream in(recFile, std::ios::in | std::ios::binary);
+    if (!in.good()) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to open '" << recFile << "'." << std::endl;
+        return false;
+    }
+
+    if (!m_settings.layers.empty() && !checkSenderStamps(in)) {
+        return false;
+    }
+
+    const auto START{std::chrono::steady_clock::now()};
+    while (in.good() && !cluon::TerminateHandler::instance().isTerminated.load()) {
+        auto e{cluon::extractEnvelope(in)};
+        if (!e.first) {
+            continue;
+        }
+
+        PendingEnvelope pending;
+        if (opendlv::proxy::ImageReading::ID() == e.second.dataType()) {
+            InputFrame frame;
+            frame.image = cluon::extractMessage<opendlv::proxy::ImageReading>(cluon::data::Envelope{e.second});
+            frame.sent = e.second.sent();
+            frame.sampleTimeStamp = e.second.sampleTimeStamp();
+            std::string fourcc;
+            if (transcodable(frame.image, fourcc)) {
+                const bool H264{"h264" == fourcc};
+                const uint32_t SENDER_STAMP{static_cast<uint32_t>(e.second.senderStamp())};
+                auto open = std::find_if(m_openChunks.begin(), m_openChunks.end(), [SENDER_STAMP](const std::shared_ptr<Chunk> &chunk){ return SENDER_STAMP == chunk->senderStamp; });
+                std::shared_ptr<Chunk> chunk{(m_openChunks.end() != open) ? *open : nullptr};
+                // h264 needs to be decoded from an IDR frame on; raw frames can be cut anywhere.
+                const bool CUT{!H264 || containsIdrSlice(frame.image.data())};
+                if (chunk && ((fourcc != chunk->fourcc) || ((m_framesPerChunk <= chunk->frames.size()) && CUT))) {
+                    submit(chunk);
+                    chunk.reset();
+                }
+                m_frames++;
+                if (!chunk && !CUT) {
+                    m_skippedFrames++;
+                    continue;
+                }
+                if (!chunk) {
+                    chunk = std::make_shared<Chunk>();
+                    chunk->senderStamp = SENDER_STAMP;
+                    chunk->fourcc = fourcc;
+                    m_openChunks.push_back(chunk);
+                }
+                pending.chunk = chunk;
+                pending.frame = chunk->frames.size();
+                chunk->frames.push_back(std::move(frame));
+            }
+        }
+        if (!pending.chunk) {
+            pending.envelope = std::move(e.second);
+            m_passedThrough++;
+        }
+        m_pending.push_back(std::move(pending));
+        writePending(false);
+    }
+    const bool RETVAL{!cluon::TerminateHandler::instance().isTerminated.load()};
+
+    while (!m_openChunks.empty()) {
+        submit(m_openChunks.front());
+    }
+    writePending(true);
+
+    const int64_t DURATION{std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - START).count()};
+    std::clog << "[opendlv-video-h264-recorder]: Transcoded " << m_encodedFrames.load() << " of " << m_frames.load() << " frames in " << m_numberOfChunks << " chunks and passed through " << m_passedThrough << " Envelopes in " << DURATION << " ms." << std::endl;
+    return RETVAL;
+}
+
+bool RecordingTranscoder::checkSenderStamps(std::fstream &in) noexcept {
+    std::set<uint32_t> inputs;
+    std::set<uint32_t> transcoded;
+    while (in.good()) {
+        auto e{cluon::extractEnvelope(in)};
+        if (e.first && (opendlv::proxy::ImageReading::ID() == e.second.dataType())) {
+            const uint32_t SENDER_STAMP{static_cast<uint32_t>(e.second.senderStamp())};
+            inputs.insert(SENDER_STAMP);
+            std::string fourcc;
+            if ((0 == transcoded.count(SENDER_STAMP)) && transcodable(cluon::extractMessage<opendlv::proxy::ImageReading>(std::move(e.second)), fourcc)) {
+                transcoded.insert(SENDER_STAMP);
+            }
+        }
+    }
+    in.clear();
+    in.seekg(0);
+
+    // The downscaled layers must neither replace streams of the input nor each other.
+    std::set<uint32_t> outputs{inputs};
+    for (const uint32_t SENDER_STAMP : transcoded) {
+        for (std::size_t j{1}; j <= m_settings.layers.size(); j++) {
+            const uint32_t LAYER_STAMP{SENDER_STAMP + static_cast<uint32_t>(j) * m_layerIdOffset};
+            if (!outputs.insert(LAYER_STAMP).second) {
+                std::cerr << "[opendlv-video-h264-recorder]: Layer " << j << " of senderStamp " << SENDER_STAMP << " would be written as senderStamp " << LAYER_STAMP << ", which " << ((0 < inputs.count(LAYER_STAMP)) ? "the input recording contains already" : "another layer uses already") << "; choose a different --layer-id-offset or transcode without --layers." << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void RecordingTranscoder::submit(std::shared_ptr<Chunk> chunk) noexcept {
+    chunk->submitted = true;
+    chunk->outputs.resize(chunk->frames.size());
+    m_openChunks.erase(std::remove(m_openChunks.begin(), m_openChunks.end(), chunk), m_openChunks.end());
+    m_chunksInFlight++;
+    m_numberOfChunks++;
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_chunks.push_back(chunk);
+    }
+    m_chunkAvailable.notify_one();
+}
+
+void RecordingTranscoder::writePending(bool wait) noexcept {
+    while (!m_pending.empty()) {
+        PendingEnvelope &pending = m_pending.front();
+        if (!pending.chunk) {
+            m_recordingWriter.push(std::move(pending.envelope));
+            m_pending.pop_front();
+            continue;
+        }
+
+        // Only wait for the oldest chunk when enough chunks are being encoded already.
+        const bool BLOCK{wait || (m_maxChunksInFlight <= m_chunksInFlight)};
+        if (!pending.chunk->submitted) {
+            if (!BLOCK) {
+                break;
+            }
+            // A stream with few frames would hold up all others until its chunk is full.
+            submit(pending.chunk);
+        }
+        {
+            std::unique_lock<std::mutex> lck(m_mutex);
+            if (!pending.chunk->done && !BLOCK) {
+                break;
+            }
+            m_chunkDone.wait(lck, [&pending]{ return pending.chunk->done; });
+        }
+
+        for (const auto &output : pending.chunk->outputs[pending.frame]) {
+            m_recordingWriter.write(output.serializedEnvelope, output.entry);
+        }
+        std::vector<OutputEnvelope>().swap(pending.chunk->outputs[pending.frame]);
+        if (pending.chunk->frames.size() == pending.frame + 1) {
+            m_chunksInFlight--;
+        }
+        m_pending.pop_front();
+    }
+}
+
+void RecordingTranscoder::encode(Chunk &chunk) noexcept {
+    const std::string FOURCC{"h264"};
+    const bool H264{FOURCC == chunk.fourcc};
+    PixelFormat format{PixelFormat::I420};
+    parsePixelFormat(chunk.fourcc, format);
+
+    // Each chunk gets its own encoder, which runs at the frame rate of the chunk's time stamps.
+    float fps{m_settings.fps};
+    if (1 < chunk.frames.size()) {
+        const int64_t DURATION{cluon::time::deltaInMicroseconds(chunk.frames.back().sampleTimeStamp, chunk.frames.front().sampleTimeStamp)};
+        if (0 < DURATION) {
+            fps = static_cast<float>(chunk.frames.size() - 1) * 1000.0f * 1000.0f / static_cast<float>(DURATION);
+        }
+    }
+
+    ISVCDecoder *decoder{nullptr};
+    if (H264) {
+        if ((0 != WelsCreateDecoder(&decoder)) || (nullptr == decoder)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to create openh264 decoder." << std::endl;
+            m_skippedFrames += chunk.frames.size();
+            return;
+        }
+        SDecodingParam decodingParameters;
+        memset(&decodingParameters, 0, sizeof(SDecodingParam));
+        decodingParameters.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_DEFAULT;
+        decoder->Initialize(&decodingParameters);
+    }
+
+    std::unique_ptr<FrameConverter> frameConverter{nullptr};
+    std::vector<uint8_t> i420;
+    std::unique_ptr<VideoEncoder> encoder{nullptr};
+    std::vector<EncodedLayer> layers;
+    for (std::size_t i{0}; i < chunk.frames.size(); i++) {
+        InputFrame &frame = chunk.frames[i];
+        const std::string &DATA{frame.image.data()};
+        I420Picture picture;
+        uint32_t width{frame.image.width()};
+        uint32_t height{frame.image.height()};
+        if (H264) {
+            unsigned char *yuv[3]{nullptr, nullptr, nullptr};
+            SBufferInfo bufferInfo;
+            memset(&bufferInfo, 0, sizeof(SBufferInfo));
+            if ((0 != decoder->DecodeFrameNoDelay(reinterpret_cast<const unsigned char*>(DATA.data()), static_cast<int>(DATA.size()), yuv, &bufferInfo)) || (1 != bufferInfo.iBufferStatus)) {
+                m_skippedFrames++;
+                continue;
+            }
+            width = static_cast<uint32_t>(bufferInfo.UsrData.sSystemBuffer.iWidth);
+            height = static_cast<uint32_t>(bufferInfo.UsrData.sSystemBuffer.iHeight);
+            picture.y = yuv[0];
+            picture.u = yuv[1];
+            picture.v = yuv[2];
+            picture.strideY = static_cast<uint32_t>(bufferInfo.UsrData.sSystemBuffer.iStride[0]);
+            picture.strideUV = static_cast<uint32_t>(bufferInfo.UsrData.sSystemBuffer.iStride[1]);
+        }
+        else {
+            if (!frameConverter || (width != frameConverter->layout().width) || (height != frameConverter->layout().height)) {
+                FrameLayout layout;
+                layout.format = format;
+                layout.width = width;
+                layout.height = height;
+                frameConverter.reset(new FrameConverter(layout));
+                i420.resize(frameConverter->needsConversion() ? frameConverter->i420Size() : 0);
+            }
+            const bool ODD{(0 != (width % 2)) || (0 != (height % 2))};
+            if (!frameConverter->valid() || (frameConverter->needsConversion() && ODD) || (DATA.size() < frameConverter->sourceSize())) {
+                m_skippedFrames++;
+                continue;
+            }
+            const uint8_t *src{reinterpret_cast<const uint8_t*>(DATA.data())};
+            if (frameConverter->needsConversion()) {
+                frameConverter->toI420(src, i420.data());
+                picture = frameConverter->packedPicture(i420.data());
+            }
+            else {
+                picture = frameConverter->picture(src);
+            }
+        }
+
+        if (!encoder || (width != encoder->width()) || (height != encoder->height())) {
+            encoder = m_encoderFactory(m_settings, width, height);
+            if (!encoder->valid()) {
+                std::cerr << "[opendlv-video-h264-recorder]: Failed to create encoder for " << width << "x" << height << "." << std::endl;
+                encoder.reset(nullptr);
+                m_skippedFrames++;
+                continue;
+            }
+            encoder->setFrameRate(fps);
+        }
+        bool isKeyFrame{false};
+        const std::size_t TOTAL_SIZE{encoder->encode(picture, layers, isKeyFrame)};
+        if (0 == TOTAL_SIZE) {
+            m_skippedFrames++;
+            continue;
+        }
+
+        for (std::size_t j{0}; j < layers.size(); j++) {
+            const EncodedLayer &LAYER = layers[j];
+            if (0 == LAYER.size) {
+                continue;
+            }
+            OutputEnvelope output;
+            output.entry.sampleTimeStamp = cluon::time::toMicroseconds(frame.sampleTimeStamp);
+            output.entry.dataType = opendlv::proxy::ImageReading::ID();
+            output.entry.senderStamp = chunk.senderStamp + static_cast<uint32_t>(j) * m_layerIdOffset;
+            output.entry.keyFrame = isKeyFrame;
+            if (!serializeImageReadingEnvelope(output.serializedEnvelope, FOURCC, LAYER.width, LAYER.height, LAYER.chunks.data(), LAYER.chunks.size(), frame.sent, frame.sampleTimeStamp, output.entry.senderStamp)) {
+                std::cerr << "[opendlv-video-h264-recorder]: Warning, frame of " << LAYER.size << " bytes exceeds maximum Envelope size; dropping frame." << std::endl;
+                continue;
+            }
+            chunk.outputs[i].push_back(std::move(output));
+        }
+        m_encodedFrames++;
+        // The input frame is not needed anymore.
+        frame.image = opendlv::proxy::ImageReading();
+    }
+
+    if (nullptr != decoder) {
+        decoder->Uninitialize();
+        WelsDestroyDecoder(decoder);
+    }
+}
+
+void RecordingTranscoder::run() noexcept {
+    std::unique_lock<std::mutex> lck(m_mutex);
+    while (true) {
+        m_chunkAvailable.wait(lck, [this]{ return !m_running || !m_chunks.empty(); });
+        if (m_chunks.empty()) {
+            break;
+        }
+        std::shared_ptr<Chunk> chunk{m_chunks.front()};
+        m_chunks.pop_front();
+        lck.unlock();
+        encode(*chunk);
+        lck.lock();
+        chunk->done = true;
+        m_chunkDone.notify_all();
+    }
+}
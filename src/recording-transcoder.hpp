@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDING_TRANSCODER_HPP
+#define RECORDING_TRANSCODER_HPP
+
+#include "camera-recorder.hpp"
+#include "cluon-complete.hpp"
+#include "opendlv-standard-message-set.hpp"
+#include "recording-index.hpp"
+#include "recording-writer.hpp"
+#include "video-encoder.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * This class re-encodes the frames of an existing recording file, e.g., to
+ * archive it at a lower bitrate. ImageReadings in a raw pixel format (i420,
+ * nv12, yuyv, rgb, bgr) or in h264 are cut per senderStamp into chunks of
+ * consecutive frames; h264 chunks start at an IDR frame so that each chunk
+ * can be decoded on its own. The chunks are decoded and encoded with a new
+ * encoder each on a pool of threads, and the results are written in the
+ * order of the input file, interleaved with all other Envelopes, which are
+ * passed through unchanged.
+ */
+class RecordingTranscoder {
+   private:
+    RecordingTranscoder(const RecordingTranscoder &) = delete;
+    RecordingTranscoder(RecordingTranscoder &&)      = delete;
+    RecordingTranscoder &operator=(const RecordingTranscoder &) = delete;
+    RecordingTranscoder &operator=(RecordingTranscoder &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param settings Encoder settings; the frame rate is taken from the time stamps of each chunk.
+     * @param encoderFactory Function to create an encoder for a given geometry.
+     * @param layerIdOffset Downscaled layer i is written with senderStamp + i * layerIdOffset.
+     * @param framesPerChunk Minimum number of frames to encode with one encoder.
+     * @param numberOfThreads Number of threads encoding chunks in parallel.
+     * @param recordingWriter Writer to write the transcoded recording to synchronously.
+     */
+    RecordingTranscoder(const EncoderSettings &settings, const CameraRecorder::EncoderFactory &encoderFactory, uint32_t layerIdOffset, uint32_t framesPerChunk, uint32_t numberOfThreads, RecordingWriter &recordingWriter) noexcept;
+    ~RecordingTranscoder();
+
+    /**
+     * This method transcodes a recording file until its end or a termination signal.
+     *
+     * @param recFile Name of the recording file to read.
+     * @return True if the recording file was read completely.
+     */
+    bool transcode(const std::string &recFile) noexcept;
+
+   private:
+    struct InputFrame {
+        opendlv::proxy::ImageReading image{};
+        cluon::data::TimeStamp sent{};
+        cluon::data::TimeStamp sampleTimeStamp{};
+    };
+
+    struct OutputEnvelope {
+        std::string serializedEnvelope{};
+        IndexEntry entry{};
+    };
+
+    struct Chunk {
+        uint32_t senderStamp{0};
+        std::string fourcc{};
+        std::vector<InputFrame> frames{};
+        std::vector<std::vector<OutputEnvelope>> outputs{}; // Encoded layers per input frame.
+        bool submitted{false};
+        bool done{false};
+    };
+
+    struct PendingEnvelope {
+        std::shared_ptr<Chunk> chunk{nullptr}; // nullptr to pass the Envelope through.
+        std::size_t frame{0};
+        cluon::data::Envelope envelope{};
+    };
+
+    bool checkSenderStamps(std::fstream &in) noexcept;
+    void submit(std::shared_ptr<Chunk> chunk) noexcept;
+    void writePending(bool wait) noexcept;
+    void encode(Chunk &chunk) noexcept;
+    void run() noexcept;
+
+   private:
+    EncoderSettings m_settings;
+    CameraRecorder::EncoderFactory m_encoderFactory;
+    uint32_t m_layerIdOffset;
+    uint32_t m_framesPerChunk;
+    uint32_t m_maxChunksInFlight;
+    RecordingWriter &m_recordingWriter;
+
+    std::deque<PendingEnvelope> m_pending{}; // Envelopes in the order of the input file.
+    std::vector<std::shared_ptr<Chunk>> m_openChunks{}; // Chunks still collecting frames; one per stream at most.
+    uint32_t m_chunksInFlight{0};
+
+    std::mutex m_mutex{};
+    std::condition_variable m_chunkAvailable{};
+    std::condition_variable m_chunkDone{};
+    std::deque<std::shared_ptr<Chunk>> m_chunks{};
+    bool m_running{true};
+    std::vector<std::thread> m_threads{};
+
+    std::atomic<uint64_t> m_frames{0};
+    std::atomic<uint64_t> m_encodedFrames{0};
+    std::atomic<uint64_t> m_skippedFrames{0};
+    uint64_t m_numberOfChunks{0};
+    uint64_t m_passedThrough{0};
+};
+
+#endif
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recording-writer.hpp"
+#include "opendlv-standard-message-set.hpp"
+
+#include "envelope-serializer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace {
+// Upper bound for sleeping while waiting on the queue; notifications are sent without holding the queue's mutex.
+constexpr std::chrono::milliseconds QUEUE_WAIT_TIMEOUT{10};
+// Time to wait for the IDR frames of all cameras before continuing in the next segment, e.g., if a camera stalled.
+constexpr int64_t ROTATION_TIMEOUT{1000 * 1000};
+
+int64_t steadyMicroseconds() noexcept {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+RecordingWriter::RecordingWriter(RecordingSegments &segments, std::mutex &recFileMutex, EventBuffer *eventBuffer, EnvelopeChunker *chunker, uint32_t numberOfProducers, uint32_t queueDepth, QueuePolicy policy, uint32_t envelopeQueueDepth, bool writeWhenIdle) noexcept
+    : m_segments(segments)
+    , m_recFileMutex(recFileMutex)
+    , m_eventBuffer(eventBuffer)
+    , m_chunker(chunker)
+    , m_policy(policy) {
+    for (uint32_t i{0}; i < numberOfProducers; i++) {
+        // One buffer is being filled, one is being written, and the others are queued.
+        m_buffers.emplace_back(new BufferPool(queueDepth + 2));
+    }
+    if (0 < queueDepth) {
+        for (uint32_t i{0}; i < numberOfProducers; i++) {
+            m_queues.emplace_back(new SPSCQueue<QueuedEnvelope>(queueDepth));
+        }
+    }
+    if (0 < envelopeQueueDepth) {
+        m_envelopes.reset(new SPSCQueue<cluon::data::Envelope>(envelopeQueueDepth));
+    }
+    if (!m_queues.empty() || m_envelopes || writeWhenIdle) {
+        m_running.store(true);
+        m_writerThread = std::thread(&RecordingWriter::run, this);
+    }
+}
+
+RecordingWriter::~RecordingWriter() {
+    stop();
+}
+
+std::string RecordingWriter::buffer(std::size_t producer) noexcept {
+    return m_buffers.empty() ? std::string() : m_buffers[producer % m_buffers.size()]->acquire();
+}
+
+bool RecordingWriter::push(std::size_t producer, std::string &&serializedEnvelope, const IndexEntry &entry) noexcept {
+    if (m_queues.empty()) {
+        write(serializedEnvelope, entry);
+        recycle(producer, serializedEnvelope);
+        return true;
+    }
+
+    auto &queue = m_queues[producer % m_queues.size()];
+    QueuedEnvelope queuedEnvelope{std::move(serializedEnvelope), entry};
+    bool retVal{queue->push(std::move(queuedEnvelope))};
+    while (!retVal && (QueuePolicy::BLOCK == m_policy) && m_running.load()) {
+        {
+            std::unique_lock<std::mutex> lck(m_queueMutex);
+            m_queueNotFull.wait_for(lck, QUEUE_WAIT_TIMEOUT);
+        }
+        retVal = queue->push(std::move(queuedEnvelope));
+    }
+    if (retVal) {
+        m_queueNotEmpty.notify_one();
+    }
+    else {
+        m_dropped++;
+    }
+    return retVal;
+}
+
+bool RecordingWriter::push(cluon::data::Envelope &&envelope) noexcept {
+    if (!m_envelopes) {
+        write(envelope);
+        return true;
+    }
+
+    const bool retVal{m_envelopes->push(std::move(envelope))};
+    if (retVal) {
+        m_queueNotEmpty.notify_one();
+    }
+    else {
+        m_droppedEnvelopes++;
+    }
+    return retVal;
+}
+
+void RecordingWriter::write(cluon::data::Envelope &envelope) noexcept {
+    if (!serializeEnvelope(m_serializedEnvelope, envelope)) {
+        m_droppedEnvelopes++;
+        return;
+    }
+    IndexEntry entry;
+    entry.sampleTimeStamp = cluon::time::toMicroseconds(envelope.sampleTimeStamp());
+    entry.dataType = envelope.dataType();
+    entry.senderStamp = envelope.senderStamp();
+    write(m_serializedEnvelope, entry);
+}
+
+void RecordingWriter::write(const std::string &serializedEnvelope, const IndexEntry &entry) noexcept {
+    std::lock_guard<std::mutex> lck(m_recFileMutex);
+    if (nullptr != m_eventBuffer) {
+        const int64_t NOW{steadyMicroseconds()};
+        if (m_eventBuffer->isTrigger(entry)) {
+            const bool WAS_RECORDING{m_eventBuffer->recording(NOW)};
+            const std::size_t BUFFERED{m_eventBuffer->trigger(NOW, [this](const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &bufferedEntry){
+                append(data1, size1, data2, size2, bufferedEntry);
+            })};
+            if (!WAS_RECORDING) {
+                // Cameras without a buffered key frame become decodable with their next IDR frame.
+                m_keyFrameRequests++;
+                std::clog << "[opendlv-video-h264-recorder]: Triggered by " << entry.dataType << "/" << entry.senderStamp << "; wrote " << BUFFERED << " buffered Envelopes." << std::endl;
+            }
+        }
+        else if (!m_eventBuffer->recording(NOW)) {
+            m_eventBuffer->store(serializedEnvelope, entry, NOW);
+            return;
+        }
+    }
+    append(serializedEnvelope.data(), serializedEnvelope.size(), nullptr, 0, entry);
+}
+
+void RecordingWriter::append(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry) noexcept {
+    if ((nullptr != m_chunker) && (opendlv::proxy::ImageReading::ID() != entry.dataType)) {
+        const int64_t NOW{steadyMicroseconds()};
+        m_chunker->add(data1, size1, data2, size2, entry, NOW);
+        if (m_chunker->due(NOW)) {
+            appendChunk();
+        }
+        return;
+    }
+
+    appendOrHold(data1, size1, data2, size2, entry);
+}
+
+void RecordingWriter::appendOrHold(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry) noexcept {
+    const bool VIDEO{opendlv::proxy::ImageReading::ID() == entry.dataType};
+    const int64_t NOW{VIDEO ? steadyMicroseconds() : 0};
+    if (VIDEO) {
+        auto stream = std::find_if(m_videoStreams.begin(), m_videoStreams.end(), [&entry](const VideoStream &videoStream){ return videoStream.senderStamp == entry.senderStamp; });
+        if (m_videoStreams.end() != stream) {
+            stream->lastSeen = NOW;
+        }
+        else if (entry.keyFrame) {
+            // Only streams from the encoders have key frames; they respond to requests for an IDR frame.
+            m_videoStreams.push_back(VideoStream{entry.senderStamp, NOW});
+        }
+    }
+
+    if (m_segments.due(entry.sampleTimeStamp) && !m_rotationPending) {
+        // Ask the encoders for an IDR frame; the next segment starts once every camera has delivered one.
+        m_rotationPending = true;
+        m_keyFrameRequests++;
+        m_rotatedStreams.clear();
+    }
+    if (m_rotationPending) {
+        if (VIDEO && entry.keyFrame && !rotated(entry.senderStamp)) {
+            m_rotatedStreams.push_back(entry.senderStamp);
+        }
+        // Frames of cameras still waiting for their IDR frame complete the current segment; all else after the first IDR frame is held back.
+        if (VIDEO ? rotated(entry.senderStamp) : !m_held.empty()) {
+            if (m_held.empty()) {
+                // Envelopes collected so far precede the first IDR frame; later chunks are held back with the frames.
+                IndexEntry chunkEntry;
+                if ((nullptr != m_chunker) && m_chunker->take(m_serializedChunk, chunkEntry)) {
+                    appendToFile(m_serializedChunk.data(), m_serializedChunk.size(), nullptr, 0, chunkEntry);
+                }
+                m_holdStart = steadyMicroseconds();
+            }
+            HeldEnvelope held;
+            if ((nullptr != m_pooledEnvelope) && (m_pooledEnvelope->data() == data1) && (m_pooledEnvelope->size() == size1) && (0 == size2)) {
+                // Frames from the queues keep their buffer, which goes back to its producer once written.
+                held.serializedEnvelope = std::move(*m_pooledEnvelope);
+                held.producer = m_pooledProducer;
+                held.pooled = true;
+                m_pooledEnvelope = nullptr;
+            }
+            else {
+                held.serializedEnvelope.reserve(size1 + size2);
+                held.serializedEnvelope.append(data1, size1);
+                if (0 < size2) {
+                    held.serializedEnvelope.append(data2, size2);
+                }
+            }
+            held.entry = entry;
+            m_held.push_back(std::move(held));
+            rotateIfComplete();
+            return;
+        }
+    }
+    appendToFile(data1, size1, data2, size2, entry);
+}
+
+bool RecordingWriter::rotated(uint32_t senderStamp) const noexcept {
+    return m_rotatedStreams.end() != std::find(m_rotatedStreams.begin(), m_rotatedStreams.end(), senderStamp);
+}
+
+void RecordingWriter::rotateIfComplete() noexcept {
+    if (!m_rotationPending || m_held.empty()) {
+        return;
+    }
+    // Streams that ended, e.g., of a stalled camera, are not waited for.
+    const bool ALL_ROTATED{std::all_of(m_videoStreams.begin(), m_videoStreams.end(), [this](const VideoStream &videoStream){ return (m_holdStart - videoStream.lastSeen > ROTATION_TIMEOUT) || rotated(videoStream.senderStamp); })};
+    if (ALL_ROTATED || (steadyMicroseconds() - m_holdStart > ROTATION_TIMEOUT)) {
+        // Should the next segment fail to open, the recording continues in the current one.
+        m_segments.rotate();
+        m_rotationPending = false;
+        appendHeld();
+    }
+}
+
+void RecordingWriter::appendHeld() noexcept {
+    for (auto &held : m_held) {
+        appendToFile(held.serializedEnvelope.data(), held.serializedEnvelope.size(), nullptr, 0, held.entry);
+        if (held.pooled) {
+            recycle(held.producer, held.serializedEnvelope);
+        }
+    }
+    m_held.clear();
+}
+
+void RecordingWriter::appendChunk() noexcept {
+    IndexEntry entry;
+    if ((nullptr != m_chunker) && m_chunker->take(m_serializedChunk, entry)) {
+        appendOrHold(m_serializedChunk.data(), m_serializedChunk.size(), nullptr, 0, entry);
+    }
+}
+
+void RecordingWriter::appendToFile(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry) noexcept {
+    RecordingFile &recFile{m_segments.file()};
+    RecordingIndex *recIndex{m_segments.index()};
+    if (nullptr != recIndex) {
+        IndexEntry indexEntry{entry};
+        indexEntry.offset = recFile.size();
+        recIndex->append(indexEntry);
+        m_bytesWritten.fetch_add(RecordingIndex::ENTRY_SIZE, std::memory_order_relaxed);
+    }
+    recFile.write(data1, size1);
+    if (0 < size2) {
+        recFile.write(data2, size2);
+    }
+    m_bytesWritten.fetch_add(size1 + size2, std::memory_order_relaxed);
+}
+
+bool RecordingWriter::schedule(const ThreadScheduling &scheduling) noexcept {
+    return m_writerThread.joinable() && applyThreadScheduling(m_writerThread.native_handle(), scheduling, "writer thread");
+}
+
+void RecordingWriter::stop() noexcept {
+    stop(std::chrono::steady_clock::time_point::max());
+}
+
+void RecordingWriter::stop(std::chrono::steady_clock::time_point deadline) noexcept {
+    if (std::chrono::steady_clock::time_point::max() != deadline) {
+        m_deadline.store(std::chrono::duration_cast<std::chrono::microseconds>(deadline.time_since_epoch()).count());
+    }
+    if (m_running.exchange(false)) {
+        m_queueNotEmpty.notify_one();
+    }
+    if (m_writerThread.joinable()) {
+        m_writerThread.join();
+    }
+    {
+        // Envelopes held back for the next segment are written to the current one.
+        std::lock_guard<std::mutex> lck(m_recFileMutex);
+        appendHeld();
+        if ((nullptr != m_chunker) && !m_chunker->empty()) {
+            appendChunk();
+        }
+    }
+}
+
+void RecordingWriter::recycle(std::size_t producer, std::string &serializedEnvelope) noexcept {
+    if (!m_buffers.empty()) {
+        m_buffers[producer % m_buffers.size()]->release(std::move(serializedEnvelope));
+    }
+}
+
+uint64_t RecordingWriter::dropped() const noexcept {
+    return m_dropped.load();
+}
+
+uint64_t RecordingWriter::droppedEnvelopes() const noexcept {
+    return m_droppedEnvelopes.load();
+}
+
+uint64_t RecordingWriter::bytesWritten() const noexcept {
+    return m_bytesWritten.load(std::memory_order_relaxed);
+}
+
+std::size_t RecordingWriter::queued() const noexcept {
+    std::size_t retVal{0};
+    for (const auto &queue : m_queues) {
+        retVal += queue->size();
+    }
+    return retVal;
+}
+
+uint32_t RecordingWriter::keyFrameRequests() const noexcept {
+    return m_keyFrameRequests.load();
+}
+
+std::size_t RecordingWriter::queued(std::size_t producer) const noexcept {
+    return m_queues.empty() ? 0 : m_queues[producer % m_queues.size()]->size();
+}
+
+std::size_t RecordingWriter::queueDepth() const noexcept {
+    return m_queues.empty() ? 0 : m_queues.front()->capacity();
+}
+
+void RecordingWriter::run() noexcept {
+    auto allEmpty = [this]() {
+        for (const auto &queue : m_queues) {
+            if (!queue->empty()) {
+                return false;
+            }
+        }
+        return !m_envelopes || m_envelopes->empty();
+    };
+
+    QueuedEnvelope queuedEnvelope;
+    cluon::data::Envelope envelope;
+    while (m_running.load() || (!allEmpty() && (steadyMicroseconds() < m_deadline.load()))) {
+        // Take one frame from each queue in turn to not starve any camera.
+        bool wroteAny{false};
+        for (std::size_t i{0}; i < m_queues.size(); i++) {
+            if (m_queues[i]->pop(queuedEnvelope)) {
+                m_queueNotFull.notify_all();
+                // Only this thread hands buffers back to the producers, so frames held for the next segment may keep theirs.
+                m_pooledEnvelope = &queuedEnvelope.serializedEnvelope;
+                m_pooledProducer = i;
+                write(queuedEnvelope.serializedEnvelope, queuedEnvelope.entry);
+                if (nullptr != m_pooledEnvelope) {
+                    recycle(i, queuedEnvelope.serializedEnvelope);
+                }
+                m_pooledEnvelope = nullptr;
+                wroteAny = true;
+            }
+        }
+        // Envelopes from the OD4Session are small but may arrive at high rates; write what has queued up so far.
+        for (std::size_t i{m_envelopes ? m_envelopes->size() : 0}; (0 < i) && m_envelopes->pop(envelope); i--) {
+            write(envelope);
+            wroteAny = true;
+        }
+        if (!wroteAny) {
+            {
+                // Write out batched data once its time limit has passed even if no new frames arrive.
+                std::lock_guard<std::mutex> lck(m_recFileMutex);
+                if ((nullptr != m_chunker) && m_chunker->due(steadyMicroseconds())) {
+                    appendChunk();
+                }
+                // Complete a segment rotation also when the cameras that still held it up stopped delivering frames.
+                rotateIfComplete();
+                m_segments.file().flushIfDue();
+                if (nullptr != m_segments.index()) {
+                    m_segments.index()->flushIfDue();
+                }
+            }
+            std::unique_lock<std::mutex> lck(m_queueMutex);
+            m_queueNotEmpty.wait_for(lck, QUEUE_WAIT_TIMEOUT, [this, &allEmpty]{ return !m_running.load() || !allEmpty(); });
+        }
+    }
+
+    // Frames still queued after the deadline are lost.
+    for (std::size_t i{0}; i < m_queues.size(); i++) {
+        while (m_queues[i]->pop(queuedEnvelope)) {
+            recycle(i, queuedEnvelope.serializedEnvelope);
+            m_dropped++;
+        }
+    }
+    while (m_envelopes && m_envelopes->pop(envelope)) {
+        m_droppedEnvelopes++;
+    }
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDING_WRITER_HPP
+#define RECORDING_WRITER_HPP
+
+#include "buffer-pool.hpp"
+#include "cluon-complete.hpp"
+#include "envelope-chunker.hpp"
+#include "event-buffer.hpp"
+#include "recording-index.hpp"
+#include "recording-segments.hpp"
+#include "spsc-queue.hpp"
+#include "thread-scheduling.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * This class writes serialized Envelopes to the recording file. Encoded
+ * frames are handed over through one bounded queue per encoding thread to a
+ * dedicated writer thread so that disk stalls do not delay the encoders;
+ * Envelopes from the OD4Session are queued as they are and serialized by
+ * the writer thread so that the receiving thread is not held up.
+ */
+class RecordingWriter {
+   private:
+    RecordingWriter(const RecordingWriter &) = delete;
+    RecordingWriter(RecordingWriter &&)      = delete;
+    RecordingWriter &operator=(const RecordingWriter &) = delete;
+    RecordingWriter &operator=(RecordingWriter &&) = delete;
+
+   public:
+    enum class QueuePolicy {
+        DROP,  // Discard a frame when the queue is full.
+        BLOCK, // Wait until a slot in the queue becomes available.
+    };
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param segments Recording file and seek index to write to.
+     * @param recFileMutex Mutex protecting segments.
+     * @param eventBuffer Ring to keep Envelopes in until a trigger arrives; nullptr to record everything.
+     * @param chunker Chunker to compress all Envelopes but ImageReadings with; nullptr to write them as they are.
+     * @param numberOfProducers Number of encoding threads, each with its own queue.
+     * @param queueDepth Number of frames to buffer per encoding thread; 0 writes synchronously.
+     * @param policy Behavior when a queue is full.
+     * @param envelopeQueueDepth Number of Envelopes from the OD4Session to buffer for the writer thread; 0 writes them synchronously.
+     * @param writeWhenIdle True to run the writer thread also without queues so that time limits for batched data are kept while no data arrive.
+     */
+    RecordingWriter(RecordingSegments &segments, std::mutex &recFileMutex, EventBuffer *eventBuffer, EnvelopeChunker *chunker, uint32_t numberOfProducers, uint32_t queueDepth, QueuePolicy policy, uint32_t envelopeQueueDepth, bool writeWhenIdle) noexcept;
+    ~RecordingWriter();
+
+    /**
+     * This method provides the buffer to serialize the next Envelope with an
+     * encoded frame into; it is recycled by the thread writing the Envelope.
+     *
+     * @param producer Index of the encoding thread's queue.
+     * @return Empty buffer.
+     */
+    std::string buffer(std::size_t producer) noexcept;
+
+    /**
+     * This method hands over a serialized Envelope with an encoded frame;
+     * each producer must only be used from one encoding thread.
+     *
+     * @param producer Index of the encoding thread's queue.
+     * @param serializedEnvelope Serialized Envelope to write.
+     * @param entry Index entry describing the Envelope; its offset is set when writing.
+     * @return true if the data was written or queued; false if it was dropped.
+     */
+    bool push(std::size_t producer, std::string &&serializedEnvelope, const IndexEntry &entry) noexcept;
+
+    /**
+     * This method hands over an Envelope received from the OD4Session; it
+     * must only be called from one thread. The Envelope is written
+     * synchronously if there is no writer thread.
+     *
+     * @param envelope Envelope to write.
+     * @return true if the Envelope was written or queued; false if it was dropped.
+     */
+    bool push(cluon::data::Envelope &&envelope) noexcept;
+
+    /**
+     * This method writes a serialized Envelope synchronously; it can be called from any thread.
+     *
+     * @param serializedEnvelope Serialized Envelope to write.
+     * @param entry Index entry describing the Envelope; its offset is set when writing.
+     */
+    void write(const std::string &serializedEnvelope, const IndexEntry &entry) noexcept;
+
+    /**
+     * This method restricts the writer thread to CPU cores and sets its priority.
+     *
+     * @param scheduling Cores and priority.
+     * @return true if there is a writer thread and all settings could be applied.
+     */
+    bool schedule(const ThreadScheduling &scheduling) noexcept;
+
+    /**
+     * This method writes all queued frames and stops the writer thread.
+     */
+    void stop() noexcept;
+
+    /**
+     * This method writes queued frames until the deadline has passed,
+     * discards the remaining ones, and stops the writer thread.
+     *
+     * @param deadline Time until which to write queued frames.
+     */
+    void stop(std::chrono::steady_clock::time_point deadline) noexcept;
+
+    /**
+     * @return Number of frames dropped because the queue was full or the deadline to stop had passed.
+     */
+    uint64_t dropped() const noexcept;
+
+    /**
+     * @return Number of Envelopes from the OD4Session dropped because their queue was full or the deadline to stop had passed.
+     */
+    uint64_t droppedEnvelopes() const noexcept;
+
+    /**
+     * @return Number of bytes written to the recording files, including the seek index.
+     */
+    uint64_t bytesWritten() const noexcept;
+
+    /**
+     * @return Number of frames currently waiting to be written.
+     */
+    std::size_t queued() const noexcept;
+
+    /**
+     * @param producer Index of the encoding thread's queue.
+     * @return Number of frames from this producer currently waiting to be written.
+     */
+    std::size_t queued(std::size_t producer) const noexcept;
+
+    /**
+     * @return Number of frames that can be queued per producer; 0 if frames are written synchronously.
+     */
+    std::size_t queueDepth() const noexcept;
+
+    /**
+     * This counter is incremented when the recording is about to continue in
+     * a new segment; encoding threads shall then force an IDR frame so that
+     * the new segment starts with a key frame of each camera. Until all have
+     * arrived, the frames following an IDR frame are held back.
+     *
+     * @return Number of key frame requests so far.
+     */
+    uint32_t keyFrameRequests() const noexcept;
+
+   private:
+    struct QueuedEnvelope {
+        std::string serializedEnvelope{};
+        IndexEntry entry{};
+    };
+
+    struct HeldEnvelope {
+        std::string serializedEnvelope{};
+        IndexEntry entry{};
+        std::size_t producer{0};
+        bool pooled{false}; // The buffer is handed back to the producer once written.
+    };
+
+    struct VideoStream {
+        uint32_t senderStamp{0};
+        int64_t lastSeen{0}; // Steady microseconds.
+    };
+
+    void run() noexcept;
+    void write(cluon::data::Envelope &envelope) noexcept;
+    void append(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry) noexcept;
+    void appendOrHold(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry) noexcept;
+    void appendToFile(const char *data1, std::size_t size1, const char *data2, std::size_t size2, const IndexEntry &entry) noexcept;
+    void appendChunk() noexcept;
+    void appendHeld() noexcept;
+    void rotateIfComplete() noexcept;
+    bool rotated(uint32_t senderStamp) const noexcept;
+    void recycle(std::size_t producer, std::string &serializedEnvelope) noexcept;
+
+   private:
+    RecordingSegments &m_segments;
+    std::mutex &m_recFileMutex;
+    EventBuffer *m_eventBuffer;
+    EnvelopeChunker *m_chunker;
+    std::string m_serializedChunk{};
+    bool m_rotationPending{false};
+    std::vector<VideoStream> m_videoStreams{};
+    std::vector<uint32_t> m_rotatedStreams{}; // Streams that delivered their IDR frame since the next segment was requested.
+    std::vector<HeldEnvelope> m_held{};        // Envelopes for the next segment until all streams delivered their IDR frame.
+    int64_t m_holdStart{0};
+    std::string *m_pooledEnvelope{nullptr}; // Frame being written by the writer thread; not owned.
+    std::size_t m_pooledProducer{0};
+    std::atomic<uint32_t> m_keyFrameRequests{0};
+    QueuePolicy m_policy;
+
+    std::vector<std::unique_ptr<SPSCQueue<QueuedEnvelope>>> m_queues{};
+    std::vector<std::unique_ptr<BufferPool>> m_buffers{};
+    std::unique_ptr<SPSCQueue<cluon::data::Envelope>> m_envelopes{nullptr};
+    std::string m_serializedEnvelope{}; // Reused by the thread serializing Envelopes from the OD4Session.
+    std::mutex m_queueMutex{};
+    std::condition_variable m_queueNotEmpty{};
+    std::condition_variable m_queueNotFull{};
+
+    std::atomic<bool> m_running{false};
+    std::atomic<int64_t> m_deadline{INT64_MAX}; // Until when to write queued frames after stopping; in steady microseconds.
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_droppedEnvelopes{0};
+    std::atomic<uint64_t> m_bytesWritten{0};
+    std::thread m_writerThread{};
+};
+
+#endif
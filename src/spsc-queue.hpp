@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * This class provides a bounded, lock-free queue for exactly one producer
+ * thread and exactly one consumer thread. Elements are moved in and out of
+ * preallocated slots; push fails when the queue is full.
+ */
+template <typename T>
+class SPSCQueue {
+   private:
+    SPSCQueue(const SPSCQueue &) = delete;
+    SPSCQueue(SPSCQueue &&)      = delete;
+    SPSCQueue &operator=(const SPSCQueue &) = delete;
+    SPSCQueue &operator=(SPSCQueue &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param capacity Maximum number of elements that can be queued.
+     */
+    explicit SPSCQueue(uint32_t capacity) noexcept
+        : m_slots(capacity + 1) {}
+
+    /**
+     * This method moves an element into the queue; to be called from the producer only.
+     *
+     * @param element Element to add.
+     * @return true if the element was added; false if the queue is full and element is left untouched.
+     */
+    bool push(T &&element) noexcept {
+        const std::size_t TAIL{m_tail.load(std::memory_order_relaxed)};
+        const std::size_t NEXT{increment(TAIL)};
+        if (NEXT == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        m_slots[TAIL] = std::move(element);
+        m_tail.store(NEXT, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * This method moves the oldest element out of the queue; to be called from the consumer only.
+     *
+     * @param element Element to move the queued element into.
+     * @return true if an element was retrieved; false if the queue is empty.
+     */
+    bool pop(T &element) noexcept {
+        const std::size_t HEAD{m_head.load(std::memory_order_relaxed)};
+        if (HEAD == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        element = std::move(m_slots[HEAD]);
+        m_head.store(increment(HEAD), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @return Number of currently queued elements (approximate when called concurrently).
+     */
+    std::size_t size() const noexcept {
+        const std::size_t HEAD{m_head.load(std::memory_order_acquire)};
+        const std::size_t TAIL{m_tail.load(std::memory_order_acquire)};
+        return (TAIL >= HEAD) ? (TAIL - HEAD) : (m_slots.size() - HEAD + TAIL);
+    }
+
+    bool empty() const noexcept {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const noexcept {
+        return m_slots.size() - 1;
+    }
+
+   private:
+    std::size_t increment(std::size_t index) const noexcept {
+        return (index + 1 == m_slots.size()) ? 0 : index + 1;
+    }
+
+   private:
+    std::vector<T> m_slots;
+    // Keep head and tail on separate cache lines to avoid false sharing between producer and consumer.
+    std::atomic<std::size_t> m_head{0};
+    char m_padding[64 - sizeof(std::atomic<std::size_t>)]{};
+    std::atomic<std::size_t> m_tail{0};
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "static-scene-filter.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+/**
+ * @return Sum of absolute differences of n bytes of a and b.
+ */
+uint64_t sad(const uint8_t *a, const uint8_t *b, uint32_t n) noexcept {
+    uint64_t retVal{0};
+    uint32_t i{0};
+#if defined(__SSE2__)
+    __m128i sum{_mm_setzero_si128()};
+    for (; i + 16 <= n; i += 16) {
+        const __m128i A{_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i))};
+        const __m128i B{_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))};
+        // Two partial sums of eight bytes each in the lower 16 bits of both 64 bit lanes.
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(A, B));
+    }
+    retVal = static_cast<uint64_t>(_mm_cvtsi128_si32(sum)) + static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+#elif defined(__ARM_NEON)
+    uint32x4_t sum{vdupq_n_u32(0)};
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t DIFFERENCE{vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i))};
+        sum = vpadalq_u16(sum, vpaddlq_u8(DIFFERENCE));
+    }
+    retVal = static_cast<uint64_t>(vgetq_lane_u32(sum, 0)) + vgetq_lane_u32(sum, 1) + vgetq_lane_u32(sum, 2) + vgetq_lane_u32(sum, 3);
+#endif
+    for (; i < n; i++) {
+        retVal += static_cast<uint64_t>(std::abs(static_cast<int32_t>(a[i]) - static_cast<int32_t>(b[i])));
+    }
+    return retVal;
+}
+
+} // namespace
+
+StaticSceneFilter::StaticSceneFilter(uint32_t width, uint32_t height, float threshold, int64_t keepAliveInMicroseconds) noexcept
+    : m_width(width)
+    , m_rows((height + ROW_STEP - 1) / ROW_STEP)
+    , m_threshold(threshold)
+    , m_keepAlive(keepAliveInMicroseconds) {
+    m_reference.resize(static_cast<std::size_t>(m_width) * m_rows);
+}
+
+bool StaticSceneFilter::keep(const uint8_t *y, uint32_t stride, int64_t sampleTimeStampInMicroseconds) noexcept {
+    bool retVal{!m_hasReference || (m_keepAlive <= sampleTimeStampInMicroseconds - m_lastKept) || (sampleTimeStampInMicroseconds < m_lastKept)};
+    if (!retVal) {
+        uint64_t sum{0};
+        for (uint32_t row{0}; row < m_rows; row++) {
+            sum += sad(y + static_cast<std::size_t>(row) * ROW_STEP * stride, m_reference.data() + static_cast<std::size_t>(row) * m_width, m_width);
+        }
+        m_difference = static_cast<float>(static_cast<double>(sum) / static_cast<double>(m_reference.size()));
+        retVal = (m_threshold <= m_difference);
+    }
+    if (retVal) {
+        for (uint32_t row{0}; row < m_rows; row++) {
+            std::memcpy(m_reference.data() + static_cast<std::size_t>(row) * m_width, y + static_cast<std::size_t>(row) * ROW_STEP * stride, m_width);
+        }
+        m_hasReference = true;
+        m_lastKept = sampleTimeStampInMicroseconds;
+    }
+    return retVal;
+}
+
+float StaticSceneFilter::difference() const noexcept {
+    return m_difference;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATIC_SCENE_FILTER_HPP
+#define STATIC_SCENE_FILTER_HPP
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * This class suppresses frames that hardly differ from the last encoded
+ * frame, e.g., while the vehicle is parked. Every ROW_STEP-th row of the Y
+ * plane is compared to the same rows of the last encoded frame by the mean
+ * absolute difference (SAD with SSE2 on x86-64 and NEON on ARM); a frame is
+ * kept at least every keep-alive interval so that the recording continues.
+ */
+class StaticSceneFilter {
+   private:
+    StaticSceneFilter(const StaticSceneFilter &) = delete;
+    StaticSceneFilter(StaticSceneFilter &&)      = delete;
+    StaticSceneFilter &operator=(const StaticSceneFilter &) = delete;
+    StaticSceneFilter &operator=(StaticSceneFilter &&) = delete;
+
+   public:
+    static constexpr uint32_t ROW_STEP{8};
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param width Width of the Y plane.
+     * @param height Height of the Y plane.
+     * @param threshold Mean absolute difference per sampled pixel below which a frame is considered unchanged.
+     * @param keepAliveInMicroseconds Longest time between two kept frames.
+     */
+    StaticSceneFilter(uint32_t width, uint32_t height, float threshold, int64_t keepAliveInMicroseconds) noexcept;
+
+    /**
+     * This method compares a frame to the last kept frame; kept frames become
+     * the reference for the following frames.
+     *
+     * @param y Y plane of the frame.
+     * @param stride Bytes per row of the Y plane.
+     * @param sampleTimeStampInMicroseconds Sample time stamp of the frame.
+     * @return True if the frame shall be encoded.
+     */
+    bool keep(const uint8_t *y, uint32_t stride, int64_t sampleTimeStampInMicroseconds) noexcept;
+
+    /**
+     * @return Mean absolute difference of the last compared frame.
+     */
+    float difference() const noexcept;
+
+   private:
+    uint32_t m_width;
+    uint32_t m_rows;
+    float m_threshold;
+    int64_t m_keepAlive;
+    std::vector<uint8_t> m_reference{};
+    bool m_hasReference{false};
+    int64_t m_lastKept{0};
+    float m_difference{0.0f};
+};
+
+#endif
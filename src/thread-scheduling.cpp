@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread-scheduling.hpp"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+bool parseCores(const std::string &list, std::vector<int32_t> &cores) noexcept {
+    cores.clear();
+    std::stringstream sstr(list);
+    std::string range;
+    while (std::getline(sstr, range, '+')) {
+        char *end{nullptr};
+        const long FIRST{std::strtol(range.c_str(), &end, 10)};
+        long last{FIRST};
+        if ((range.c_str() != end) && ('-' == *end)) {
+            const char *begin{end + 1};
+            last = std::strtol(begin, &end, 10);
+            if (begin == end) {
+                return false;
+            }
+        }
+        if ((range.c_str() == end) || ('\0' != *end) || (0 > FIRST) || (FIRST > last) || (CPU_SETSIZE <= last)) {
+            return false;
+        }
+        for (long core{FIRST}; core <= last; core++) {
+            cores.push_back(static_cast<int32_t>(core));
+        }
+    }
+    return !cores.empty();
+}
+
+bool applyThreadScheduling(pthread_t thread, const ThreadScheduling &scheduling, const std::string &name) noexcept {
+    bool retVal{true};
+    if (!scheduling.cores.empty()) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (const int32_t core : scheduling.cores) {
+            CPU_SET(core, &cpuset);
+        }
+        const int result{::pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset)};
+        if (0 != result) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to pin " << name << " to cores";
+            for (const int32_t core : scheduling.cores) {
+                std::cerr << " " << core;
+            }
+            std::cerr << ": " << ::strerror(result) << std::endl;
+            retVal = false;
+        }
+    }
+    if (0 < scheduling.priority) {
+        struct sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = scheduling.priority;
+        const int result{::pthread_setschedparam(thread, SCHED_FIFO, &param)};
+        if (0 != result) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to schedule " << name << " with SCHED_FIFO priority " << scheduling.priority << ": " << ::strerror(result);
+            if (EPERM == result) {
+                std::cerr << " (requires CAP_SYS_NICE or a sufficient RLIMIT_RTPRIO, e.g., ulimit -r)";
+            }
+            std::cerr << std::endl;
+            retVal = false;
+        }
+    }
+    return retVal;
+}
+
+bool lockMemory() noexcept {
+    if (0 != ::mlockall(MCL_CURRENT)) {
+        const int error{errno};
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to lock memory: " << ::strerror(error);
+        struct rlimit limit;
+        if ((ENOMEM == error || EPERM == error) && (0 == ::getrlimit(RLIMIT_MEMLOCK, &limit))) {
+            std::cerr << " (RLIMIT_MEMLOCK is ";
+            if (RLIM_INFINITY == limit.rlim_cur) {
+                std::cerr << "unlimited";
+            }
+            else {
+                std::cerr << limit.rlim_cur / 1024 << " KiB";
+            }
+            std::cerr << "; requires CAP_IPC_LOCK or a higher limit, e.g., ulimit -l)";
+        }
+        std::cerr << std::endl;
+        return false;
+    }
+    return true;
+}
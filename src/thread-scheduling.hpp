@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREAD_SCHEDULING_HPP
+#define THREAD_SCHEDULING_HPP
+
+#include <pthread.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * This struct describes the CPU cores and the real-time priority for a thread.
+ */
+struct ThreadScheduling {
+    std::vector<int32_t> cores{}; // CPU cores the thread may run on; empty to not restrict.
+    int32_t priority{0};          // SCHED_FIFO priority from 1 to 99; 0 to keep the default scheduler.
+};
+
+/**
+ * This function parses a set of CPU cores given as single cores or ranges
+ * joined by '+', e.g., "2", "2-3", or "0+4-5".
+ *
+ * @param list Set of CPU cores.
+ * @param cores Parsed cores (output).
+ * @return true if list could be parsed.
+ */
+bool parseCores(const std::string &list, std::vector<int32_t> &cores) noexcept;
+
+/**
+ * This function restricts a thread to its CPU cores and enables SCHED_FIFO
+ * if a priority is given; failures are reported to std::cerr.
+ *
+ * @param thread Thread to schedule.
+ * @param scheduling Cores and priority.
+ * @param name Name of the thread to report failures with.
+ * @return true if all settings could be applied.
+ */
+bool applyThreadScheduling(pthread_t thread, const ThreadScheduling &scheduling, const std::string &name) noexcept;
+
+/**
+ * This function locks all pages currently mapped into the address space,
+ * including all preallocated buffers, into RAM; failures are reported to
+ * std::cerr.
+ *
+ * @return true if the memory could be locked.
+ */
+bool lockMemory() noexcept;
+
+#endif
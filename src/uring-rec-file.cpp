@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uring-rec-file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+    #include <linux/io_uring.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+    #define URING_REC_FILE_ENABLED
+#endif
+
+namespace {
+constexpr std::size_t MIN_BUFFER_SIZE{64 * 1024};
+constexpr uint64_t FDATASYNC_TAG{~static_cast<uint64_t>(0)};
+
+std::size_t roundUp(std::size_t v, std::size_t alignment) noexcept {
+    return (v + alignment - 1) & ~(alignment - 1);
+}
+}
+
+UringRecFile::UringRecFile(const std::string &filename, uint32_t flushBytes, uint32_t flushIntervalMs, uint32_t fdatasyncIntervalMs) noexcept
+    : m_filename(filename)
+    , m_bufferSize(roundUp(std::max(static_cast<std::size_t>(flushBytes), MIN_BUFFER_SIZE), BLOCK_SIZE))
+    , m_flushInterval(flushIntervalMs)
+    , m_fdatasyncInterval(fdatasyncIntervalMs) {
+    if (!setupRing()) {
+        teardownRing();
+        return;
+    }
+
+    m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+    if (-1 == m_fd) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to open '" << m_filename << "' with O_DIRECT: " << ::strerror(errno) << std::endl;
+        teardownRing();
+        return;
+    }
+
+    m_buffers.resize(NUMBER_OF_BUFFERS);
+    for (auto &buffer : m_buffers) {
+        void *ptr{nullptr};
+        if (0 != ::posix_memalign(&ptr, BLOCK_SIZE, m_bufferSize)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to allocate aligned buffers for '" << m_filename << "'." << std::endl;
+            close();
+            return;
+        }
+        buffer.data = static_cast<char*>(ptr);
+    }
+
+    m_good = true;
+    m_lastFlush = m_lastFdatasync = std::chrono::steady_clock::now();
+}
+
+UringRecFile::~UringRecFile() {
+    close();
+}
+
+bool UringRecFile::good() const noexcept {
+    return m_good;
+}
+
+void UringRecFile::write(const char *data, std::size_t size) noexcept {
+    if (!m_good || (nullptr == data) || (0 == size)) {
+        return;
+    }
+    m_size += size;
+
+    while (m_good && (0 < size)) {
+        StagingBuffer &buffer = m_buffers[m_current];
+        const std::size_t LENGTH{std::min(size, m_bufferSize - buffer.fill)};
+        std::memcpy(buffer.data + buffer.fill, data, LENGTH);
+        buffer.fill += LENGTH;
+        data += LENGTH;
+        size -= LENGTH;
+        if (buffer.fill == m_bufferSize) {
+            submit(false);
+        }
+    }
+    flushIfDue();
+}
+
+void UringRecFile::flush() noexcept {
+    if (m_good) {
+        submit(true);
+    }
+    m_lastFlush = std::chrono::steady_clock::now();
+}
+
+void UringRecFile::flushIfDue() noexcept {
+    if (!m_good) {
+        return;
+    }
+    // Collect completions without blocking to report errors early.
+    reap(0);
+
+    auto now = std::chrono::steady_clock::now();
+    if ((0 < m_flushInterval.count()) && (0 < m_buffers[m_current].fill) && (now - m_lastFlush >= m_flushInterval)) {
+        flush();
+    }
+    if ((0 < m_fdatasyncInterval.count()) && m_pendingFdatasync && (now - m_lastFdatasync >= m_fdatasyncInterval)) {
+        submitFdatasync();
+    }
+}
+
+void UringRecFile::sync() noexcept {
+    if (-1 != m_fd) {
+        flush();
+        waitForAll();
+        if (0 != ::fdatasync(m_fd)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to fdatasync '" << m_filename << "': " << ::strerror(errno) << std::endl;
+        }
+        m_pendingFdatasync = false;
+        m_lastFdatasync = std::chrono::steady_clock::now();
+    }
+}
+
+void UringRecFile::close() noexcept {
+    if (-1 != m_fd) {
+        if (m_good) {
+            submit(true);
+        }
+        waitForAll();
+        // Remove the padding of the last block.
+        if (0 != ::ftruncate(m_fd, static_cast<off_t>(m_size))) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to truncate '" << m_filename << "': " << ::strerror(errno) << std::endl;
+        }
+        if (0 != ::fdatasync(m_fd)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to fdatasync '" << m_filename << "': " << ::strerror(errno) << std::endl;
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    for (auto &buffer : m_buffers) {
+        ::free(buffer.data);
+        buffer.data = nullptr;
+    }
+    m_buffers.clear();
+    teardownRing();
+    m_good = false;
+}
+
+void UringRecFile::preallocate(uint64_t size) noexcept {
+    if (-1 != m_fd) {
+        // Keeping the size lets close() truncate to the logical size as before.
+        ::fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+    }
+}
+
+uint64_t UringRecFile::size() const noexcept {
+    return m_size;
+}
+
+void UringRecFile::submit(bool padLastBlock) noexcept {
+    StagingBuffer &buffer = m_buffers[m_current];
+    if (0 == buffer.fill) {
+        return;
+    }
+    // A previously padded block is about to be rewritten; writes in flight are not ordered.
+    if (m_overlapInFlight) {
+        waitForAll();
+        m_overlapInFlight = false;
+    }
+
+    const std::size_t ALIGNED{buffer.fill & ~(BLOCK_SIZE - 1)};
+    const std::size_t LENGTH{padLastBlock ? roundUp(buffer.fill, BLOCK_SIZE) : ALIGNED};
+    if (0 == LENGTH) {
+        return;
+    }
+    if (LENGTH > buffer.fill) {
+        std::memset(buffer.data + buffer.fill, 0, LENGTH - buffer.fill);
+    }
+
+    buffer.iov.iov_base = buffer.data;
+    buffer.iov.iov_len = LENGTH;
+#ifdef URING_REC_FILE_ENABLED
+    if (!enqueue(IORING_OP_WRITEV, m_current, &buffer.iov, m_offset, 0, 0)) {
+        return;
+    }
+#endif
+    buffer.inFlight = true;
+    m_inFlight++;
+    m_pendingFdatasync = true;
+
+    // Carry the unaligned tail over to the next staging buffer.
+    const std::size_t TAIL{buffer.fill - ALIGNED};
+    const std::size_t NEXT{(m_current + 1) % m_buffers.size()};
+    waitFor(NEXT);
+    if (0 < TAIL) {
+        std::memcpy(m_buffers[NEXT].data, buffer.data + ALIGNED, TAIL);
+        m_overlapInFlight = padLastBlock;
+    }
+    m_buffers[NEXT].fill = TAIL;
+    buffer.fill = 0;
+    m_offset += ALIGNED;
+    m_current = NEXT;
+}
+
+void UringRecFile::submitFdatasync() noexcept {
+#ifdef URING_REC_FILE_ENABLED
+    // Drain orders the commit after all previously submitted writes.
+    if (enqueue(IORING_OP_FSYNC, FDATASYNC_TAG, nullptr, 0, IORING_FSYNC_DATASYNC, IOSQE_IO_DRAIN)) {
+        m_inFlight++;
+    }
+#endif
+    m_pendingFdatasync = false;
+    m_lastFdatasync = std::chrono::steady_clock::now();
+}
+
+void UringRecFile::waitFor(std::size_t buffer) noexcept {
+    while (m_buffers[buffer].inFlight && (-1 != m_ringFd)) {
+        reap(1);
+    }
+}
+
+void UringRecFile::waitForAll() noexcept {
+    while ((0 < m_inFlight) && (-1 != m_ringFd)) {
+        reap(1);
+    }
+}
+
+#ifdef URING_REC_FILE_ENABLED
+bool UringRecFile::setupRing() noexcept {
+    constexpr uint32_t ENTRIES{2 * NUMBER_OF_BUFFERS};
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, ENTRIES, &params));
+    if (-1 == m_ringFd) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to set up io_uring: " << ::strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    m_cqRing = ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+    m_sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if ((MAP_FAILED == m_sqRing) || (MAP_FAILED == m_cqRing) || (MAP_FAILED == m_sqes)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to map io_uring: " << ::strerror(errno) << std::endl;
+        return false;
+    }
+
+    char *sq{static_cast<char*>(m_sqRing)};
+    m_sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    char *cq{static_cast<char*>(m_cqRing)};
+    m_cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    m_cqes = cq + params.cq_off.cqes;
+    return true;
+}
+
+void UringRecFile::teardownRing() noexcept {
+    if ((nullptr != m_sqes) && (MAP_FAILED != m_sqes)) {
+        ::munmap(m_sqes, m_sqesSize);
+    }
+    if ((nullptr != m_cqRing) && (MAP_FAILED != m_cqRing)) {
+        ::munmap(m_cqRing, m_cqRingSize);
+    }
+    if ((nullptr != m_sqRing) && (MAP_FAILED != m_sqRing)) {
+        ::munmap(m_sqRing, m_sqRingSize);
+    }
+    m_sqes = m_cqRing = m_sqRing = nullptr;
+    if (-1 != m_ringFd) {
+        ::close(m_ringFd);
+        m_ringFd = -1;
+    }
+}
+
+bool UringRecFile::enqueue(uint8_t opcode, uint64_t userData, const struct iovec *iov, uint64_t offset, uint32_t fsyncFlags, uint8_t sqeFlags) noexcept {
+    const uint32_t TAIL{*m_sqTail};
+    const uint32_t INDEX{TAIL & *m_sqMask};
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*>(m_sqes) + INDEX;
+    std::memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->flags = sqeFlags;
+    sqe->fd = m_fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = (nullptr != iov) ? 1 : 0;
+    sqe->fsync_flags = fsyncFlags;
+    sqe->user_data = userData;
+    m_sqArray[INDEX] = INDEX;
+    __atomic_store_n(m_sqTail, TAIL + 1, __ATOMIC_RELEASE);
+
+    // Submit right away without waiting for the completion.
+    while (-1 == ::syscall(__NR_io_uring_enter, m_ringFd, 1, 0, 0, nullptr, 0)) {
+        if ((EINTR != errno) && (EAGAIN != errno)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to submit write for '" << m_filename << "': " << ::strerror(errno) << std::endl;
+            m_good = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+void UringRecFile::reap(uint32_t minComplete) noexcept {
+    if (-1 == m_ringFd) {
+        return;
+    }
+    if (0 < minComplete) {
+        if ((-1 == ::syscall(__NR_io_uring_enter, m_ringFd, 0, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0)) && (EINTR != errno)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to wait for writes to '" << m_filename << "': " << ::strerror(errno) << std::endl;
+            // Give up on outstanding requests to not block forever.
+            m_good = false;
+            for (auto &buffer : m_buffers) {
+                buffer.inFlight = false;
+            }
+            m_inFlight = 0;
+            return;
+        }
+    }
+
+    uint32_t head{*m_cqHead};
+    const uint32_t TAIL{__atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)};
+    while (head != TAIL) {
+        const struct io_uring_cqe *cqe = static_cast<struct io_uring_cqe*>(m_cqes) + (head & *m_cqMask);
+        if (FDATASYNC_TAG == cqe->user_data) {
+            if (0 > cqe->res) {
+                std::cerr << "[opendlv-video-h264-recorder]: Failed to fdatasync '" << m_filename << "': " << ::strerror(-cqe->res) << std::endl;
+            }
+        }
+        else if (cqe->user_data < m_buffers.size()) {
+            StagingBuffer &buffer = m_buffers[cqe->user_data];
+            if ((0 > cqe->res) || (static_cast<std::size_t>(cqe->res) != buffer.iov.iov_len)) {
+                std::cerr << "[opendlv-video-h264-recorder]: Failed to write to '" << m_filename << "': " << ((0 > cqe->res) ? ::strerror(-cqe->res) : "short write") << std::endl;
+                m_good = false;
+            }
+            buffer.inFlight = false;
+        }
+        if (0 < m_inFlight) {
+            m_inFlight--;
+        }
+        head++;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+#else
+bool UringRecFile::setupRing() noexcept {
+    std::cerr << "[opendlv-video-h264-recorder]: This binary was built without io_uring support." << std::endl;
+    return false;
+}
+
+void UringRecFile::teardownRing() noexcept {}
+
+bool UringRecFile::enqueue(uint8_t, uint64_t, const struct iovec *, uint64_t, uint32_t, uint8_t) noexcept {
+    return false;
+}
+
+void UringRecFile::reap(uint32_t) noexcept {}
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef URING_REC_FILE_HPP
+#define URING_REC_FILE_HPP
+
+#include "recording-file.hpp"
+
+#include <sys/uio.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * This class writes a .rec file with O_DIRECT, bypassing the page cache, and
+ * submits the writes asynchronously through io_uring. Data is collected in a
+ * small set of aligned staging buffers; a caller only blocks once all staging
+ * buffers are in flight. Time-based flushes write the last partial block
+ * zero-padded and rewrite it with the next submission; the file is truncated
+ * to its logical size on close.
+ *
+ * If io_uring is not available at build or run time or the file system does
+ * not support O_DIRECT, good() returns false and the caller is expected to
+ * fall back to RecFile.
+ */
+class UringRecFile : public RecordingFile {
+   private:
+    UringRecFile(const UringRecFile &) = delete;
+    UringRecFile(UringRecFile &&)      = delete;
+    UringRecFile &operator=(const UringRecFile &) = delete;
+    UringRecFile &operator=(UringRecFile &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param filename Name of the file to create; an existing file is truncated.
+     * @param flushBytes Size of each staging buffer (rounded up to the block size).
+     * @param flushIntervalMs Maximum time in milliseconds that data stays buffered; 0 disables the time limit.
+     * @param fdatasyncIntervalMs Interval in milliseconds to submit fdatasync; 0 only commits data on close.
+     */
+    UringRecFile(const std::string &filename, uint32_t flushBytes, uint32_t flushIntervalMs, uint32_t fdatasyncIntervalMs) noexcept;
+    ~UringRecFile() override;
+
+    bool good() const noexcept override;
+    void write(const char *data, std::size_t size) noexcept override;
+    void flush() noexcept override;
+    void flushIfDue() noexcept override;
+    void sync() noexcept override;
+    void close() noexcept override;
+    void preallocate(uint64_t size) noexcept override;
+    uint64_t size() const noexcept override;
+
+   public:
+    static constexpr std::size_t BLOCK_SIZE{4096};
+    static constexpr std::size_t NUMBER_OF_BUFFERS{4};
+
+   private:
+    struct StagingBuffer {
+        char *data{nullptr};
+        std::size_t fill{0};
+        bool inFlight{false};
+        struct iovec iov{nullptr, 0};
+    };
+
+   private:
+    bool setupRing() noexcept;
+    void teardownRing() noexcept;
+    void submit(bool padLastBlock) noexcept;
+    void submitFdatasync() noexcept;
+    bool enqueue(uint8_t opcode, uint64_t userData, const struct iovec *iov, uint64_t offset, uint32_t fsyncFlags, uint8_t sqeFlags) noexcept;
+    void reap(uint32_t minComplete) noexcept;
+    void waitFor(std::size_t buffer) noexcept;
+    void waitForAll() noexcept;
+
+   private:
+    std::string m_filename;
+    int m_fd{-1};
+    bool m_good{false};
+
+    std::size_t m_bufferSize{0};
+    std::chrono::milliseconds m_flushInterval;
+    std::chrono::milliseconds m_fdatasyncInterval;
+    std::chrono::steady_clock::time_point m_lastFlush{};
+    std::chrono::steady_clock::time_point m_lastFdatasync{};
+    bool m_pendingFdatasync{false};
+
+    std::vector<StagingBuffer> m_buffers{};
+    std::size_t m_current{0};
+    uint64_t m_offset{0};
+    bool m_overlapInFlight{false};
+    uint32_t m_inFlight{0};
+    uint64_t m_size{0};
+
+    // io_uring state.
+    int m_ringFd{-1};
+    void *m_sqRing{nullptr};
+    std::size_t m_sqRingSize{0};
+    void *m_cqRing{nullptr};
+    std::size_t m_cqRingSize{0};
+    void *m_sqes{nullptr};
+    std::size_t m_sqesSize{0};
+    uint32_t *m_sqTail{nullptr};
+    uint32_t *m_sqMask{nullptr};
+    uint32_t *m_sqArray{nullptr};
+    uint32_t *m_cqHead{nullptr};
+    uint32_t *m_cqTail{nullptr};
+    uint32_t *m_cqMask{nullptr};
+    void *m_cqes{nullptr};
+};
+
+#endif
@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "v4l2-encoder.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_VIDEODEV2_H
+    #include <linux/videodev2.h>
+    #define V4L2_ENCODER_ENABLED
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace {
+#ifdef V4L2_ENCODER_ENABLED
+int xioctl(int fd, unsigned long request, void *arg) noexcept {
+    int retVal{-1};
+    do {
+        retVal = ::ioctl(fd, request, arg);
+    } while ((-1 == retVal) && (EINTR == errno));
+    return retVal;
+}
+#endif
+}
+
+V4L2Encoder::V4L2Encoder(const EncoderSettings &settings, uint32_t width, uint32_t height) noexcept
+    : m_device(settings.device)
+    , m_verbose(settings.verbose)
+    , m_width(width)
+    , m_height(height) {
+#ifdef V4L2_ENCODER_ENABLED
+    m_fd = ::open(m_device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (-1 == m_fd) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to open V4L2 encoder '" << m_device << "': " << ::strerror(errno) << std::endl;
+        return;
+    }
+
+    struct v4l2_capability capability;
+    memset(&capability, 0, sizeof(capability));
+    if (-1 == xioctl(m_fd, VIDIOC_QUERYCAP, &capability)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to query '" << m_device << "': " << ::strerror(errno) << std::endl;
+        close();
+        return;
+    }
+    const uint32_t CAPABILITIES{(0 != (capability.capabilities & V4L2_CAP_DEVICE_CAPS)) ? capability.device_caps : capability.capabilities};
+    if ((0 == (CAPABILITIES & V4L2_CAP_VIDEO_M2M_MPLANE)) || (0 == (CAPABILITIES & V4L2_CAP_STREAMING))) {
+        std::cerr << "[opendlv-video-h264-recorder]: '" << m_device << "' (" << capability.card << ") is not a multi-planar memory-to-memory device." << std::endl;
+        close();
+        return;
+    }
+
+    // The encoded format is set first as some drivers derive the constraints of the raw format from it.
+    struct v4l2_format format;
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    format.fmt.pix_mp.width = m_width;
+    format.fmt.pix_mp.height = m_height;
+    format.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_H264;
+    format.fmt.pix_mp.field = V4L2_FIELD_ANY;
+    format.fmt.pix_mp.num_planes = 1;
+    format.fmt.pix_mp.plane_fmt[0].sizeimage = std::max(m_width * m_height, 512u * 1024u);
+    if ((-1 == xioctl(m_fd, VIDIOC_S_FMT, &format)) || (V4L2_PIX_FMT_H264 != format.fmt.pix_mp.pixelformat)) {
+        std::cerr << "[opendlv-video-h264-recorder]: '" << m_device << "' does not encode h264 at " << m_width << "x" << m_height << "." << std::endl;
+        close();
+        return;
+    }
+
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    format.fmt.pix_mp.width = m_width;
+    format.fmt.pix_mp.height = m_height;
+    format.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_YUV420;
+    format.fmt.pix_mp.field = V4L2_FIELD_NONE;
+    format.fmt.pix_mp.num_planes = 1;
+    format.fmt.pix_mp.plane_fmt[0].bytesperline = m_width;
+    if ((-1 == xioctl(m_fd, VIDIOC_S_FMT, &format)) || (V4L2_PIX_FMT_YUV420 != format.fmt.pix_mp.pixelformat) || (1 != format.fmt.pix_mp.num_planes)) {
+        std::cerr << "[opendlv-video-h264-recorder]: '" << m_device << "' does not accept single-plane I420 frames of " << m_width << "x" << m_height << "." << std::endl;
+        close();
+        return;
+    }
+    // The driver may pad rows and the luma plane; the chroma planes follow the padded luma plane.
+    m_strideY = format.fmt.pix_mp.plane_fmt[0].bytesperline;
+    m_sizeImage = format.fmt.pix_mp.plane_fmt[0].sizeimage;
+    m_alignedHeight = (0 < m_strideY) ? std::max(m_height, (m_sizeImage * 2) / (3 * m_strideY)) : 0;
+    if ((m_strideY < m_width) || (m_sizeImage < m_strideY * m_alignedHeight + 2 * (m_strideY / 2) * (m_alignedHeight / 2))) {
+        std::cerr << "[opendlv-video-h264-recorder]: '" << m_device << "' reported an unexpected frame layout (stride " << m_strideY << ", size " << m_sizeImage << ")." << std::endl;
+        close();
+        return;
+    }
+
+    // Keep the stream decodable by openh264-based consumers and from every IDR frame for split recordings.
+    setControl(V4L2_CID_MPEG_VIDEO_H264_PROFILE, V4L2_MPEG_VIDEO_H264_PROFILE_CONSTRAINED_BASELINE, "constrained baseline profile");
+    setControl(V4L2_CID_MPEG_VIDEO_REPEAT_SEQ_HEADER, 1, "repeating SPS/PPS");
+    setControl(V4L2_CID_MPEG_VIDEO_H264_I_PERIOD, static_cast<int32_t>(settings.gop), "I frame period");
+    setControl(V4L2_CID_MPEG_VIDEO_GOP_SIZE, static_cast<int32_t>(settings.gop), "GOP size");
+    setControl(V4L2_CID_MPEG_VIDEO_BITRATE_MODE, (1 == settings.rcMode) ? V4L2_MPEG_VIDEO_BITRATE_MODE_CBR : V4L2_MPEG_VIDEO_BITRATE_MODE_VBR, "bitrate mode");
+    setControl(V4L2_CID_MPEG_VIDEO_BITRATE, static_cast<int32_t>(settings.bitrate), "bitrate");
+    setControl(V4L2_CID_MPEG_VIDEO_BITRATE_PEAK, static_cast<int32_t>(settings.bitrateMax), "peak bitrate");
+    setControl(V4L2_CID_MPEG_VIDEO_H264_MIN_QP, static_cast<int32_t>(settings.qpMin), "minimum QP");
+    setControl(V4L2_CID_MPEG_VIDEO_H264_MAX_QP, static_cast<int32_t>(settings.qpMax), "maximum QP");
+    setFrameRate(settings.fps);
+
+    if (!mapBuffers(V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, NUMBER_OF_OUTPUT_BUFFERS, m_outputBuffers) ||
+        !mapBuffers(V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, NUMBER_OF_CAPTURE_BUFFERS, m_captureBuffers)) {
+        close();
+        return;
+    }
+    for (uint32_t i{0}; i < m_outputBuffers.size(); i++) {
+        m_freeOutputBuffers.push_back(i);
+    }
+    for (uint32_t i{0}; i < m_captureBuffers.size(); i++) {
+        if (!queueCaptureBuffer(i)) {
+            close();
+            return;
+        }
+    }
+
+    int type{V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE};
+    if (-1 == xioctl(m_fd, VIDIOC_STREAMON, &type)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to start streaming to '" << m_device << "': " << ::strerror(errno) << std::endl;
+        close();
+        return;
+    }
+    m_streaming = true;
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    if (-1 == xioctl(m_fd, VIDIOC_STREAMON, &type)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to start streaming from '" << m_device << "': " << ::strerror(errno) << std::endl;
+        close();
+        return;
+    }
+
+    if (!settings.layers.empty()) {
+        std::cerr << "[opendlv-video-h264-recorder]: Warning, '" << m_device << "' only encodes the full resolution; ignoring downscaled layers." << std::endl;
+    }
+    if (m_verbose) {
+        std::clog << "[opendlv-video-h264-recorder]: Encoding " << m_width << "x" << m_height << " with '" << m_device << "' (" << capability.card << ", " << capability.driver << ")." << std::endl;
+    }
+    m_valid = true;
+#else
+    std::cerr << "[opendlv-video-h264-recorder]: V4L2 encoder '" << m_device << "' not available in this build." << std::endl;
+#endif
+}
+
+V4L2Encoder::~V4L2Encoder() {
+    close();
+}
+
+bool V4L2Encoder::valid() const noexcept {
+    return m_valid;
+}
+
+std::size_t V4L2Encoder::encode(const I420Picture &picture, std::vector<EncodedLayer> &layers, bool &isKeyFrame) noexcept {
+    std::size_t totalSize{0};
+    layers.resize(1);
+    layers[0].width = m_width;
+    layers[0].height = m_height;
+    layers[0].size = 0;
+    layers[0].chunks.clear();
+    isKeyFrame = false;
+#ifdef V4L2_ENCODER_ENABLED
+    if (!m_valid) {
+        return totalSize;
+    }
+
+    // The encoded frame handed out by the previous call is no longer referenced.
+    if (0 <= m_pendingCaptureBuffer) {
+        queueCaptureBuffer(static_cast<uint32_t>(m_pendingCaptureBuffer));
+        m_pendingCaptureBuffer = -1;
+    }
+
+    // Reclaim the OUTPUT buffers that the encoder has consumed.
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buffer;
+    do {
+        memset(&buffer, 0, sizeof(buffer));
+        memset(planes, 0, sizeof(planes));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.m.planes = planes;
+        buffer.length = 1;
+        if (0 == xioctl(m_fd, VIDIOC_DQBUF, &buffer)) {
+            m_freeOutputBuffers.push_back(buffer.index);
+        }
+        else if (m_freeOutputBuffers.empty() && !waitFor(POLLOUT)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Warning, '" << m_device << "' did not return an input buffer; skipping frame." << std::endl;
+            return totalSize;
+        }
+    } while (m_freeOutputBuffers.empty());
+
+    const uint32_t INDEX{m_freeOutputBuffers.back()};
+    m_freeOutputBuffers.pop_back();
+    uint8_t *y{m_outputBuffers[INDEX].data};
+    uint8_t *u{y + m_strideY * m_alignedHeight};
+    uint8_t *v{u + (m_strideY / 2) * (m_alignedHeight / 2)};
+    for (uint32_t row{0}; row < m_height; row++) {
+        memcpy(y + row * m_strideY, picture.y + row * picture.strideY, m_width);
+    }
+    for (uint32_t row{0}; row < m_height / 2; row++) {
+        memcpy(u + row * (m_strideY / 2), picture.u + row * picture.strideUV, m_width / 2);
+        memcpy(v + row * (m_strideY / 2), picture.v + row * picture.strideUV, m_width / 2);
+    }
+
+    memset(&buffer, 0, sizeof(buffer));
+    memset(planes, 0, sizeof(planes));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = INDEX;
+    buffer.m.planes = planes;
+    buffer.length = 1;
+    planes[0].bytesused = m_sizeImage;
+    planes[0].length = static_cast<uint32_t>(m_outputBuffers[INDEX].length);
+    if (-1 == xioctl(m_fd, VIDIOC_QBUF, &buffer)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to queue frame to '" << m_device << "': " << ::strerror(errno) << std::endl;
+        m_freeOutputBuffers.push_back(INDEX);
+        return totalSize;
+    }
+
+    // Stateful encoders return one CAPTURE buffer per frame.
+    memset(&buffer, 0, sizeof(buffer));
+    memset(planes, 0, sizeof(planes));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.m.planes = planes;
+    buffer.length = 1;
+    while (-1 == xioctl(m_fd, VIDIOC_DQBUF, &buffer)) {
+        if ((EAGAIN != errno) || !waitFor(POLLIN)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Warning, no encoded frame from '" << m_device << "'; skipping frame." << std::endl;
+            return totalSize;
+        }
+    }
+    if ((0 != (buffer.flags & V4L2_BUF_FLAG_ERROR)) || (planes[0].bytesused <= planes[0].data_offset)) {
+        queueCaptureBuffer(buffer.index);
+        return totalSize;
+    }
+
+    m_pendingCaptureBuffer = static_cast<int32_t>(buffer.index);
+    isKeyFrame = (0 != (buffer.flags & V4L2_BUF_FLAG_KEYFRAME));
+    totalSize = planes[0].bytesused - planes[0].data_offset;
+    layers[0].size = totalSize;
+    layers[0].chunks.push_back(PayloadChunk{reinterpret_cast<char*>(m_captureBuffers[buffer.index].data + planes[0].data_offset), totalSize});
+#else
+    (void)picture;
+#endif
+    return totalSize;
+}
+
+void V4L2Encoder::forceKeyFrame() noexcept {
+#ifdef V4L2_ENCODER_ENABLED
+    if (m_valid) {
+        setControl(V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1, "forcing key frames");
+    }
+#endif
+}
+
+bool V4L2Encoder::setFrameRate(float fps) noexcept {
+    bool retVal{false};
+#ifdef V4L2_ENCODER_ENABLED
+    if ((-1 != m_fd) && (0.0f < fps)) {
+        struct v4l2_streamparm parameters;
+        memset(&parameters, 0, sizeof(parameters));
+        parameters.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        parameters.parm.output.timeperframe.numerator = 1000;
+        parameters.parm.output.timeperframe.denominator = static_cast<uint32_t>(fps * 1000.0f);
+        retVal = (0 == xioctl(m_fd, VIDIOC_S_PARM, &parameters));
+    }
+#else
+    (void)fps;
+#endif
+    return retVal;
+}
+
+bool V4L2Encoder::setBitrate(uint32_t bitrate) noexcept {
+#ifdef V4L2_ENCODER_ENABLED
+    return m_valid && setControl(V4L2_CID_MPEG_VIDEO_BITRATE, static_cast<int32_t>(bitrate), "bitrate");
+#else
+    (void)bitrate;
+    return false;
+#endif
+}
+
+bool V4L2Encoder::setComplexity(uint32_t) noexcept {
+    return false;
+}
+
+bool V4L2Encoder::setFrameSkip(bool frameSkip) noexcept {
+#if defined(V4L2_ENCODER_ENABLED) && defined(V4L2_CID_MPEG_VIDEO_FRAME_SKIP_MODE)
+    // Frame skipping controls were added in Linux 5.7.
+    return m_valid && setControl(V4L2_CID_MPEG_VIDEO_FRAME_SKIP_MODE, frameSkip ? V4L2_MPEG_VIDEO_FRAME_SKIP_MODE_BUF_LIMIT : V4L2_MPEG_VIDEO_FRAME_SKIP_MODE_DISABLED, "frame skipping");
+#else
+    (void)frameSkip;
+    return false;
+#endif
+}
+
+bool V4L2Encoder::resize(uint32_t /*width*/, uint32_t /*height*/) noexcept {
+    // Changing the format requires to stop streaming and to reallocate all buffers, which equals recreating the encoder.
+    return false;
+}
+
+uint32_t V4L2Encoder::width() const noexcept {
+    return m_width;
+}
+
+uint32_t V4L2Encoder::height() const noexcept {
+    return m_height;
+}
+
+bool V4L2Encoder::setControl(uint32_t id, int32_t value, const char *name) noexcept {
+    bool retVal{false};
+#ifdef V4L2_ENCODER_ENABLED
+    struct v4l2_control control;
+    memset(&control, 0, sizeof(control));
+    control.id = id;
+    control.value = value;
+    retVal = (0 == xioctl(m_fd, VIDIOC_S_CTRL, &control));
+    if (!retVal && m_verbose) {
+        std::clog << "[opendlv-video-h264-recorder]: Warning, '" << m_device << "' does not support " << name << ": " << ::strerror(errno) << std::endl;
+    }
+#else
+    (void)id;
+    (void)value;
+    (void)name;
+#endif
+    return retVal;
+}
+
+bool V4L2Encoder::mapBuffers(uint32_t type, uint32_t count, std::vector<MappedBuffer> &buffers) noexcept {
+#ifdef V4L2_ENCODER_ENABLED
+    struct v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.count = count;
+    request.type = type;
+    request.memory = V4L2_MEMORY_MMAP;
+    if ((-1 == xioctl(m_fd, VIDIOC_REQBUFS, &request)) || (0 == request.count)) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to allocate buffers on '" << m_device << "': " << ::strerror(errno) << std::endl;
+        return false;
+    }
+
+    buffers.resize(request.count);
+    for (uint32_t i{0}; i < request.count; i++) {
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
+        struct v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        memset(planes, 0, sizeof(planes));
+        buffer.type = type;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        buffer.m.planes = planes;
+        buffer.length = 1;
+        if (-1 == xioctl(m_fd, VIDIOC_QUERYBUF, &buffer)) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to query buffer " << i << " on '" << m_device << "': " << ::strerror(errno) << std::endl;
+            return false;
+        }
+        void *data{::mmap(nullptr, planes[0].length, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, planes[0].m.mem_offset)};
+        if (MAP_FAILED == data) {
+            std::cerr << "[opendlv-video-h264-recorder]: Failed to map buffer " << i << " of '" << m_device << "': " << ::strerror(errno) << std::endl;
+            return false;
+        }
+        buffers[i].data = static_cast<uint8_t*>(data);
+        buffers[i].length = planes[0].length;
+    }
+    return true;
+#else
+    (void)type;
+    (void)count;
+    (void)buffers;
+    return false;
+#endif
+}
+
+bool V4L2Encoder::queueCaptureBuffer(uint32_t index) noexcept {
+    bool retVal{false};
+#ifdef V4L2_ENCODER_ENABLED
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    memset(planes, 0, sizeof(planes));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = index;
+    buffer.m.planes = planes;
+    buffer.length = 1;
+    planes[0].length = static_cast<uint32_t>(m_captureBuffers[index].length);
+    retVal = (0 == xioctl(m_fd, VIDIOC_QBUF, &buffer));
+    if (!retVal) {
+        std::cerr << "[opendlv-video-h264-recorder]: Failed to queue buffer " << index << " on '" << m_device << "': " << ::strerror(errno) << std::endl;
+    }
+#else
+    (void)index;
+#endif
+    return retVal;
+}
+
+bool V4L2Encoder::waitFor(short events) noexcept {
+    struct pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    int result{-1};
+    do {
+        result = ::poll(&pfd, 1, POLL_TIMEOUT_MS);
+    } while ((-1 == result) && (EINTR == errno));
+    return (0 < result) && (0 != (pfd.revents & events));
+}
+
+void V4L2Encoder::close() noexcept {
+    m_valid = false;
+#ifdef V4L2_ENCODER_ENABLED
+    if (m_streaming) {
+        int type{V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE};
+        xioctl(m_fd, VIDIOC_STREAMOFF, &type);
+        type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        xioctl(m_fd, VIDIOC_STREAMOFF, &type);
+        m_streaming = false;
+    }
+#endif
+    for (auto &buffer : m_outputBuffers) {
+        if (nullptr != buffer.data) {
+            ::munmap(buffer.data, buffer.length);
+        }
+    }
+    m_outputBuffers.clear();
+    m_freeOutputBuffers.clear();
+    for (auto &buffer : m_captureBuffers) {
+        if (nullptr != buffer.data) {
+            ::munmap(buffer.data, buffer.length);
+        }
+    }
+    m_captureBuffers.clear();
+    m_pendingCaptureBuffer = -1;
+    if (-1 != m_fd) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
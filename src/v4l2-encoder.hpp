@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef V4L2_ENCODER_HPP
+#define V4L2_ENCODER_HPP
+
+#include "video-encoder.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * This class encodes I420 frames into h264 using a stateful V4L2 memory-to-memory
+ * encoder such as the hardware encoders of the Raspberry Pi (/dev/video11) or
+ * other SoCs exposing the multi-planar V4L2 M2M API. Frames are copied into
+ * memory-mapped OUTPUT buffers; the encoded frame is handed out directly from
+ * the memory-mapped CAPTURE buffer, which is requeued on the next call to encode.
+ *
+ * Downscaled layers are not supported; only the full resolution is encoded.
+ *
+ * If V4L2 is not available at build time or the device cannot be configured,
+ * valid() returns false and the caller is expected to fall back to H264Encoder.
+ */
+class V4L2Encoder : public VideoEncoder {
+   private:
+    V4L2Encoder(const V4L2Encoder &) = delete;
+    V4L2Encoder(V4L2Encoder &&)      = delete;
+    V4L2Encoder &operator=(const V4L2Encoder &) = delete;
+    V4L2Encoder &operator=(V4L2Encoder &&) = delete;
+
+   public:
+    /**
+     * Constructor.
+     *
+     * @param settings Encoder settings; device, gop, bitrate, bitrateMax, rcMode, qpMin, qpMax, and fps are used.
+     * @param width Width of the frames to encode.
+     * @param height Height of the frames to encode.
+     */
+    V4L2Encoder(const EncoderSettings &settings, uint32_t width, uint32_t height) noexcept;
+    ~V4L2Encoder() override;
+
+    bool valid() const noexcept override;
+    std::size_t encode(const I420Picture &picture, std::vector<EncodedLayer> &layers, bool &isKeyFrame) noexcept override;
+    void forceKeyFrame() noexcept override;
+    bool setFrameRate(float fps) noexcept override;
+    bool setBitrate(uint32_t bitrate) noexcept override;
+    bool setComplexity(uint32_t complexity) noexcept override;
+    bool setFrameSkip(bool frameSkip) noexcept override;
+    bool resize(uint32_t width, uint32_t height) noexcept override;
+    uint32_t width() const noexcept override;
+    uint32_t height() const noexcept override;
+
+   public:
+    static constexpr uint32_t NUMBER_OF_OUTPUT_BUFFERS{2};
+    static constexpr uint32_t NUMBER_OF_CAPTURE_BUFFERS{4};
+    static constexpr int POLL_TIMEOUT_MS{1000};
+
+   private:
+    struct MappedBuffer {
+        uint8_t *data{nullptr};
+        std::size_t length{0};
+    };
+
+    bool setControl(uint32_t id, int32_t value, const char *name) noexcept;
+    bool mapBuffers(uint32_t type, uint32_t count, std::vector<MappedBuffer> &buffers) noexcept;
+    bool queueCaptureBuffer(uint32_t index) noexcept;
+    bool waitFor(short events) noexcept;
+    void close() noexcept;
+
+   private:
+    std::string m_device;
+    bool m_valid{false};
+    bool m_verbose{false};
+    uint32_t m_width;
+    uint32_t m_height;
+    int m_fd{-1};
+    bool m_streaming{false};
+
+    // Layout of the OUTPUT buffers as negotiated with the driver.
+    uint32_t m_strideY{0};
+    uint32_t m_alignedHeight{0};
+    uint32_t m_sizeImage{0};
+
+    std::vector<MappedBuffer> m_outputBuffers{};
+    std::vector<uint32_t> m_freeOutputBuffers{};
+    std::vector<MappedBuffer> m_captureBuffers{};
+    int32_t m_pendingCaptureBuffer{-1};
+};
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2019  Christian Berger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIDEO_ENCODER_HPP
+#define VIDEO_ENCODER_HPP
+
+#include "envelope-serializer.hpp"
+#include "frame-converter.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * This struct holds the encoder settings given on the command line. Backends
+ * other than openh264 only use the settings that they support.
+ */
+struct EncoderSettings {
+    std::string backend{"openh264"}; // openh264 or v4l2.
+    std::string device{"/dev/video11"}; // Encoder device for the v4l2 backend.
+    uint32_t gop{10};
+    uint32_t bitrate{1500000};
+    uint32_t bitrateMax{5000000};
+    uint32_t rcMode{0};
+    uint32_t ecomplexity{0};
+    uint32_t spsPpsStrategy{0};
+    uint32_t numRefFrame{1};
+    uint32_t prefixNal{0};
+    uint32_t ssei{0};
+    uint32_t padding{0};
+    uint32_t entropyCoding{0};
+    uint32_t frameSkip{1};
+    uint32_t qpMax{42};
+    uint32_t qpMin{12};
+    uint32_t longTermReference{0};
+    uint32_t loopFilter{0};
+    uint32_t denoise{0};
+    uint32_t backgroundDetection{1};
+    uint32_t adaptiveQuant{1};
+    uint32_t frameCropping{1};
+    uint32_t sceneChangeDetect{1};
+    float fps{20}; // Initial frame rate for the rate control.
+    bool autoFps{true}; // Adapt the frame rate to the measured inter-arrival times.
+    int32_t threads{-1}; // -1 to select from the frame size and the number of cores; 0 to let openh264 use all cores.
+    int32_t sliceMode{-1}; // SliceModeEnum; -1 to select from threads and frame size.
+    uint32_t slices{0}; // Number of slices for SM_FIXEDSLCNUM_SLICE; 0 to select from threads and frame size.
+    std::vector<uint32_t> layers{}; // Divisors of width and height for extra downscaled layers, e.g., 2 and 4.
+    bool verbose{false};
+};
+
+/**
+ * This struct references one spatial layer of an encoded frame.
+ */
+struct EncodedLayer {
+    uint32_t width{0};
+    uint32_t height{0};
+    std::size_t size{0};
+    std::vector<PayloadChunk> chunks{};
+};
+
+/**
+ * This interface describes an encoder that turns I420 frames into an h264
+ * Annex B byte stream. Implementations are not thread-safe.
+ */
+class VideoEncoder {
+   public:
+    virtual ~VideoEncoder() = default;
+
+    /**
+     * @return True if the encoder was successfully initialized.
+     */
+    virtual bool valid() const noexcept = 0;
+
+    /**
+     * This method encodes an I420 frame into the full resolution and all
+     * downscaled layers. The resulting chunks reference memory owned by the
+     * encoder that stays valid until the next call to encode.
+     *
+     * @param picture Planes of the I420 frame of width x height.
+     * @param layers Encoded layers starting with the full resolution followed by
+     *        the downscaled layers in the order of EncoderSettings::layers (output);
+     *        a layer without chunks was skipped.
+     * @param isKeyFrame True if the encoded frame is an IDR frame (output).
+     * @return Size in bytes of all layers; 0 if the frame was skipped or could not be encoded.
+     */
+    virtual std::size_t encode(const I420Picture &picture, std::vector<EncodedLayer> &layers, bool &isKeyFrame) noexcept = 0;
+
+    /**
+     * This method makes the encoder emit an IDR frame for the next frame.
+     */
+    virtual void forceKeyFrame() noexcept = 0;
+
+    /**
+     * This method changes the frame rate assumed by the rate control.
+     *
+     * @param fps New frame rate.
+     * @return True if the encoder accepted the new frame rate.
+     */
+    virtual bool setFrameRate(float fps) noexcept = 0;
+
+    /**
+     * This method changes the target bitrate of the full resolution; downscaled
+     * layers are scaled accordingly.
+     *
+     * @param bitrate New target bitrate.
+     * @return True if the encoder accepted the new bitrate.
+     */
+    virtual bool setBitrate(uint32_t bitrate) noexcept = 0;
+
+    /**
+     * This method changes the complexity mode (0: low, 1: medium, 2: high).
+     *
+     * @param complexity New complexity mode.
+     * @return True if the encoder supports and accepted the new complexity mode.
+     */
+    virtual bool setComplexity(uint32_t complexity) noexcept = 0;
+
+    /**
+     * This method toggles skipping frames in the rate control to keep the bitrate within limits.
+     *
+     * @param frameSkip True to allow skipping frames.
+     * @return True if the encoder supports and accepted the setting.
+     */
+    virtual bool setFrameSkip(bool frameSkip) noexcept = 0;
+
+    /**
+     * This method changes the resolution of the frames to encode in place so
+     * that the encoder keeps its other settings; the next frame is an IDR frame.
+     *
+     * @param width New width of the frames to encode.
+     * @param height New height of the frames to encode.
+     * @return True if the encoder was reconfigured; false if it needs to be recreated.
+     */
+    virtual bool resize(uint32_t width, uint32_t height) noexcept = 0;
+
+    virtual uint32_t width() const noexcept = 0;
+    virtual uint32_t height() const noexcept = 0;
+
+   public:
+    // Chunks per encoded frame to reserve; matches openh264's MAX_LAYER_NUM_OF_FRAME.
+    static constexpr std::size_t MAX_CHUNKS{128};
+    // Downscaled layers in addition to the full resolution; openh264 supports four spatial layers.
+    static constexpr std::size_t MAX_EXTRA_LAYERS{3};
+};
+
+#endif